@@ -1,8 +1,14 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
+#include "DocumentFilter.h"
+#include "DocumentLoader.h"
+#include "InvertedIndex.h"
 #include "RelativeIndex.h"
+#include "Snippet.h"
+#include "TextAnalyzer.h"
 
 class ConverterJSON {
   public:
@@ -14,21 +20,108 @@ class ConverterJSON {
     */
     std::vector<std::string> GetTextDocuments();
 
+    /**
+     * Resolves the paths of the files listed in config.json.
+     * @return Full path of each listed file.
+    */
+     std::vector<std::string> GetDocumentPaths();
+
+    /**
+     * Loads the files listed in config.json concurrently via memory mapping.
+     * @return Mapped contents of each readable file.
+    */
+     std::shared_ptr<const MappedDocuments> LoadTextDocuments();
+
+    /**
+     * Builds the metadata of loaded documents from their paths and optional sidecar files.
+     * @param documents Documents returned by LoadTextDocuments.
+     * @return Metadata of each document, in document order.
+    */
+     std::vector<DocumentMetadata> GetDocumentMetadata(const MappedDocuments& documents);
+
+    /**
+     * Reads the optional load_queue_depth field from config.json.
+     * @return Number of files loaded concurrently, 0 for one per hardware thread.
+    */
+     size_t GetLoadQueueDepth();
+
     /**
      * Reads the max_responses field from config.json.
      * @return Maximum number of responses.
     */
      int GetResponsesLimit();
 
+    /**
+     * Reads the optional memory_limit field from config.json.
+     * @return Memory budget for the postings in bytes, 0 if unlimited.
+    */
+     size_t GetMemoryLimit();
+
+    /**
+     * Builds the analysis stage from the optional analysis section of config.json.
+     * @return Analyzer with the configured stop words and stemming.
+    */
+     TextAnalyzer GetTextAnalyzer();
+
+    /**
+     * Reads the optional deduplication field from config.json.
+     * @return Maximum SimHash distance for near duplicates, -1 if deduplication is disabled.
+    */
+     int GetDeduplicationDistance();
+
+    /**
+     * Reads the optional impact_ordering section from config.json.
+     * @return Which frequent terms get impact-ordered postings and how long the lists are.
+    */
+     ImpactOrdering GetImpactOrdering();
+
+    /**
+     * Reads the optional common_term_frequency field from config.json.
+     * @return Document frequency above which query terms only score candidates, 0 for none.
+    */
+     size_t GetCommonTermFrequency();
+
+    /**
+     * Reads the optional explain flag from config.json.
+     * @return True if query plans should be printed.
+    */
+     bool GetExplainQueries();
+
+    /**
+     * Reads the optional snippets field from config.json.
+     * @return Snippet window and highlight markers; window_bytes is 0 if snippets are not requested.
+    */
+     SnippetOptions GetSnippetOptions();
+
+    /**
+     * Reads the optional numa flag from config.json.
+     * @return True if the index should be replicated on every NUMA node.
+    */
+     bool GetNumaPlacement();
+
+    /**
+     * Reads the optional stats_file field from config.json.
+     * @return Path of the metrics report, or an empty string if none is configured.
+    */
+     std::string GetStatsFile();
+
     /**
      * Retrieves search requests from requests.json file.
      * @return Vector containing the search requests.
     */
      std::vector<std::string> GetRequests();
 
+    /**
+     * Reads the optional filter expression from requests.json.
+     * @return Metadata filter applied to every request; empty if none is given.
+    */
+     DocumentFilter GetRequestFilter();
+
     /**
      * Writes the answers to answers.json file.
      * @param answers Vector of vectors containing RelativeIndex objects for each request.
+     * @param snippets Snippet of every answer, in the same order; empty to write none.
     */
-     void putAnswers(const std::vector<std::vector<RelativeIndex>>& answers);
+     void putAnswers(const std::vector<std::vector<RelativeIndex>>& answers,
+                     const std::vector<std::vector<Snippet>>& snippets = {});
 };
\ No newline at end of file
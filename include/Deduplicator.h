@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Fingerprints of a document used to detect copies at ingestion time.
+ */
+struct DocumentFingerprint {
+  uint64_t content_hash = 0; // Hash of the normalized text, equal for exact copies.
+  uint64_t simhash = 0; // SimHash over the document terms, close for near copies.
+};
+
+/**
+ * @brief Counters describing what deduplication removed from the index.
+ */
+struct DeduplicationStats {
+  size_t exact_duplicates = 0; // Documents identical to an earlier one after normalization.
+  size_t near_duplicates = 0; // Documents whose SimHash is within the distance of an earlier one.
+  size_t postings_saved = 0; // Postings entries that were not indexed.
+};
+
+/**
+ * @brief Streams documents in id order and maps every copy to the first document it duplicates.
+ * Near copies are found with SimHash: the 64 bits are split into max_distance + 1 bands, so two
+ * fingerprints within the distance share at least one band (LSH candidates), and candidates are
+ * confirmed by Hamming distance.
+ */
+class Deduplicator {
+  public:
+    /**
+     * @param max_distance Largest Hamming distance between SimHashes treated as a near copy.
+     */
+    explicit Deduplicator(unsigned max_distance = 3);
+
+    /**
+     * Computes the fingerprints of a document.
+     * @param text The normalized document text.
+     * @param word_counts Term frequencies of the document.
+     * @return Exact and SimHash fingerprints.
+     */
+    static DocumentFingerprint Fingerprint(std::string_view text,
+                                           const std::pmr::unordered_map<std::string_view, size_t>& word_counts);
+
+    /**
+     * Registers the next document. Documents must be added in increasing id order.
+     * @param doc_id Document id.
+     * @param fingerprint Fingerprints of the document.
+     * @return doc_id if the document is new, otherwise the id of the document it duplicates.
+     */
+    size_t Add(size_t doc_id, const DocumentFingerprint& fingerprint);
+
+    /**
+     * @return Counts of exact and near duplicates seen so far.
+     */
+    const DeduplicationStats& GetStats() const;
+
+  private:
+    unsigned _max_distance;
+    size_t _band_count;
+    std::unordered_map<uint64_t, size_t> _exact; // Content hash -> canonical document.
+    std::vector<std::unordered_map<uint64_t, std::vector<size_t>>> _bands; // Band value -> canonical documents.
+    std::unordered_map<size_t, uint64_t> _simhashes; // Canonical document -> SimHash.
+    DeduplicationStats _stats;
+
+    uint64_t BandValue(uint64_t simhash, size_t band) const;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Compressed set of document IDs in the style of a Roaring bitmap.
+ * IDs are split into a 16-bit high part, which selects a container, and a 16-bit low
+ * part stored in it. Sparse containers are sorted arrays of low parts; containers with
+ * more than 4096 IDs switch to a 65536-bit bitmap, so no container exceeds 8 KiB.
+ */
+class DocumentBitmap {
+  public:
+    DocumentBitmap() = default;
+
+    /**
+     * Adds a document. Adding IDs in increasing order is the fast path.
+     * @param doc_id Document ID below 2^32.
+     */
+    void Add(size_t doc_id);
+
+    /**
+     * Removes a document if it is in the set.
+     * @param doc_id Document ID.
+     */
+    void Remove(size_t doc_id);
+
+    /**
+     * @param doc_id Document ID.
+     * @return True if the document is in the set.
+     */
+    bool Contains(size_t doc_id) const;
+
+    /**
+     * @return Number of documents in the set.
+     */
+    size_t Cardinality() const;
+
+    /**
+     * @return True if the set holds no document.
+     */
+    bool Empty() const;
+
+    /**
+     * @return Heap bytes used by the containers.
+     */
+    size_t SizeInBytes() const;
+
+    /**
+     * Keeps only the documents that are also in other.
+     * @param other Set to intersect with.
+     */
+    void IntersectWith(const DocumentBitmap& other);
+
+    /**
+     * Adds every document of other.
+     * @param other Set to merge in.
+     */
+    void UnionWith(const DocumentBitmap& other);
+
+    /**
+     * @return Document IDs in increasing order.
+     */
+    std::vector<size_t> ToVector() const;
+
+    /**
+     * @return 32-bit FNV-1a of the document IDs in increasing order; equal sets hash
+     * equally whatever their containers, in every process.
+     */
+    uint32_t Hash() const;
+
+  private:
+    /**
+     * @brief IDs sharing the same high 16 bits, as a sorted array or as a bitmap.
+     */
+    struct Container {
+      uint32_t key = 0; // High 16 bits of the IDs.
+      std::vector<uint16_t> array; // Sorted low bits while the container is sparse.
+      std::vector<uint64_t> bits; // 1024 words once the container is dense, empty otherwise.
+      size_t cardinality = 0;
+
+      bool IsBitmap() const { return !bits.empty(); }
+      bool Contains(uint16_t low) const;
+      void Add(uint16_t low);
+      bool Remove(uint16_t low);
+      void ToBitmap();
+      void ToArrayIfSparse();
+    };
+
+    std::vector<Container> containers; // Sorted by key.
+
+    const Container* Find(uint32_t key) const;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Metadata fields of one document, such as its directory, file type or date.
+ */
+using DocumentMetadata = std::map<std::string, std::string>;
+
+/**
+ * @brief Restricts a search to documents whose metadata matches every clause.
+ * A clause either lists accepted values of a field or gives an inclusive range of values.
+ * Values compare as strings, so dates should be written as YYYY-MM-DD.
+ */
+class DocumentFilter {
+  public:
+    /**
+     * @brief Condition on a single metadata field.
+     */
+    struct Clause {
+      std::string field;
+      std::vector<std::string> values; // Accepted values, for equality clauses.
+      bool is_range = false;
+      std::string low; // Inclusive lower bound of a range; empty means unbounded.
+      std::string high; // Inclusive upper bound of a range; empty means unbounded.
+    };
+
+    DocumentFilter() = default;
+
+    /**
+     * Parses a filter expression made of whitespace-separated clauses:
+     * "field:value", "field:a,b,c" (any of the values) or "field:low..high" (inclusive range,
+     * either bound may be omitted). All clauses must match.
+     * @param expression The filter expression.
+     * @return The parsed filter.
+     */
+    static DocumentFilter Parse(std::string_view expression);
+
+    /**
+     * Adds a clause accepting any of the given values.
+     * @param field Metadata field.
+     * @param values Accepted values.
+     * @return This filter.
+     */
+    DocumentFilter& Where(std::string field, std::vector<std::string> values);
+
+    /**
+     * Adds a clause accepting an inclusive range of values.
+     * @param field Metadata field.
+     * @param low Lower bound; empty for none.
+     * @param high Upper bound; empty for none.
+     * @return This filter.
+     */
+    DocumentFilter& Between(std::string field, std::string low, std::string high);
+
+    /**
+     * @return True if the filter has no clause and accepts every document.
+     */
+    bool Empty() const;
+
+    /**
+     * @return Clauses of the filter.
+     */
+    const std::vector<Clause>& Clauses() const;
+
+  private:
+    std::vector<Clause> clauses;
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Read-only contents of a set of document files.
+ * Files are memory-mapped where the platform allows it, so documents can be
+ * tokenized straight from the mapped pages without copying them into strings.
+ * Reading a mapped file that was truncated since it was loaded raises SIGBUS, so files
+ * that may change while loaded are copied instead (see DocumentLoader).
+ */
+class MappedDocuments {
+  public:
+    MappedDocuments() = default;
+    ~MappedDocuments();
+
+    MappedDocuments(const MappedDocuments&) = delete;
+    MappedDocuments& operator=(const MappedDocuments&) = delete;
+    MappedDocuments(MappedDocuments&& other) noexcept;
+    MappedDocuments& operator=(MappedDocuments&& other) noexcept;
+
+    /**
+     * @return Number of loaded documents.
+     */
+    size_t size() const;
+
+    /**
+     * @param doc_id Index of the document in load order.
+     * @return Contents of the document; valid while this object is alive.
+     */
+    std::string_view operator[](size_t doc_id) const;
+
+    /**
+     * @return True if some documents point into file mappings rather than owned copies.
+     */
+    bool Mapped() const;
+
+    /**
+     * @return Total size of the loaded documents in bytes.
+     */
+    size_t TotalBytes() const;
+
+    /**
+     * @return Paths of the loaded documents, in document order.
+     */
+    const std::vector<std::string>& Paths() const;
+
+    /**
+     * @return Paths that could not be opened and were skipped.
+     */
+    const std::vector<std::string>& FailedPaths() const;
+
+    /**
+     * @return Wall-clock time spent loading, in seconds.
+     */
+    double LoadSeconds() const;
+
+    /**
+     * @return Load throughput in gigabytes per second.
+     */
+    double GigabytesPerSecond() const;
+
+  private:
+    friend class DocumentLoader;
+
+    /**
+     * @brief One loaded file: a mapping, or a heap buffer where mapping is not available.
+     */
+    struct Mapping {
+      const char* data = nullptr;
+      size_t size = 0;
+      bool mapped = false;
+      std::unique_ptr<char[]> buffer;
+      bool loaded = false;
+    };
+
+    std::vector<Mapping> mappings;
+    std::vector<std::string> paths;
+    std::vector<std::string> failed_paths;
+    size_t total_bytes = 0;
+    double load_seconds = 0.0;
+
+    void Release();
+};
+
+/**
+ * @brief Opens and maps document files concurrently.
+ * Up to queue_depth files are in flight at once; each worker opens a file, maps it and
+ * prefaults its pages, so the storage device sees queue_depth outstanding reads.
+ */
+class DocumentLoader {
+  public:
+    /**
+     * @param queue_depth Number of files loaded concurrently; 0 uses the hardware concurrency.
+     * @param copy_files True to read the files into owned buffers instead of mapping them,
+     * for files that may be rewritten or truncated while the documents are in use.
+     */
+    explicit DocumentLoader(size_t queue_depth = 0, bool copy_files = false);
+
+    /**
+     * Loads the given files. Files that cannot be opened are skipped and reported.
+     * @param paths Paths of the document files.
+     * @return Contents of the loaded files in the order of paths.
+     */
+    MappedDocuments Load(const std::vector<std::string>& paths) const;
+
+  private:
+    size_t _queue_depth;
+    bool _copy_files;
+};
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * @brief Absolute relevance of a document: the summed counts of the query terms in it.
+ * Unlike RelativeIndex, scores from different parts of a corpus can be compared and merged.
+ */
+struct DocumentScore {
+  size_t doc_id; // Document ID
+  size_t score; // Sum of the counts of the query terms in the document
+
+  /**
+   * Equality operator to compare two DocumentScore objects.
+   * @param other Another DocumentScore object to compare with.
+   * @return True if both doc_id and score are equal; otherwise, false.
+   */
+  bool operator==(const DocumentScore& other) const {
+    return doc_id == other.doc_id && score == other.score;
+  }
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "DocumentLoader.h"
+#include "InvertedIndex.h"
+
+/**
+ * @brief What is known about a document file, used to tell real changes from touches.
+ */
+struct FileFingerprint {
+  bool exists = false;
+  uint64_t size = 0;
+  int64_t mtime_ns = 0;
+  uint64_t content_hash = 0;
+};
+
+/**
+ * @brief Outcome of one batch of file changes applied to the index.
+ */
+struct WatchBatch {
+  size_t updated = 0; // Documents re-indexed (modified, deleted or added).
+  size_t unchanged = 0; // Files that were reported but whose contents had not changed.
+  double index_ms = 0.0; // Time spent re-indexing.
+  double searchable_ms = 0.0; // From the first change of the batch until it was searchable.
+};
+
+/**
+ * @brief Keeps an index in sync with its document files.
+ * The directories of the files are watched with inotify. Events are debounced: a batch
+ * is applied once no event has arrived for the debounce interval, so a burst of writes
+ * costs one update. Every reported file is compared with its fingerprint (size, mtime and
+ * content hash) and only files whose contents changed are re-indexed, through
+ * InvertedIndex::UpdateDocuments, while queries keep being served.
+ * A deleted file becomes an empty document; a file that could not be loaded at start is
+ * appended as a new document once it appears.
+ * The documents must be loaded as copies (DocumentLoader with copy_files), since a watched
+ * file may be truncated before its change is applied, and reading a truncated mapping
+ * raises SIGBUS.
+ */
+class DocumentWatcher {
+  public:
+    /**
+     * @param index Index built over documents.
+     * @param documents Documents the index was built from; their paths give the document IDs.
+     * @param debounce Quiet time after the last event before a batch is applied.
+     * @throws std::invalid_argument if the documents are memory-mapped.
+     */
+    DocumentWatcher(InvertedIndex& index, const MappedDocuments& documents,
+                    std::chrono::milliseconds debounce = std::chrono::milliseconds(100));
+    ~DocumentWatcher();
+
+    DocumentWatcher(const DocumentWatcher&) = delete;
+    DocumentWatcher& operator=(const DocumentWatcher&) = delete;
+
+    /**
+     * Sets where the metadata of changed and appended documents comes from, so metadata
+     * filters keep matching them; without a source their metadata is left as it was.
+     * @param source Returns the metadata of the document file at a path.
+     */
+    void SetMetadataSource(std::function<DocumentMetadata(const std::string& path)> source);
+
+    /**
+     * Watches the files and applies changes until Stop is called. Needs inotify (Linux).
+     * @param on_batch Called after every applied batch.
+     */
+    void Run(std::function<void(const WatchBatch&)> on_batch = {});
+
+    /**
+     * Makes Run return. Safe to call from any thread.
+     */
+    void Stop();
+
+    /**
+     * Checks every file against its fingerprint and applies the changes. Used after the
+     * inotify queue overflowed, and on systems without inotify.
+     * @return The applied batch.
+     */
+    WatchBatch Rescan();
+
+    /**
+     * Reads a file and computes its fingerprint.
+     * @param path Path of the file.
+     * @param contents Receives the contents if not nullptr.
+     * @return Fingerprint; exists is false if the file cannot be read.
+     */
+    static FileFingerprint Fingerprint(const std::string& path, std::string* contents = nullptr);
+
+  private:
+    /**
+     * @brief A watched file and the document holding its contents.
+     */
+    struct WatchedFile {
+      std::string path;
+      size_t doc_id = SIZE_MAX; // SIZE_MAX until a file missing at start appears.
+      FileFingerprint fingerprint;
+    };
+
+    InvertedIndex& _index;
+    std::chrono::milliseconds _debounce;
+    std::vector<WatchedFile> _files;
+    std::unordered_map<std::string, size_t> _file_by_path; // Normalized absolute path -> index in _files.
+    size_t _next_doc_id;
+    std::function<DocumentMetadata(const std::string& path)> _metadata_source;
+    std::atomic<bool> _stopping{false};
+    int _wake_fds[2] = { -1, -1 }; // Pipe that interrupts Run.
+
+    /**
+     * @return Files whose existence, size or mtime differ from their fingerprints.
+     */
+    std::vector<size_t> StaleFiles() const;
+
+    /**
+     * Re-reads the given files and re-indexes those whose contents changed.
+     * @param files Indexes into _files.
+     * @param first_change Time of the first event of the batch.
+     * @return The applied batch.
+     */
+    WatchBatch Apply(const std::vector<size_t>& files, std::chrono::steady_clock::time_point first_change);
+};
@@ -1,16 +1,94 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <unordered_map>
 #include <mutex>
+#include <shared_mutex>
+#include <memory>
+#include <memory_resource>
+#include <string_view>
+#include <functional>
+#include <map>
+#include <optional>
+#include <span>
+#include "Deduplicator.h"
+#include "DocumentBitmap.h"
+#include "DocumentFilter.h"
+#include "DocumentLoader.h"
 #include "Entry.h"
+#include "NumaTopology.h"
+#include "TextAnalyzer.h"
+
+/**
+ * @brief Memory held by an InvertedIndex, broken down by structure.
+ */
+struct IndexMemoryUsage {
+  size_t dictionary_bytes = 0; // Hash table buckets, nodes and term strings.
+  size_t postings_bytes = 0; // Entry storage of every postings list.
+  size_t documents_bytes = 0; // Stored copies of the document texts.
+  size_t impact_bytes = 0; // Impact-ordered copies of the postings of frequent terms.
+  size_t metadata_bytes = 0; // Bitmaps of the document metadata values.
+  size_t offsets_bytes = 0; // Byte offsets of the term occurrences, kept for snippets.
+  size_t replica_bytes = 0; // Copies of the dictionary, postings and impact lists on other NUMA nodes.
+  size_t disk_postings_bytes = 0; // Postings served from the file mapping of a spilled build; paged in on demand.
+
+  /**
+   * @return Bytes held in memory; postings served from disk are left out.
+   */
+  size_t Total() const {
+    return dictionary_bytes + postings_bytes + documents_bytes + impact_bytes + metadata_bytes + offsets_bytes +
+           replica_bytes;
+  }
+};
+
+/**
+ * @brief Which terms get impact-ordered postings and how long those lists are.
+ */
+struct ImpactOrdering {
+  size_t min_document_frequency = 0; // Terms found in at least this many documents; 0 disables impact ordering.
+  size_t top_k = 0; // Entries kept per term, highest count first; 0 keeps a full copy of the postings.
+};
+
+/**
+ * @brief New contents of one document, for InvertedIndex::UpdateDocuments.
+ */
+struct DocumentUpdate {
+  size_t doc_id; // An existing document, or the current document count to append one.
+  std::string text; // New contents; empty for a deleted document.
+  std::optional<DocumentMetadata> metadata = std::nullopt; // New metadata; unset keeps the current metadata.
+};
+
+/**
+ * @brief Where a term occurs in the original text of a document.
+ */
+struct TermSpan {
+  size_t offset; // Byte offset of the word in the document.
+  size_t length; // Byte length of the word without surrounding ASCII punctuation.
+};
+
+/**
+ * @brief Hash for term dictionaries that accepts any string type, so lookups by
+ * std::string_view do not have to build a std::string key.
+ */
+struct TermHash {
+  using is_transparent = void;
+
+  size_t operator()(std::string_view term) const noexcept {
+    return std::hash<std::string_view>{}(term);
+  }
+};
 
 /**
  * @brief Builds an inverted index from a collection of documents.
  */
 class InvertedIndex {
   public:
+    using FrequencyDictionary = std::unordered_map<std::string, std::vector<Entry>, TermHash, std::equal_to<>>;
+    using DiskDictionary = std::unordered_map<std::string, std::span<const Entry>, TermHash, std::equal_to<>>;
+
     InvertedIndex() = default;
 
     /**
@@ -19,6 +97,38 @@ class InvertedIndex {
      */
     void UpdateDocumentBase(const std::vector<std::string>& input_docs);
 
+    /**
+     * Rebuilds the inverted index over memory-mapped documents without copying them.
+     * The index keeps the mappings alive for as long as it refers to them.
+     * @param input_docs Documents loaded by DocumentLoader.
+     */
+    void UpdateMappedDocumentBase(std::shared_ptr<const MappedDocuments> input_docs);
+
+    /**
+     * Re-indexes only the given documents. Their old postings are found by tokenizing
+     * the stored text again, so the rest of the index is left untouched; for documents still
+     * backed by a file mapping, whose file may already have changed, the dictionary is swept
+     * once per batch instead. Queries may run
+     * concurrently and see the index either before or after the whole batch.
+     * With deduplication enabled the whole index is rebuilt instead, since one change
+     * can move other documents between duplicate groups; the new index is built while
+     * queries keep reading the old one and then swapped in, so memory peaks at two indexes.
+     * @param updates New contents of the changed documents; appended documents must
+     * take consecutive IDs starting at DocumentCount().
+     */
+    void UpdateDocuments(std::vector<DocumentUpdate> updates);
+
+    /**
+     * @return Number of documents, including deleted ones that are kept as empty documents.
+     */
+    size_t DocumentCount() const;
+
+    /**
+     * Keeps UpdateDocuments from changing the index while a query reads it.
+     * @return Shared lock to hold for the duration of the query.
+     */
+    std::shared_lock<std::shared_mutex> LockForReading() const;
+
     /**
      * Retrieves the list of entries (document IDs and counts) for a given word.
      * @param word The word to search for.
@@ -26,16 +136,303 @@ class InvertedIndex {
      */
     std::vector<Entry> GetWordCount(const std::string& word);
 
+    /**
+     * Sets the analysis stage (stop words, stemming) used for documents and lookups.
+     * Must be called before UpdateDocumentBase.
+     * @param text_analyzer The analyzer to apply.
+     */
+    void SetAnalyzer(TextAnalyzer text_analyzer);
+
+    /**
+     * Normalizes and analyzes a word the same way indexed words are.
+     * @param word The input word.
+     * @return The indexed term, or an empty string if the word is dropped by analysis.
+     */
+    std::string AnalyzeWord(const std::string& word) const;
+
+    /**
+     * Applies the analysis stage to a word that is already normalized, without allocating.
+     * @param normalized_word A word produced by TextNormalizer.
+     * @return The indexed term (a prefix of normalized_word), or empty if the word is dropped.
+     */
+    std::string_view AnalyzeTerm(std::string_view normalized_word) const;
+
+    /**
+     * Looks up the postings of an already analyzed term without copying them.
+     * @param term A term as returned by AnalyzeWord or AnalyzeTerm.
+     * @return The postings list, in memory or in the file mapping of a spilled build;
+     * empty if the term is not indexed. Valid while the index is locked for reading.
+     */
+    std::span<const Entry> FindTerm(std::string_view term) const;
+
+    /**
+     * Sets which frequent terms get impact-ordered postings during UpdateDocumentBase.
+     * Each list costs up to top_k entries (or a full copy of the postings) per frequent term.
+     * @param ordering Document frequency threshold and list length.
+     */
+    void SetImpactOrdering(ImpactOrdering ordering);
+
+    /**
+     * @return The current impact ordering settings.
+     */
+    ImpactOrdering GetImpactOrdering() const;
+
+    /**
+     * Looks up the impact-ordered postings of a frequent term: entries sorted by count
+     * (highest first, then by doc_id), truncated to top_k entries if a limit is set.
+     * @param term An analyzed term.
+     * @return The list, or an empty one if the term has no impact-ordered postings.
+     */
+    std::span<const Entry> FindImpactOrdered(std::string_view term) const;
+
+    /**
+     * Places the index on the nodes of a NUMA machine. Indexing threads are pinned
+     * round-robin over the nodes, and after every rebuild the dictionary, postings and
+     * impact lists are copied once per node by a thread pinned to it, so each copy sits in
+     * that node's memory. Lookups read the copy of the calling thread's node.
+     * Costs one copy of the postings per extra node; with a single node nothing changes.
+     * Must be called before UpdateDocumentBase.
+     * @param topology Nodes to place the index on, or nullptr to turn placement off.
+     */
+    void SetNumaTopology(const NumaTopology* topology);
+
+    /**
+     * @return Topology the index is placed on, or nullptr if placement is off.
+     */
+    const NumaTopology* GetNumaTopology() const;
+
+    /**
+     * Makes indexing record the byte offset of every term occurrence, so snippets can be
+     * cut without scanning the documents again. Costs 8 bytes per indexed word.
+     * Must be called before UpdateDocumentBase. Offsets are 32-bit, so words starting past
+     * the first 4 GiB of a document get none and its snippets only cover that part; such
+     * documents are reported on stderr.
+     * @param enabled True to store the offsets.
+     */
+    void SetTermOffsets(bool enabled);
+
+    /**
+     * @return True if term offsets are recorded.
+     */
+    bool HasTermOffsets() const;
+
+    /**
+     * Finds the occurrences of a term in one document from the stored offsets.
+     * @param doc_id A document ID.
+     * @param term An analyzed term.
+     * @return Occurrences in document order; empty if offsets are not stored.
+     */
+    std::vector<TermSpan> FindOccurrences(size_t doc_id, std::string_view term) const;
+
+    /**
+     * @param doc_id A document ID.
+     * @return Text of the document as it was indexed; valid until the document is updated.
+     */
+    std::string_view GetDocumentText(size_t doc_id) const;
+
+    /**
+     * Attaches metadata to the documents and indexes every field value as a bitmap.
+     * @param metadata Metadata of each document, indexed by document ID.
+     */
+    void SetDocumentMetadata(const std::vector<DocumentMetadata>& metadata);
+
+    /**
+     * Finds the documents whose metadata matches a filter. With deduplication on, a duplicate
+     * whose metadata matches also selects its canonical document, which holds its postings.
+     * @param filter A non-empty filter.
+     * @return IDs of the matching documents.
+     */
+    DocumentBitmap MatchDocuments(const DocumentFilter& filter) const;
+
+    /**
+     * Sets the memory budget for the postings built while documents are tokenized.
+     * The budget is checked after every document; once it is reached, the partial index
+     * is flushed to disk as a sorted run. When indexing finishes, the runs are k-way merged
+     * into one postings file that is mapped read-only and served from there, so only the
+     * term dictionary stays on the heap and the kernel pages postings in as queries read
+     * them. Together with mapped documents (UpdateMappedDocumentBase), this indexes corpora
+     * larger than memory. Impact-ordered lists, term offsets and NUMA replicas are still
+     * held in memory, and terms changed by UpdateDocuments move back to memory.
+     * @param bytes Budget in bytes; 0 keeps every postings list in memory.
+     */
+    void SetMemoryLimit(size_t bytes);
+
+    /**
+     * Computes the memory currently used by the index.
+     * @return Bytes used by the term dictionary, the postings and the stored documents.
+     */
+    IndexMemoryUsage GetMemoryUsage() const;
+
+    /**
+     * Enables collapsing of exact and near-duplicate documents during UpdateDocumentBase.
+     * Only the first document of each group is indexed; the others become its aliases.
+     * @param enabled True to detect duplicates.
+     * @param max_distance Largest SimHash Hamming distance treated as a near duplicate.
+     */
+    void SetDeduplication(bool enabled, unsigned max_distance = 3);
+
+    /**
+     * @param doc_id A document ID.
+     * @return The ID of the indexed document that doc_id duplicates, or doc_id itself.
+     */
+    size_t GetCanonicalId(size_t doc_id) const;
+
+    /**
+     * @param doc_id ID of an indexed document.
+     * @return IDs of the documents collapsed into doc_id, in increasing order.
+     */
+    std::vector<size_t> GetAliases(size_t doc_id) const;
+
+    /**
+     * @return Duplicates found and postings saved by the last UpdateDocumentBase call.
+     */
+    DeduplicationStats GetDeduplicationStats() const;
+
+    /**
+     * @return Number of sorted runs flushed to disk by the last UpdateDocumentBase call.
+     */
+    size_t GetSpilledRunCount() const;
 
   private:
-    std::vector<std::string> docs; // List of document contents.
-    std::unordered_map<std::string, std::vector<Entry>> freq_dictionary; // Frequency dictionary (inverted index).
+    /**
+     * @brief Frequency dictionary of the documents indexed by one indexing thread.
+     * Terms and postings live in an arena owned by the block and are freed at once after the merge.
+     */
+    struct PartialIndex {
+      std::unique_ptr<std::pmr::monotonic_buffer_resource> arena = std::make_unique<std::pmr::monotonic_buffer_resource>();
+      std::pmr::unordered_map<std::pmr::string, std::pmr::vector<Entry>, TermHash, std::equal_to<>> dictionary{arena.get()};
+    };
+
+    /**
+     * @brief Merged postings of a spilled build, mapped read-only.
+     */
+    struct PostingsFile;
+
+    /**
+     * @brief Read-only copy of the dictionaries in the memory of one NUMA node.
+     */
+    struct NodeReplica {
+      FrequencyDictionary dictionary;
+      FrequencyDictionary impact;
+    };
+
+    /**
+     * @brief One word of a document: a 32-bit hash of its term and its byte offset.
+     * Collisions are ruled out by analyzing the word again when it is looked up.
+     */
+    struct TermOffset {
+      uint32_t term_key;
+      uint32_t offset; // Words past the first 4 GiB of a document are not recorded.
+
+      bool operator<(const TermOffset& other) const {
+        return term_key != other.term_key ? term_key < other.term_key : offset < other.offset;
+      }
+    };
+
+    std::vector<std::string> docs; // Owned document contents when indexing from strings.
+    std::unordered_map<size_t, std::string> updated_docs; // Owned contents of documents changed by UpdateDocuments.
+    std::shared_ptr<const MappedDocuments> mapped_docs; // Mapped document contents when indexing from files.
+    std::vector<std::string_view> doc_texts; // Contents of every document, pointing into docs or mapped_docs.
+    FrequencyDictionary freq_dictionary; // Frequency dictionary (inverted index).
+    DiskDictionary disk_dictionary; // Terms whose postings are read from postings_file; disjoint from freq_dictionary.
+    std::shared_ptr<const PostingsFile> postings_file; // Mapping of a spilled build; null when all postings are in memory.
+    size_t memory_limit = 0; // Budget for the postings during tokenization, 0 means unlimited.
+    size_t spilled_runs = 0; // Runs written to disk by the last update.
+    ImpactOrdering impact_ordering; // Which terms get impact-ordered postings.
+    FrequencyDictionary impact_dictionary; // Frequent term -> postings sorted by count.
+    TextAnalyzer analyzer; // Stop-word and stemming stage shared by indexing and lookups.
+    bool deduplicate = false; // Collapse duplicate documents at ingestion.
+    unsigned duplicate_distance = 3; // SimHash distance for near duplicates.
+    std::vector<DocumentFingerprint> fingerprints; // Filled by the indexing threads during an update.
+    std::vector<size_t> canonical_ids; // Document ID -> ID of the indexed copy.
+    std::unordered_map<size_t, std::vector<size_t>> aliases; // Indexed document -> collapsed duplicates.
+    DeduplicationStats dedup_stats;
+    std::unordered_map<std::string, std::map<std::string, DocumentBitmap, std::less<>>> metadata_index; // Field -> value -> documents.
+    bool store_offsets = false; // Record term offsets for snippets.
+    std::vector<std::vector<TermOffset>> term_offsets; // Document -> its words, sorted by term key, then offset.
+    const NumaTopology* numa = nullptr; // Nodes the index is placed on; nullptr when placement is off.
+    std::vector<std::unique_ptr<NodeReplica>> replicas; // Copies for nodes 1..N-1; node 0 reads the dictionaries above.
+
+    /**
+     * Rebuilds the index over doc_texts.
+     */
+    void BuildIndex();
+
+    /**
+     * Builds the impact-ordered postings of the frequent terms of freq_dictionary.
+     */
+    void BuildImpactPostings();
+
+    /**
+     * Rebuilds the impact-ordered postings of one term after its postings changed.
+     * @param term An indexed or removed term.
+     */
+    void RefreshImpactPostings(const std::string& term);
+
+    /**
+     * Copies the dictionaries to every NUMA node after a rebuild.
+     */
+    void PlaceOnNodes();
+
+    /**
+     * Copies the changed terms of the dictionaries to the replicas of the other nodes.
+     * @param terms Terms changed by UpdateDocuments.
+     */
+    void RefreshReplicas(const std::vector<std::string>& terms);
+
+    /**
+     * @return Index of the calling thread's node, or 0 when the index is not replicated.
+     */
+    size_t LocalNode() const;
+
+    /**
+     * @param term An analyzed term.
+     * @return Its postings from either dictionary of this node, or an empty list.
+     */
+    std::span<const Entry> Postings(std::string_view term) const;
+
+    /**
+     * Moves the postings of a term served from disk into freq_dictionary, so they can change.
+     * Needs the exclusive lock on index_mutex.
+     * @param term An analyzed term.
+     * @return The term in freq_dictionary, or its end if the term is not indexed.
+     */
+    FrequencyDictionary::iterator MaterializeTerm(std::string_view term);
+
+    /**
+     * Replaces the metadata of one document in the metadata bitmaps.
+     * Needs the exclusive lock on index_mutex.
+     * @param doc_id A document ID.
+     * @param metadata New metadata of the document.
+     */
+    void ApplyMetadata(size_t doc_id, const DocumentMetadata& metadata);
+
+    /**
+     * Counts the terms of a document the same way IndexDocuments does.
+     * @param text Document contents.
+     * @param offsets Receives the offsets of the words if not nullptr, sorted like term_offsets.
+     * @return Term -> number of occurrences.
+     */
+    std::unordered_map<std::string, size_t> CountTerms(std::string_view text,
+                                                       std::vector<TermOffset>* offsets = nullptr) const;
+
+    /**
+     * Builds the partial index of the documents taken from a counter shared by the indexing threads.
+     * @param next_doc Next document to index.
+     * @param end_doc One past the last document to index.
+     * @param round_bytes Estimated bytes added by all threads of the round.
+     * @param byte_budget Bytes the round may add before the threads stop; 0 for no limit.
+     * @return Frequency dictionary of the documents indexed by this thread.
+     */
+    PartialIndex IndexDocuments(std::atomic<size_t>& next_doc, size_t end_doc, std::atomic<size_t>& round_bytes,
+                                size_t byte_budget);
 
     /**
      * Normalizes a word by removing punctuation and converting it to lowercase.
      * @param word The input word.
      * @return The cleaned word.
      */
-    std::string CleanWord(const std::string& word);
-    std::mutex freq_mutex; // Mutex to protect freq_dictionary during updates.
+    std::string CleanWord(const std::string& word) const;
+    mutable std::shared_mutex index_mutex; // Shared by queries, exclusive while documents are updated.
+    std::mutex update_mutex; // Serializes UpdateDocuments batches.
 };
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "Metrics.h"
+
+/**
+ * @brief Outcome of one open-loop run at a fixed arrival rate.
+ */
+struct LoadReport {
+  double target_qps = 0.0;
+  double achieved_qps = 0.0; // Completed queries per second, until the last one finished.
+  uint64_t completed = 0;
+  uint64_t errors = 0; // Queries whose target threw.
+  LatencyHistogram latency; // From the intended start of each query, corrected for coordinated omission.
+  LatencyHistogram service; // From the actual start of each query, as a closed-loop client would see it.
+
+  /**
+   * @return True if the target fell behind the arrival rate.
+   */
+  bool Saturated() const;
+};
+
+/**
+ * @brief Open-loop load generator for replaying query logs.
+ * Query i is due at start + i / target_qps whether or not earlier queries have finished,
+ * and its latency is measured from that intended time. A stall therefore shows up in the
+ * latency of every query that had to wait behind it, instead of silently lowering the
+ * arrival rate as in a closed loop (coordinated omission).
+ */
+class LoadGenerator {
+  public:
+    using Target = std::function<void(const std::string& query)>;
+
+    /**
+     * @param queries Queries to replay, in order; the log is repeated as needed.
+     * @param target Runs one query; must be safe to call from several threads.
+     * @param concurrency Number of queries that may be in flight at once.
+     */
+    LoadGenerator(std::vector<std::string> queries, Target target, size_t concurrency = 64);
+
+    /**
+     * Issues queries at a fixed rate for the given duration and waits for all of them.
+     * @param target_qps Arrival rate.
+     * @param duration Time during which queries are issued.
+     * @return Throughput and latency distributions of the run.
+     */
+    LoadReport Run(double target_qps, std::chrono::milliseconds duration) const;
+
+    /**
+     * Runs at increasing rates until the target saturates.
+     * @param start_qps First arrival rate.
+     * @param growth Factor applied to the rate after every sustained run.
+     * @param max_qps Rate after which the sweep stops even without saturation.
+     * @param duration Length of each run.
+     * @return Reports of all runs; the last one is saturated unless max_qps was reached.
+     */
+    std::vector<LoadReport> Sweep(double start_qps, double growth, double max_qps,
+                                  std::chrono::milliseconds duration) const;
+
+    /**
+     * Reads a query log: requests.json ({"requests": [...]}) or JSONL with one query per
+     * line, given as a JSON string, an object with a "query" field or plain text.
+     * @param path Path of the log file.
+     * @return Queries in log order.
+     */
+    static std::vector<std::string> ReadQueryLog(const std::string& path);
+
+  private:
+    std::vector<std::string> _queries;
+    Target _target;
+    size_t _concurrency;
+};
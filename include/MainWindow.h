@@ -1,12 +1,14 @@
 #pragma once
 
 #include <QMainWindow>
-#include <QTextEdit>
+#include <QListView>
 #include <QPushButton>
+#include <QProgressBar>
 #include <QVBoxLayout>
 #include <QLabel>
 #include <QPropertyAnimation>
-#include "ConverterJSON.h"
+#include <QFutureWatcher>
+#include "ResultsModel.h"
 
 class MainWindow : public QMainWindow {
   Q_OBJECT
@@ -18,17 +20,26 @@ public:
   private slots:
       void openFile();
   void processSearch();
+  void cancelSearch();
+  void appendResults(int begin, int end);
+  void searchFinished();
 
 private:
   void setupUI();
   void setupAnimations();
+  void setBusy(bool busy);
 
   QWidget *centralWidget;
   QPushButton *openFileButton;
   QPushButton *searchButton;
-  QTextEdit *outputViewer;
+  QPushButton *cancelButton;
+  QProgressBar *progressBar;
+  QListView *outputViewer;
+  ResultsModel *resultsModel;
   QLabel *titleLabel;
 
-  ConverterJSON jsonConverter;
   QPropertyAnimation *animation;
+  QFutureWatcher<QString> searchWatcher; // Tracks the background indexing and search job.
+  bool searchActive = false; // searchWatcher holds a search whose end has not been handled yet.
+  int shownRows = 0; // Results of the current search already in resultsModel; they are shown in request order.
 };
@@ -0,0 +1,286 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#ifndef SEARCH_ENGINE_METRICS
+#define SEARCH_ENGINE_METRICS 0
+#endif
+
+/**
+ * @brief Pipeline stages that are timed by the built-in instrumentation.
+ */
+enum class Stage : size_t {
+  FileRead,   // Reading document files listed in config.json
+  Tokenize,   // Splitting and normalizing a document into words
+  Merge,      // Merging per-thread partial indexes
+  Lookup,     // Parsing a query and fetching the postings lists of its words
+  Scoring,    // Planning, accumulating counts and selecting the top results
+  Query,      // End-to-end processing of a single query (Lookup + Scoring)
+  JsonOutput, // Serializing and writing answers.json
+  Snippet,    // Cutting and highlighting result snippets
+  Count
+};
+
+/**
+ * @brief Plain event counters maintained next to the stage histograms.
+ */
+enum class Counter : size_t {
+  DocumentsLoaded,  // Documents read from disk
+  BytesRead,        // Bytes read from document files
+  TokensIndexed,    // Words counted while building the index
+  QueriesProcessed, // Queries passed to ProcessQuery
+  PostingsScanned,  // Entries visited while scoring queries
+  Count
+};
+
+/**
+ * @brief Log-linear latency histogram in the spirit of HdrHistogram.
+ * Values below 64 ns are recorded exactly; larger values keep 5 significant bits,
+ * which bounds the relative error of reported percentiles to about 3%.
+ * A histogram has a single writer; readers may take snapshots concurrently.
+ */
+class LatencyHistogram {
+  public:
+    static constexpr size_t kSubBucketBits = 6;
+    static constexpr size_t kSubBuckets = size_t{1} << kSubBucketBits;
+    static constexpr size_t kHalfSubBuckets = kSubBuckets / 2;
+    static constexpr size_t kBucketCount = kSubBuckets + (64 - kSubBucketBits) * kHalfSubBuckets;
+
+    LatencyHistogram() = default;
+    LatencyHistogram(const LatencyHistogram& other);
+    LatencyHistogram& operator=(const LatencyHistogram& other);
+
+    /**
+     * Records one value (nanoseconds).
+     * @param value The measured latency.
+     */
+    void Record(uint64_t value);
+
+    /**
+     * Adds all recorded values of another histogram to this one.
+     * @param other Histogram to merge.
+     */
+    void Merge(const LatencyHistogram& other);
+
+    /**
+     * Clears all recorded values.
+     */
+    void Reset();
+
+    uint64_t Count() const;
+    uint64_t Sum() const;
+    uint64_t Min() const;
+    uint64_t Max() const;
+    double Mean() const;
+
+    /**
+     * Returns the value at the given percentile.
+     * @param percentile Percentile in the range [0, 100].
+     * @return Representative value of the bucket holding the percentile, 0 if empty.
+     */
+    uint64_t Percentile(double percentile) const;
+
+    static size_t BucketIndex(uint64_t value);
+    static uint64_t BucketLowerBound(size_t index);
+    static uint64_t BucketUpperBound(size_t index);
+
+  private:
+    std::array<std::atomic<uint64_t>, kBucketCount> buckets{};
+    std::atomic<uint64_t> total_count{0};
+    std::atomic<uint64_t> total_sum{0};
+    std::atomic<uint64_t> min_value{UINT64_MAX};
+    std::atomic<uint64_t> max_value{0};
+};
+
+/**
+ * @brief Aggregated view over the metrics of every thread.
+ */
+struct MetricsSnapshot {
+  std::array<LatencyHistogram, static_cast<size_t>(Stage::Count)> stages;
+  std::array<uint64_t, static_cast<size_t>(Counter::Count)> counters{};
+
+  const LatencyHistogram& operator[](Stage stage) const {
+    return stages[static_cast<size_t>(stage)];
+  }
+  uint64_t operator[](Counter counter) const {
+    return counters[static_cast<size_t>(counter)];
+  }
+};
+
+/**
+ * @brief Process-wide registry of per-thread counters and stage histograms.
+ * Every thread writes only to its own block, so recording never contends;
+ * blocks of finished threads are recycled by new threads.
+ */
+class Metrics {
+  public:
+    static constexpr uint32_t kDefaultTimelineSampling = 4;
+
+    /**
+     * Records the duration of a stage for the calling thread.
+     * @param stage The stage that was measured.
+     * @param nanoseconds Measured duration.
+     */
+    static void Record(Stage stage, uint64_t nanoseconds);
+
+    /**
+     * Increments a counter for the calling thread.
+     * @param counter The counter to increment.
+     * @param value Amount to add.
+     */
+    static void Add(Counter counter, uint64_t value = 1);
+
+    /**
+     * Aggregates the metrics of all threads.
+     * @return Snapshot of every stage and counter.
+     */
+    static MetricsSnapshot Snapshot();
+
+    /**
+     * Clears the metrics of all threads. Safe while other threads record; values recorded
+     * concurrently with the call may or may not be kept.
+     */
+    static void Reset();
+
+    /**
+     * Decides whether the calling thread times the timeline it is starting: the first one
+     * and then one in TimelineSampling().
+     * @return True if the timeline is to be timed.
+     */
+    static bool SampleTimeline();
+
+    /**
+     * Sets how often each thread times a timeline (the stages of a query); every thread
+     * times its next timeline, then one in interval. Counters are never sampled, so the
+     * histogram counts of the stages are about 1/interval of them.
+     * @param interval Timelines per timed one; 1 times every timeline.
+     * @throws std::invalid_argument if interval is 0.
+     */
+    static void SetTimelineSampling(uint32_t interval);
+
+    /**
+     * @return Timelines per timed one, kDefaultTimelineSampling unless changed.
+     */
+    static uint32_t TimelineSampling();
+
+    /**
+     * Writes the current metrics as a JSON document.
+     * @param out Destination stream.
+     */
+    static void WriteJson(std::ostream& out);
+
+    /**
+     * Writes the current metrics in the Prometheus text exposition format.
+     * @param out Destination stream.
+     */
+    static void WritePrometheus(std::ostream& out);
+
+    /**
+     * Writes the current metrics to a file; ".prom" and ".txt" files use the
+     * Prometheus format, anything else is written as JSON.
+     * @param path Destination file path.
+     */
+    static void WriteReport(const std::string& path);
+
+    static const char* StageName(Stage stage);
+    static const char* CounterName(Counter counter);
+};
+
+/**
+ * @brief Records the lifetime of the object as one sample of a stage.
+ */
+class MetricsScope {
+  public:
+    explicit MetricsScope(Stage stage)
+      : _stage(stage), _start(std::chrono::steady_clock::now()) {}
+
+    ~MetricsScope() {
+      auto elapsed = std::chrono::steady_clock::now() - _start;
+      Metrics::Record(_stage, static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+
+    MetricsScope(const MetricsScope&) = delete;
+    MetricsScope& operator=(const MetricsScope&) = delete;
+
+  private:
+    Stage _stage;
+    std::chrono::steady_clock::time_point _start;
+};
+
+/**
+ * @brief Times consecutive stages of one operation and the operation as a whole, with a
+ * single clock read per stage boundary: Next ends the open stage where the next one starts,
+ * and the destructor ends the last stage and the whole span at the same instant. The whole
+ * span is thus exactly the sum of its stages. Timelines are sampled (Metrics::SampleTimeline);
+ * one that is not timed reads no clock at all.
+ */
+class MetricsTimeline {
+  public:
+    MetricsTimeline(Stage total, Stage first)
+      : _total(total), _stage(first), _sampled(Metrics::SampleTimeline()) {
+      if (_sampled) {
+        _start = std::chrono::steady_clock::now();
+        _stage_start = _start;
+      }
+    }
+
+    ~MetricsTimeline() {
+      if (!_sampled) {
+        return;
+      }
+      auto now = std::chrono::steady_clock::now();
+      Metrics::Record(_stage, Nanoseconds(now - _stage_start));
+      Metrics::Record(_total, Nanoseconds(now - _start));
+    }
+
+    /**
+     * Ends the open stage and starts the next one.
+     * @param stage The stage that starts now.
+     */
+    void Next(Stage stage) {
+      if (!_sampled) {
+        return;
+      }
+      auto now = std::chrono::steady_clock::now();
+      Metrics::Record(_stage, Nanoseconds(now - _stage_start));
+      _stage = stage;
+      _stage_start = now;
+    }
+
+    MetricsTimeline(const MetricsTimeline&) = delete;
+    MetricsTimeline& operator=(const MetricsTimeline&) = delete;
+
+  private:
+    static uint64_t Nanoseconds(std::chrono::steady_clock::duration elapsed) {
+      return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+    Stage _total;
+    Stage _stage;
+    bool _sampled;
+    std::chrono::steady_clock::time_point _start;
+    std::chrono::steady_clock::time_point _stage_start;
+};
+
+#define SE_METRICS_CONCAT_IMPL(a, b) a##b
+#define SE_METRICS_CONCAT(a, b) SE_METRICS_CONCAT_IMPL(a, b)
+
+#if SEARCH_ENGINE_METRICS
+#define SE_METRICS_SCOPE(stage) MetricsScope SE_METRICS_CONCAT(se_metrics_scope_, __LINE__)(stage)
+#define SE_METRICS_ADD(counter, value) Metrics::Add((counter), (value))
+// One timeline per block: SE_METRICS_NEXT refers to the one declared in an enclosing scope
+#define SE_METRICS_TIMELINE(total, first) MetricsTimeline se_metrics_timeline((total), (first))
+#define SE_METRICS_NEXT(stage) se_metrics_timeline.Next(stage)
+#else
+#define SE_METRICS_SCOPE(stage) ((void)0)
+#define SE_METRICS_ADD(counter, value) ((void)0)
+#define SE_METRICS_TIMELINE(total, first) ((void)0)
+#define SE_METRICS_NEXT(stage) ((void)0)
+#endif
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/**
+ * @brief NUMA nodes of the machine and their CPUs, for pinning worker threads and
+ * placing index replicas. Detected through libnuma when the build found it, otherwise
+ * from /sys/devices/system/node. Without NUMA information the machine is a single node
+ * holding every CPU, and placement becomes a no-op.
+ */
+class NumaTopology {
+  public:
+    /**
+     * @param node_cpus CPUs of every node; a CPU may appear in several nodes to simulate a topology.
+     */
+    explicit NumaTopology(std::vector<std::vector<int>> node_cpus);
+
+    /**
+     * @return Topology of this machine, detected on first use.
+     */
+    static const NumaTopology& System();
+
+    /**
+     * @return Number of nodes; at least 1.
+     */
+    size_t NodeCount() const;
+
+    /**
+     * @param node A node index.
+     * @return CPUs of the node.
+     */
+    const std::vector<int>& CpusOfNode(size_t node) const;
+
+    /**
+     * @param worker Index of a worker thread.
+     * @return Node of the worker: workers are spread round-robin over the nodes.
+     */
+    size_t NodeOfWorker(size_t worker) const;
+
+    /**
+     * Restricts the calling thread to the CPUs of the worker's node and makes it the
+     * thread's node for CurrentNode. Workers of a node share all of its CPUs, so workers
+     * of different pools or batches never queue behind each other on one core.
+     * @param worker Index of the worker thread.
+     * @return False if the affinity could not be set; the node is then not recorded.
+     */
+    bool PinWorker(size_t worker) const;
+
+    /**
+     * @return Node of the calling thread: the node it was pinned to, otherwise the node
+     * of the CPU it is running on.
+     */
+    size_t CurrentNode() const;
+
+    /**
+     * Runs a task on a thread pinned to a node, with memory allocated from that node.
+     * Pages are placed on the node that first touches them, so data built by the task
+     * stays local to the node.
+     * @param node A node index.
+     * @param task Work to run; exceptions are rethrown to the caller.
+     */
+    void RunOnNode(size_t node, const std::function<void()>& task) const;
+
+    /**
+     * @param address Any address of the process.
+     * @return Node holding the page of address, or -1 if the page is not mapped or the
+     * system does not report it.
+     */
+    static int NodeOfAddress(const void* address);
+
+  private:
+    std::vector<std::vector<int>> _node_cpus;
+    std::vector<size_t> _cpu_node; // CPU -> first node listing it.
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+/**
+ * @brief Cancellation flag shared between the caller of a query and its evaluation.
+ * Copies share the same flag, so a copy kept by the caller can cancel a running query.
+ */
+class CancellationToken {
+  public:
+    CancellationToken() : _cancelled(std::make_shared<std::atomic<bool>>(false)) {}
+
+    /**
+     * Asks every query holding this token to stop as soon as possible.
+     */
+    void Cancel() const {
+      _cancelled->store(true, std::memory_order_relaxed);
+    }
+
+    bool IsCancelled() const {
+      return _cancelled->load(std::memory_order_relaxed);
+    }
+
+  private:
+    std::shared_ptr<std::atomic<bool>> _cancelled;
+};
+
+/**
+ * @brief Time a query may spend in evaluation, and the token that can cut it short.
+ * Evaluation checks the budget between blocks of postings and returns the best results
+ * found so far once it is exhausted.
+ */
+struct QueryBudget {
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+  CancellationToken token;
+
+  /**
+   * @return True once the deadline has passed or the query was cancelled.
+   */
+  bool Exhausted() const {
+    return token.IsCancelled() || std::chrono::steady_clock::now() >= deadline;
+  }
+};
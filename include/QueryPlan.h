@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief How the planner evaluates a query.
+ */
+enum class QueryStrategy {
+  NoMatches,      // No query term is in the dictionary.
+  ImpactOrdered,  // Threshold algorithm over impact-ordered postings, stops early.
+  Exhaustive,     // OR over the postings of every term.
+  RareTermsFirst  // OR over the rare terms; common terms only add to their candidates' scores.
+};
+
+/**
+ * @brief Dictionary statistics of one query term and the role the planner gave it.
+ */
+struct PlannedTerm {
+  std::string term; // Term after analysis.
+  size_t document_frequency = 0;
+  size_t postings_bytes = 0;
+  bool impact_ordered = false; // The term has an impact-ordered postings list.
+  bool scoring_only = false; // Above the common-term threshold: scores candidates but does not add any.
+};
+
+/**
+ * @brief Trace of the planning and evaluation of one query, for tuning the planner.
+ */
+struct QueryPlan {
+  std::vector<PlannedTerm> terms; // Rarest first.
+  QueryStrategy strategy = QueryStrategy::NoMatches;
+  bool impact_fallback = false; // A truncated impact list ran out and the query was rescored exhaustively.
+  bool truncated = false; // The query budget ran out.
+  size_t postings_read = 0; // Postings entries read sequentially.
+  size_t random_lookups = 0; // Binary searches into doc-ordered postings.
+  size_t candidates = 0; // Documents that were scored.
+  double elapsed_us = 0.0;
+
+  /**
+   * Writes the plan as human-readable text, one term per line.
+   * @param out Output stream.
+   */
+  void Write(std::ostream& out) const;
+};
+
+/**
+ * @return Name of the strategy, as used in the explain output.
+ */
+const char* ToString(QueryStrategy strategy);
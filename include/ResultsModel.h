@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QAbstractListModel>
+#include <QStringList>
+
+/**
+ * @brief Line-oriented list model backing the output view.
+ * Used with a uniform-height QListView, only the visible rows are laid out,
+ * so large answers.json documents and long result lists stay responsive.
+ */
+class ResultsModel : public QAbstractListModel {
+  Q_OBJECT
+
+public:
+  explicit ResultsModel(QObject *parent = nullptr);
+
+  int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+  QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+  /**
+   * Replaces all rows of the model.
+   * @param rows New content, one entry per line.
+   */
+  void setRows(QStringList rows);
+
+  /**
+   * Appends rows to the end of the model.
+   * @param rows Rows to append.
+   */
+  void appendRows(const QStringList &rows);
+
+  /**
+   * Removes all rows.
+   */
+  void clear();
+
+private:
+  QStringList lines;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+/**
+ * @brief Reusable monotonic arena for short-lived scratch data.
+ * Allocations are bump-pointer allocations from an owned buffer; Reset() makes the
+ * whole buffer available again without freeing it. When a round of work overflows
+ * the buffer, the next Reset() grows it to the observed peak, so repeated work of a
+ * similar size stops calling malloc after the first round.
+ */
+class ScratchArena {
+  public:
+    /**
+     * @param initial_bytes Initial size of the owned buffer.
+     */
+    explicit ScratchArena(size_t initial_bytes = 64 * 1024);
+
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    /**
+     * @return Memory resource to pass to std::pmr containers.
+     */
+    std::pmr::memory_resource* Resource();
+
+    /**
+     * Releases every allocation at once. Containers using the arena must be destroyed first.
+     */
+    void Reset();
+
+    /**
+     * @return Size of the owned buffer in bytes.
+     */
+    size_t Capacity() const;
+
+  private:
+    /**
+     * @brief Upstream resource that records how much memory spilled past the buffer.
+     */
+    class OverflowCounter : public std::pmr::memory_resource {
+      public:
+        size_t overflow_bytes = 0;
+
+      private:
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+    };
+
+    std::unique_ptr<std::byte[]> buffer;
+    size_t capacity;
+    OverflowCounter upstream;
+    std::optional<std::pmr::monotonic_buffer_resource> resource;
+};
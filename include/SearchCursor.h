@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "DocumentBitmap.h"
+
+/**
+ * @brief Position of a paginated query: the last result of the previous page.
+ * The cursor is stateless: it holds everything the next page needs, so the server keeps
+ * nothing between pages. Results continue strictly after (score, doc_id) in the usual
+ * order of decreasing score, then increasing doc_id.
+ */
+struct SearchCursor {
+  size_t score = 0; // Absolute score of the last result returned.
+  size_t doc_id = 0; // Document of the last result returned.
+  size_t max_score = 0; // Score of the first result of the first page; ranks stay relative to it.
+  uint32_t query_hash = 0; // Hash of the query and filter the cursor was issued for.
+
+  /**
+   * @return The cursor as a short URL-safe string.
+   */
+  std::string Encode() const;
+
+  /**
+   * Parses a cursor returned by Encode.
+   * @param text Encoded cursor.
+   * @return The cursor.
+   * @throws std::invalid_argument if text is not a valid cursor.
+   */
+  static SearchCursor Decode(std::string_view text);
+
+  /**
+   * @param query A query string.
+   * @param allowed Documents the query is restricted to, or nullptr for all documents.
+   * @return Hash of the query and its filter, stable across processes, used to reject a
+   * cursor passed with another query or another filter.
+   */
+  static uint32_t HashQuery(std::string_view query, const DocumentBitmap* allowed = nullptr);
+
+  bool operator==(const SearchCursor& other) const = default;
+};
@@ -1,15 +1,46 @@
 #pragma once
 
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
+#include <memory_resource>
+#include "DocumentScore.h"
+#include "QueryBudget.h"
+#include "QueryPlan.h"
 #include "RelativeIndex.h"
+#include "SearchCursor.h"
+#include "Snippet.h"
 #include "InvertedIndex.h"
+#include "DocumentBitmap.h"
+#include "DocumentFilter.h"
+
+/**
+ * @brief Results of a query evaluated under a budget.
+ */
+struct SearchOutcome {
+  std::vector<RelativeIndex> results;
+  bool truncated = false; // The budget ran out; results are the best found before that.
+};
+
+/**
+ * @brief One page of a paginated query.
+ */
+struct SearchPage {
+  std::vector<RelativeIndex> results; // Ranks are relative to the best result of the first page.
+  std::string next_cursor; // Cursor of the next page; empty once the results are exhausted.
+};
 
 /**
  * @brief Implements a search server that processes queries using an inverted index.
  */
 class SearchServer {
   public:
+    using AnswerCallback = std::function<bool(size_t query_index, const std::vector<RelativeIndex>& results)>;
+
   /**
    * @brief Constructs a SearchServer with a reference to an InvertedIndex.
    * @param idx Reference to an existing InvertedIndex object.
@@ -17,21 +48,158 @@ class SearchServer {
    */
     SearchServer(InvertedIndex& idx, int responses_limit = 5);
 
+  /**
+   * @brief Finishes the queued asynchronous queries and stops their workers.
+   */
+    ~SearchServer();
+
+    SearchServer(const SearchServer&) = delete;
+    SearchServer& operator=(const SearchServer&) = delete;
+
  /**
   * @brief Processes a list of search queries.
   * @param queries_input Vector of search query strings.
   * @return Vector of vectors containing RelativeIndex objects for each query.
   */
     std::vector<std::vector<RelativeIndex>> search(const std::vector<std::string>& queries_input);
+
+ /**
+  * @brief Processes a list of search queries over the documents matching a metadata filter.
+  * Excluded documents are skipped while the postings are read, so they are never scored
+  * and every query still returns up to responses_limit matching documents.
+  * @param queries_input Vector of search query strings.
+  * @param filter Metadata filter; an empty filter accepts every document.
+  * @param on_answered Called with the index and results of every answered query, possibly from
+  * several threads at once; returning false skips the queries not started yet.
+  * @return Vector of vectors containing RelativeIndex objects for each query.
+  */
+    std::vector<std::vector<RelativeIndex>> search(const std::vector<std::string>& queries_input,
+                                                   const DocumentFilter& filter,
+                                                   const AnswerCallback& on_answered = {});
+
+ /**
+  * @brief Scores a single query without normalizing the scores, for merging results across shards.
+  * @param query The search query string.
+  * @param allowed Documents that may be returned, or nullptr for all documents.
+  * @return Up to responses_limit documents by decreasing score, then by doc_id.
+  */
+    std::vector<DocumentScore> SearchScores(const std::string& query, const DocumentBitmap* allowed = nullptr);
+
+ /**
+  * @brief Returns one page of up to responses_limit results of a query.
+  * The cursor of the previous page marks its last (score, doc_id); evaluation skips every
+  * document ranked at or above it and keeps only the best responses_limit below it, so a
+  * page costs the same however deep it is and the query is never re-run with a larger limit.
+  * @param query The search query string.
+  * @param cursor next_cursor of the previous page, or empty for the first page.
+  * @param allowed Documents that may be returned, or nullptr for all documents.
+  * @return The page and the cursor of the next one.
+  * @throws std::invalid_argument if the cursor is malformed or was issued for another query or filter.
+  */
+    SearchPage SearchPaged(const std::string& query, const std::string& cursor = {},
+                           const DocumentBitmap* allowed = nullptr);
+
+ /**
+  * @brief Submits a single query to the server's worker pool without waiting for it.
+  * The query stops at the first postings block boundary after the deadline passes or the
+  * token is cancelled, and its best results so far are returned marked as truncated.
+  * @param query The search query string.
+  * @param deadline Time by which the results are needed.
+  * @param token Token the caller can use to cancel the query.
+  * @return Future holding the outcome, or the exception raised for an invalid query.
+  */
+    std::future<SearchOutcome> SearchAsync(const std::string& query,
+                                           std::chrono::steady_clock::time_point deadline,
+                                           CancellationToken token = {});
+
+ /**
+  * @brief Sets the number of persistent worker threads used by search and SearchAsync.
+  * @param threads Number of threads; 0 for hardware_concurrency.
+  * @throws std::runtime_error once the workers have been started by a query.
+  */
+    void SetWorkerThreads(size_t threads);
+
+ /**
+  * @brief Sets the document frequency above which a term is treated as common.
+  * Common terms do not add candidates: they only add to the scores of documents that
+  * contain a rarer query term. A query made only of common terms is evaluated as usual.
+  * @param document_frequency Threshold; 0 disables common-term handling.
+  */
+    void SetCommonTermFrequency(size_t document_frequency);
+
+ /**
+  * @brief Evaluates a query and reports how the planner handled it.
+  * @param query The search query string.
+  * @param allowed Documents that may be returned, or nullptr for all documents.
+  * @return Terms with their statistics and roles, the chosen strategy and the work done.
+  */
+    QueryPlan Explain(const std::string& query, const DocumentBitmap* allowed = nullptr);
+
+ /**
+  * @brief Sets the excerpt length and highlight markers used for snippets.
+  * @param options Snippet options; window_bytes must be positive.
+  */
+    void SetSnippetOptions(SnippetOptions options);
+
+ /**
+  * @brief Cuts a highlighted excerpt of a document around the terms of a query.
+  * Occurrences come from the term offsets stored by the index, so the document is not
+  * scanned again; the excerpt is the window that covers the most (and rarest) query terms.
+  * @param query The search query string.
+  * @param doc_id A document, usually one of the query's results.
+  * @return The excerpt; the start of the document if no query term occurs in it.
+  * @throws std::runtime_error if the index does not store term offsets.
+  */
+    Snippet MakeSnippet(const std::string& query, size_t doc_id);
+
+ /**
+  * @brief Cuts the snippet of every result of every query.
+  * @param queries_input Vector of search query strings.
+  * @param answers Results of the queries, as returned by search.
+  * @return Snippets in the order of the results.
+  */
+    std::vector<std::vector<Snippet>> Snippets(const std::vector<std::string>& queries_input,
+                                               const std::vector<std::vector<RelativeIndex>>& answers);
   private:
+    struct WorkerPool;
+
     InvertedIndex& _index; // Reference to the inverted index.
     int _responses_limit; // Maximum number of responses per query.
+    size_t _common_term_frequency = 0; // Document frequency above which terms only score; 0 for none.
+    SnippetOptions _snippet_options;
+    size_t _worker_threads = 0; // Size of the worker pool; 0 for hardware_concurrency.
+    std::once_flag _workers_started;
+    std::unique_ptr<WorkerPool> _workers; // Started by the first batch or asynchronous query.
+
+  /**
+   * @brief Starts the worker pool on first use.
+   * @return The pool shared by batch searches and SearchAsync.
+   */
+    WorkerPool& Workers();
 
   /**
    * @brief Processes a single search query.
    * @param query The search query string.
-   * @return Vector of RelativeIndex objects representing search results.
+   * @param allowed Documents that may be returned, or nullptr for all documents.
+   * @param budget Limits on the evaluation, or nullptr to run to completion.
+   * @return Normalized results and whether the budget cut them short.
+   */
+    SearchOutcome ProcessQuery(const std::string& query, const DocumentBitmap* allowed,
+                               const QueryBudget* budget = nullptr);
+
+  /**
+   * @brief Finds the best documents of a query by absolute score.
+   * @param query The search query string.
+   * @param allowed Documents that may be returned, or nullptr for all documents.
+   * @param scratch Arena for all temporary data.
+   * @param top Receives up to responses_limit documents by decreasing score, then by doc_id.
+   * @param budget Limits on the evaluation, or nullptr to run to completion.
+   * @param trace Receives the plan and the work done, or nullptr.
+   * @param after Only documents ranked strictly after this one are returned, or nullptr for all.
+   * @return True if the budget ran out before all postings were read.
    */
-    std::vector<RelativeIndex> ProcessQuery(const std::string& query);
+    bool ScoreQuery(const std::string& query, const DocumentBitmap* allowed, std::pmr::memory_resource* scratch,
+                    std::pmr::vector<DocumentScore>& top, const QueryBudget* budget = nullptr,
+                    QueryPlan* trace = nullptr, const DocumentScore* after = nullptr);
 };
 
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "DocumentScore.h"
+#include "RelativeIndex.h"
+
+/**
+ * @brief Answer of the coordinator to one query.
+ */
+struct CoordinatedResult {
+  std::vector<RelativeIndex> results;
+  std::vector<size_t> failed_shards; // Shards that timed out or failed; their documents are missing.
+
+  /**
+   * @return True if some shards did not answer and the results may be incomplete.
+   */
+  bool Partial() const {
+    return !failed_shards.empty();
+  }
+};
+
+/**
+ * @brief Fans queries out to shard nodes and merges their answers.
+ * Shards return their best documents with absolute scores, so merging the per-shard
+ * top-k lists and normalizing by the best score gives the same ranking as a single
+ * index over the whole corpus. Shards that miss the deadline are left out and the
+ * result is marked partial. Connections to each shard are pooled between queries.
+ */
+class ShardCoordinator {
+  public:
+    /**
+     * @param shard_addresses Address of every shard node.
+     * @param timeout Time each query may take, including all shards.
+     * @param responses_limit Maximum number of responses per query.
+     */
+    ShardCoordinator(std::vector<std::string> shard_addresses, std::chrono::milliseconds timeout,
+                     int responses_limit = 5);
+    ~ShardCoordinator();
+
+    ShardCoordinator(const ShardCoordinator&) = delete;
+    ShardCoordinator& operator=(const ShardCoordinator&) = delete;
+
+    /**
+     * Runs a query on all shards. Safe to call from several threads.
+     * @param query The search query string.
+     * @param filter Metadata filter expression, empty for none.
+     * @return Merged results and the shards that did not answer in time.
+     */
+    CoordinatedResult Search(const std::string& query, const std::string& filter = {});
+
+    /**
+     * @return Number of shards.
+     */
+    size_t ShardCount() const;
+
+  private:
+    /**
+     * @brief A shard node and its idle connections.
+     */
+    struct Shard {
+      std::string address;
+      std::mutex mutex;
+      std::vector<int> idle_connections;
+    };
+
+    std::vector<std::unique_ptr<Shard>> _shards;
+    std::chrono::milliseconds _timeout;
+    int _responses_limit;
+
+    int Send(Shard& shard, const std::string& payload, bool allow_pooled, bool& pooled);
+    void Release(Shard& shard, int fd);
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "DocumentScore.h"
+
+/**
+ * @brief Query sent by the coordinator to a shard node.
+ */
+struct ShardRequest {
+  uint32_t limit = 5; // Number of results the shard returns.
+  std::string query;
+  std::string filter; // Metadata filter expression, empty for none.
+};
+
+/**
+ * @brief Answer of a shard node: its best documents with absolute scores and global IDs.
+ */
+struct ShardResponse {
+  bool ok = true;
+  std::string error; // Reason of the failure when ok is false.
+  std::vector<DocumentScore> results;
+};
+
+/**
+ * @brief Binary protocol between shard nodes and the coordinator.
+ * Every message is a frame: a 32-bit payload length followed by the payload. Integers are
+ * sent in host byte order, since all nodes run on the same machine. Addresses are
+ * "unix:/path/to/socket" or "host:port" (optionally prefixed with "tcp:").
+ */
+class ShardProtocol {
+  public:
+    static std::string EncodeRequest(const ShardRequest& request);
+    static ShardRequest DecodeRequest(std::string_view payload);
+    static std::string EncodeResponse(const ShardResponse& response);
+    static ShardResponse DecodeResponse(std::string_view payload);
+
+    /**
+     * Creates a listening socket. A stale Unix socket file is replaced.
+     * @param address Address to listen on.
+     * @return The listening socket descriptor.
+     */
+    static int Listen(const std::string& address);
+
+    /**
+     * Connects to a shard node.
+     * @param address Address of the node.
+     * @return The connected socket descriptor.
+     */
+    static int Connect(const std::string& address);
+
+    /**
+     * Writes one frame. Throws std::runtime_error if the peer is gone.
+     * @param fd Connected socket.
+     * @param payload Message to send.
+     */
+    static void SendFrame(int fd, std::string_view payload);
+
+    /**
+     * Reads one frame.
+     * @param fd Connected socket.
+     * @param payload Receives the message.
+     * @param deadline Time after which the read is abandoned.
+     * @return False on timeout, on a closed connection or on a malformed frame.
+     */
+    static bool ReceiveFrame(int fd, std::string& payload, std::chrono::steady_clock::time_point deadline);
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "InvertedIndex.h"
+#include "ShardProtocol.h"
+
+/**
+ * @brief Shard node: serves queries over one part of the corpus through ShardProtocol.
+ * Results carry absolute scores and global document IDs, so the coordinator can merge
+ * the answers of all shards exactly. Each connection is served by its own thread, which is
+ * joined once the connection closes.
+ */
+class ShardServer {
+  public:
+    /**
+     * @param index Index over the documents owned by this shard.
+     * @param first_doc_id Global ID of the first document of the shard.
+     */
+    ShardServer(InvertedIndex& index, size_t first_doc_id);
+    ~ShardServer();
+
+    ShardServer(const ShardServer&) = delete;
+    ShardServer& operator=(const ShardServer&) = delete;
+
+    /**
+     * Binds the listening socket; queries are accepted once Serve runs.
+     * @param address "unix:/path" or "host:port".
+     */
+    void Listen(const std::string& address);
+
+    /**
+     * Accepts connections and answers queries until Stop is called.
+     */
+    void Serve();
+
+    /**
+     * Stops accepting connections, closes the open ones and waits for their threads.
+     */
+    void Stop();
+
+    /**
+     * Answers a single request; used by the connection threads.
+     * @param request Decoded request.
+     * @return Response with global document IDs.
+     */
+    ShardResponse Answer(const ShardRequest& request);
+
+  private:
+    InvertedIndex& _index;
+    size_t _first_doc_id;
+    int _listen_fd = -1;
+    std::atomic<bool> _stopping{false};
+    std::mutex _mutex; // Guards the connection lists.
+    std::vector<int> _connections;
+    std::vector<std::thread> _threads;
+    std::vector<std::thread::id> _finished; // Threads whose connection closed, joined on the next accept.
+
+    void HandleConnection(int fd);
+};
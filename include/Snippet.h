@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief How snippets are cut and highlighted.
+ */
+struct SnippetOptions {
+  size_t window_bytes = 160; // Length of the excerpt around the query terms.
+  std::string highlight_open = "<b>"; // Inserted before every query term.
+  std::string highlight_close = "</b>"; // Inserted after every query term.
+};
+
+/**
+ * @brief Excerpt of a document around the query terms of one search hit.
+ */
+struct Snippet {
+  size_t doc_id = 0;
+  size_t begin = 0; // Byte offset of the excerpt in the document.
+  size_t end = 0; // One past the last byte of the excerpt.
+  size_t highlights = 0; // Query term occurrences marked in the excerpt.
+  std::string text; // Excerpt with whitespace runs collapsed and the query terms highlighted.
+};
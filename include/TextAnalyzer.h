@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Analysis stage applied to normalized words before indexing and before lookup.
+ * Drops stop words, found through a minimal perfect hash, and optionally reduces
+ * English words to a stem by stripping common suffixes. A default-constructed
+ * analyzer passes every word through unchanged.
+ */
+class TextAnalyzer {
+  public:
+    TextAnalyzer() = default;
+
+    /**
+     * Replaces the stop-word list. Words are normalized like indexed text.
+     * @param words Words to drop during analysis.
+     */
+    void SetStopWords(const std::vector<std::string>& words);
+
+    /**
+     * Enables or disables suffix-stripping stemming.
+     * @param enabled True to stem words.
+     */
+    void SetStemming(bool enabled);
+
+    /**
+     * @return A list of common English stop words.
+     */
+    static const std::vector<std::string>& DefaultStopWords();
+
+    /**
+     * @param word A normalized word.
+     * @return True if the word is in the stop-word list.
+     */
+    bool IsStopWord(std::string_view word) const;
+
+    /**
+     * Strips common English suffixes; non-ASCII words are returned unchanged.
+     * @param word A normalized word.
+     * @return The stem, always a prefix of word.
+     */
+    static std::string_view Stem(std::string_view word);
+
+    /**
+     * Applies the analysis stage to a normalized word.
+     * @param word A normalized word.
+     * @return The term to index or look up (a prefix of word); empty if the word is dropped.
+     */
+    std::string_view Analyze(std::string_view word) const;
+
+    /**
+     * @return Number of stop words.
+     */
+    size_t StopWordCount() const;
+
+  private:
+    std::vector<std::string> stop_words; // Slots of the perfect hash table; empty strings are free slots.
+    std::vector<uint32_t> displacements; // Per-bucket seeds of the hash-and-displace scheme.
+    size_t stop_word_count = 0;
+    bool stemming = false;
+
+    static uint64_t Hash(std::string_view word, uint64_t seed);
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Normalizes text for indexing: keeps letters and digits, case-folds them,
+ * turns ASCII whitespace and U+00A0 (no-break space) into single spaces and drops
+ * everything else.
+ * Input is treated as UTF-8. ASCII runs are processed 16 (SSE2) or 32 (AVX2) bytes
+ * at a time, multibyte sequences are classified and folded through Unicode tables.
+ * The implementation is picked at runtime from the features of the CPU.
+ */
+class TextNormalizer {
+  public:
+    /**
+     * @brief Available implementations of the normalization kernel.
+     */
+    enum class Kernel {
+      Scalar, // Byte-at-a-time reference implementation
+      SSE2,   // 16-byte ASCII fast path
+      AVX2    // 32-byte ASCII fast path
+    };
+
+    /**
+     * Normalizes text with the fastest kernel supported by the CPU.
+     * Whitespace is kept as a word separator, so normalizing a whole document and then
+     * splitting on spaces yields the same words as splitting first and cleaning each word.
+     * @param text UTF-8 input.
+     * @return Normalized text.
+     */
+    static std::string Normalize(std::string_view text);
+
+    /**
+     * Normalizes text with a specific kernel.
+     * @param text UTF-8 input.
+     * @param kernel Kernel to use; must be supported by the CPU.
+     * @return Normalized text.
+     */
+    static std::string Normalize(std::string_view text, Kernel kernel);
+
+    /**
+     * Normalizes text into a caller-provided buffer, for callers that manage their own memory.
+     * @param text UTF-8 input.
+     * @param out Output buffer of at least text.size() bytes.
+     * @return Number of bytes written.
+     */
+    static size_t NormalizeInto(std::string_view text, char* out);
+
+    /**
+     * @return The kernel selected for this CPU.
+     */
+    static Kernel ActiveKernel();
+
+    /**
+     * @param kernel Kernel to check.
+     * @return True if the kernel can run on this CPU.
+     */
+    static bool IsSupported(Kernel kernel);
+
+    /**
+     * @param code_point Unicode code point.
+     * @return True if the code point is treated as a letter or digit.
+     */
+    static bool IsAlnum(char32_t code_point);
+
+    /**
+     * Applies simple Unicode case folding. Folding never lengthens the UTF-8 encoding.
+     * @param code_point Unicode code point.
+     * @return The folded code point.
+     */
+    static char32_t FoldCase(char32_t code_point);
+};
@@ -1,19 +1,23 @@
 #include "ConverterJSON.h"
+#include "Metrics.h"
+#include <QDateTime>
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
 
+namespace {
+
 /**
- * @brief Reads text documents specified in the config.json file.
- * @return Vector containing the contents of each document.
+ * @brief Loads and parses config.json.
+ * @return The root object of the config file.
  */
-std::vector<std::string> ConverterJSON::GetTextDocuments() {
-    std::vector<std::string> documents;
-
+QJsonObject ReadConfig() {
     QString base_path = QDir::currentPath();
     QString config_path = QDir(base_path).filePath("../data/config.json");
     QFile config_file(config_path);
@@ -30,7 +34,31 @@ std::vector<std::string> ConverterJSON::GetTextDocuments() {
         throw std::runtime_error("Error parsing JSON in config file.");
     }
 
-    QJsonObject config_json = config_doc.object();
+    return config_doc.object();
+}
+
+/**
+ * @brief Returns the "config" section of config.json, or an empty object if it is missing.
+ */
+QJsonObject ReadConfigSection() {
+    QJsonObject config_json = ReadConfig();
+    if (!config_json.contains("config") || !config_json["config"].isObject()) {
+        return {};
+    }
+    return config_json["config"].toObject();
+}
+
+} // namespace
+
+/**
+ * @brief Resolves the document paths listed in the config.json file.
+ * @return Full path of each listed file.
+ */
+std::vector<std::string> ConverterJSON::GetDocumentPaths() {
+    std::vector<std::string> paths;
+
+    QString base_path = QDir::currentPath();
+    QJsonObject config_json = ReadConfig();
 
     // Check if the "config" section exists
     if (!config_json.contains("config") || !config_json["config"].isObject()) {
@@ -52,7 +80,7 @@ std::vector<std::string> ConverterJSON::GetTextDocuments() {
     QJsonArray files_array = config_json["files"].toArray();
 
     // Reserve space in the vector to avoid reallocations
-    documents.reserve(files_array.size());
+    paths.reserve(files_array.size());
 
     // Iterate over each file path in "files"
     for (const QJsonValue& file_path_value : files_array) {
@@ -61,17 +89,35 @@ std::vector<std::string> ConverterJSON::GetTextDocuments() {
             continue;
         }
         QString file_path = file_path_value.toString();
-        QString full_file_path = QDir(base_path).filePath(file_path);
+        paths.push_back(QDir(base_path).filePath(file_path).toStdString());
+    }
+
+    return paths;
+}
+
+/**
+ * @brief Reads text documents specified in the config.json file.
+ * @return Vector containing the contents of each document.
+ */
+std::vector<std::string> ConverterJSON::GetTextDocuments() {
+    std::vector<std::string> documents;
+    std::vector<std::string> paths = GetDocumentPaths();
+    documents.reserve(paths.size());
 
-        QFile file(full_file_path);
+    for (const auto& path : paths) {
+        SE_METRICS_SCOPE(Stage::FileRead);
+        QFile file(QString::fromStdString(path));
         if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            std::cerr << "Cannot open file: " << full_file_path.toStdString() << ". Skipping this file." << std::endl;
+            std::cerr << "Cannot open file: " << path << ". Skipping this file." << std::endl;
             continue;
         }
 
         QByteArray file_data = file.readAll();
         documents.push_back(file_data.toStdString());
         file.close();
+
+        SE_METRICS_ADD(Counter::DocumentsLoaded, 1);
+        SE_METRICS_ADD(Counter::BytesRead, static_cast<uint64_t>(file_data.size()));
     }
 
     if (documents.empty()) {
@@ -81,6 +127,88 @@ std::vector<std::string> ConverterJSON::GetTextDocuments() {
     return documents;
 }
 
+/**
+ * @brief Loads the documents listed in config.json concurrently via memory mapping.
+ * @return Mapped documents; files that cannot be opened are skipped.
+ */
+std::shared_ptr<const MappedDocuments> ConverterJSON::LoadTextDocuments() {
+    DocumentLoader loader(GetLoadQueueDepth());
+    auto documents = std::make_shared<MappedDocuments>(loader.Load(GetDocumentPaths()));
+
+    if (documents->size() == 0) {
+        throw std::runtime_error("No documents were read. Please check the file paths in config.json.");
+    }
+
+    std::cout << "Loaded " << documents->size() << " documents (" << documents->TotalBytes() << " bytes) in "
+              << documents->LoadSeconds() << " s, " << documents->GigabytesPerSecond() << " GB/s" << std::endl;
+    return documents;
+}
+
+/**
+ * @brief Builds the metadata of loaded documents for search filters.
+ * Every document gets "dir" (its directory as listed in config.json), "type" (lower-case
+ * file extension) and "date" (last modification, YYYY-MM-DD). An optional sidecar file
+ * "<document>.meta.json" holding a JSON object adds or overrides string and number fields.
+ * @param documents Documents returned by LoadTextDocuments.
+ * @return Metadata of each document, in document order.
+ */
+std::vector<DocumentMetadata> ConverterJSON::GetDocumentMetadata(const MappedDocuments& documents) {
+    std::vector<DocumentMetadata> metadata;
+    metadata.reserve(documents.size());
+
+    for (const std::string& path : documents.Paths()) {
+        QFileInfo file_info(QString::fromStdString(path));
+        DocumentMetadata fields;
+        fields["dir"] = QDir::cleanPath(file_info.path()).toStdString();
+        fields["type"] = file_info.suffix().toLower().toStdString();
+        fields["date"] = file_info.lastModified().date().toString(Qt::ISODate).toStdString();
+
+        QFile sidecar(QString::fromStdString(path) + ".meta.json");
+        if (sidecar.exists()) {
+            QJsonDocument sidecar_doc;
+            if (sidecar.open(QIODevice::ReadOnly | QIODevice::Text)) {
+                sidecar_doc = QJsonDocument::fromJson(sidecar.readAll());
+            }
+            if (!sidecar_doc.isObject()) {
+                std::cerr << "Metadata file " << sidecar.fileName().toStdString()
+                          << " is not a JSON object. Skipping it." << std::endl;
+            } else {
+                QJsonObject sidecar_json = sidecar_doc.object();
+                for (auto it = sidecar_json.begin(); it != sidecar_json.end(); ++it) {
+                    if (it.value().isString()) {
+                        fields[it.key().toStdString()] = it.value().toString().toStdString();
+                    } else if (it.value().isDouble()) {
+                        fields[it.key().toStdString()] = QString::number(it.value().toDouble()).toStdString();
+                    } else {
+                        std::cerr << "Metadata field '" << it.key().toStdString() << "' in "
+                                  << sidecar.fileName().toStdString() << " is not a string or number. Skipping it." << std::endl;
+                    }
+                }
+            }
+        }
+        metadata.push_back(std::move(fields));
+    }
+
+    return metadata;
+}
+
+/**
+ * @brief Reads the optional "load_queue_depth" value from config.json.
+ * @return Number of files loaded concurrently; 0 means one per hardware thread.
+ */
+size_t ConverterJSON::GetLoadQueueDepth() {
+    QJsonObject config_section = ReadConfigSection();
+    QJsonValue depth_value = config_section["load_queue_depth"];
+    if (depth_value.isUndefined()) {
+        return 0;
+    }
+    if (depth_value.isDouble() && depth_value.toInt() > 0) {
+        return static_cast<size_t>(depth_value.toInt());
+    }
+    std::cerr << "'load_queue_depth' in config file is not a positive integer. Using one per hardware thread." << std::endl;
+    return 0;
+}
+
 /**
  * Reads the "max_responses" value from config.json.
  * @return Maximum number of responses; returns default value 5 if not specified.
@@ -125,6 +253,247 @@ int ConverterJSON::GetResponsesLimit() {
     return max_responses;
 }
 
+/**
+ * @brief Reads the optional "memory_limit" value from config.json.
+ * The limit is either a number of bytes or a string with a K, M or G suffix (e.g. "512M").
+ * It bounds the postings kept in memory: once they fill it, they are spilled to disk,
+ * and the finished index serves them from the merged file on disk.
+ * @return Memory budget for the postings in bytes; 0 if unlimited.
+ */
+size_t ConverterJSON::GetMemoryLimit() {
+    QJsonObject config_section = ReadConfigSection();
+    if (!config_section.contains("memory_limit")) {
+        return 0;
+    }
+
+    QJsonValue limit_value = config_section["memory_limit"];
+    // 2^64 is exactly representable, so every double below it fits into size_t
+    if (limit_value.isDouble() && limit_value.toDouble() >= 0
+        && limit_value.toDouble() < static_cast<double>(std::numeric_limits<size_t>::max())) {
+        return static_cast<size_t>(limit_value.toDouble());
+    }
+
+    if (limit_value.isString()) {
+        QString limit = limit_value.toString().trimmed().toUpper();
+        size_t multiplier = 1;
+        if (limit.endsWith('K')) {
+            multiplier = size_t{1} << 10;
+        } else if (limit.endsWith('M')) {
+            multiplier = size_t{1} << 20;
+        } else if (limit.endsWith('G')) {
+            multiplier = size_t{1} << 30;
+        }
+        if (multiplier != 1) {
+            limit.chop(1);
+        }
+        bool ok = false;
+        qulonglong value = limit.toULongLong(&ok);
+        if (ok && value <= std::numeric_limits<size_t>::max() / multiplier) {
+            return static_cast<size_t>(value) * multiplier;
+        }
+    }
+
+    std::cerr << "'memory_limit' in config file is not a valid size. Indexing without a memory limit." << std::endl;
+    return 0;
+}
+
+/**
+ * @brief Builds the analysis stage from the optional "analysis" section of config.json.
+ * "stop_words" is either true (default English list) or an array of words;
+ * "stemming" enables suffix stripping.
+ * @return Configured analyzer; passes words through unchanged if the section is absent.
+ */
+TextAnalyzer ConverterJSON::GetTextAnalyzer() {
+    TextAnalyzer analyzer;
+    QJsonObject config_section = ReadConfigSection();
+    if (!config_section.contains("analysis")) {
+        return analyzer;
+    }
+    if (!config_section["analysis"].isObject()) {
+        std::cerr << "'analysis' in config file is not an object. Indexing without analysis." << std::endl;
+        return analyzer;
+    }
+
+    QJsonObject analysis = config_section["analysis"].toObject();
+    QJsonValue stop_words = analysis["stop_words"];
+    if (stop_words.isBool()) {
+        if (stop_words.toBool()) {
+            analyzer.SetStopWords(TextAnalyzer::DefaultStopWords());
+        }
+    } else if (stop_words.isArray()) {
+        std::vector<std::string> words;
+        for (const QJsonValue& word : stop_words.toArray()) {
+            if (!word.isString()) {
+                std::cerr << "Stop word is not a string. Skipping entry." << std::endl;
+                continue;
+            }
+            words.push_back(word.toString().toStdString());
+        }
+        analyzer.SetStopWords(words);
+    } else if (!stop_words.isUndefined()) {
+        std::cerr << "'stop_words' in config file must be a boolean or an array. Ignoring it." << std::endl;
+    }
+
+    QJsonValue stemming = analysis["stemming"];
+    if (stemming.isBool()) {
+        analyzer.SetStemming(stemming.toBool());
+    } else if (!stemming.isUndefined()) {
+        std::cerr << "'stemming' in config file is not a boolean. Stemming is disabled." << std::endl;
+    }
+
+    return analyzer;
+}
+
+/**
+ * @brief Reads the optional "deduplication" value from config.json.
+ * true enables duplicate detection with the default SimHash distance of 3 bits;
+ * a number enables it with that distance.
+ * @return Maximum SimHash distance for near duplicates; -1 if deduplication is disabled.
+ */
+int ConverterJSON::GetDeduplicationDistance() {
+    QJsonObject config_section = ReadConfigSection();
+    QJsonValue dedup_value = config_section["deduplication"];
+    if (dedup_value.isUndefined()) {
+        return -1;
+    }
+    if (dedup_value.isBool()) {
+        return dedup_value.toBool() ? 3 : -1;
+    }
+    if (dedup_value.isDouble() && dedup_value.toInt() >= 0 && dedup_value.toInt() < 64) {
+        return dedup_value.toInt();
+    }
+    std::cerr << "'deduplication' in config file must be a boolean or a distance below 64. Deduplication is disabled." << std::endl;
+    return -1;
+}
+
+/**
+ * @brief Reads the optional "impact_ordering" section from config.json:
+ * { "min_document_frequency": N, "top_k": K }. Terms found in at least N documents get
+ * postings sorted by count; K bounds each list (0 or missing keeps a full copy).
+ * @return Impact ordering settings; disabled if the section is missing or invalid.
+ */
+ImpactOrdering ConverterJSON::GetImpactOrdering() {
+    ImpactOrdering ordering;
+    QJsonObject config_section = ReadConfigSection();
+    if (!config_section.contains("impact_ordering")) {
+        return ordering;
+    }
+    if (!config_section["impact_ordering"].isObject()) {
+        std::cerr << "'impact_ordering' in config file is not an object. Impact ordering is disabled." << std::endl;
+        return ordering;
+    }
+
+    QJsonObject impact = config_section["impact_ordering"].toObject();
+    QJsonValue min_df = impact["min_document_frequency"];
+    QJsonValue top_k = impact["top_k"];
+    if (!min_df.isDouble() || min_df.toInt() <= 0 || (!top_k.isUndefined() && (!top_k.isDouble() || top_k.toInt() < 0))) {
+        std::cerr << "'impact_ordering' needs a positive 'min_document_frequency' and a non-negative 'top_k'. "
+                     "Impact ordering is disabled." << std::endl;
+        return ordering;
+    }
+    ordering.min_document_frequency = static_cast<size_t>(min_df.toInt());
+    ordering.top_k = static_cast<size_t>(top_k.toInt(0));
+    return ordering;
+}
+
+/**
+ * @brief Reads the optional "common_term_frequency" value from config.json.
+ * @return Document frequency above which query terms only score candidates; 0 if not set or invalid.
+ */
+size_t ConverterJSON::GetCommonTermFrequency() {
+    QJsonObject config_section = ReadConfigSection();
+    if (!config_section.contains("common_term_frequency")) {
+        return 0;
+    }
+    QJsonValue frequency = config_section["common_term_frequency"];
+    if (!frequency.isDouble() || frequency.toInteger() < 0) {
+        std::cerr << "'common_term_frequency' in config file must be a non-negative number. "
+                     "Common-term handling is disabled." << std::endl;
+        return 0;
+    }
+    return static_cast<size_t>(frequency.toInteger());
+}
+
+/**
+ * @brief Reads the optional "explain" flag from config.json.
+ * @return True if the query plan of every request should be printed.
+ */
+bool ConverterJSON::GetExplainQueries() {
+    QJsonObject config_section = ReadConfigSection();
+    return config_section["explain"].toBool(false);
+}
+
+/**
+ * @brief Reads the optional "numa" flag from config.json.
+ * @return True if the index should be replicated on every NUMA node and workers pinned.
+ */
+bool ConverterJSON::GetNumaPlacement() {
+    QJsonObject config_section = ReadConfigSection();
+    return config_section["numa"].toBool(false);
+}
+
+/**
+ * @brief Reads the optional "snippets" value from config.json.
+ * Accepts true for the default window, a window length in bytes, or an object with
+ * "window" and a two-element "highlight" array of opening and closing markers.
+ * @return Snippet options; window_bytes is 0 if snippets are not requested or invalid.
+ */
+SnippetOptions ConverterJSON::GetSnippetOptions() {
+    SnippetOptions options;
+    QJsonObject config_section = ReadConfigSection();
+    QJsonValue snippets = config_section["snippets"];
+    if (snippets.isUndefined() || (snippets.isBool() && !snippets.toBool())) {
+        options.window_bytes = 0;
+        return options;
+    }
+    if (snippets.isBool()) {
+        return options;
+    }
+
+    QJsonValue window = snippets;
+    QJsonValue highlight;
+    if (snippets.isObject()) {
+        window = snippets.toObject()["window"];
+        highlight = snippets.toObject()["highlight"];
+        if (window.isUndefined()) {
+            window = static_cast<qint64>(options.window_bytes);
+        }
+    }
+    bool valid_window = window.isDouble() && window.toInteger() > 0;
+    bool valid_highlight = highlight.isUndefined() ||
+        (highlight.isArray() && highlight.toArray().size() == 2 &&
+         highlight.toArray()[0].isString() && highlight.toArray()[1].isString());
+    if (!valid_window || !valid_highlight) {
+        std::cerr << "'snippets' in config file must be true, a positive window length, or an object with "
+                     "'window' and a two-string 'highlight' array. Snippets are disabled." << std::endl;
+        options.window_bytes = 0;
+        return options;
+    }
+
+    options.window_bytes = static_cast<size_t>(window.toInteger());
+    if (highlight.isArray()) {
+        options.highlight_open = highlight.toArray()[0].toString().toStdString();
+        options.highlight_close = highlight.toArray()[1].toString().toStdString();
+    }
+    return options;
+}
+
+/**
+ * @brief Reads the optional "stats_file" value from config.json.
+ * @return Path of the metrics report; empty if no report was requested.
+ */
+std::string ConverterJSON::GetStatsFile() {
+    QJsonObject config_section = ReadConfigSection();
+    if (!config_section.contains("stats_file")) {
+        return {};
+    }
+    if (!config_section["stats_file"].isString()) {
+        std::cerr << "'stats_file' in config file is not a string. Metrics report is disabled." << std::endl;
+        return {};
+    }
+    return QDir(QDir::currentPath()).filePath(config_section["stats_file"].toString()).toStdString();
+}
+
 /**
  * @brief Reads search requests from requests.json file.
  * @return Vector containing each request as a string.
@@ -173,21 +542,54 @@ std::vector<std::string> ConverterJSON::GetRequests() {
     return requests;
 }
 
+/**
+ * @brief Reads the optional "filter" expression from requests.json.
+ * The filter applies to every request, e.g. "type:txt date:2024-01-01..2024-12-31".
+ * @return The parsed filter; empty if none is given.
+ */
+DocumentFilter ConverterJSON::GetRequestFilter() {
+    QString requests_path = QDir(QDir::currentPath()).filePath("../data/requests.json");
+    QFile requests_file(requests_path);
+
+    if (!requests_file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        throw std::runtime_error("Cannot open requests file: " + requests_path.toStdString());
+    }
+
+    QJsonDocument requests_doc = QJsonDocument::fromJson(requests_file.readAll());
+    if (requests_doc.isNull()) {
+        throw std::runtime_error("Error parsing JSON in requests file.");
+    }
+
+    QJsonValue filter_value = requests_doc.object()["filter"];
+    if (filter_value.isUndefined()) {
+        return {};
+    }
+    if (!filter_value.isString()) {
+        throw std::runtime_error("'filter' in requests file is not a string.");
+    }
+    return DocumentFilter::Parse(filter_value.toString().toStdString());
+}
+
 /**
  * @brief Writes the search results to answers.json file.
  * @param answers Vector of vectors containing RelativeIndex objects for each request.
  */
-void ConverterJSON::putAnswers(const std::vector<std::vector<RelativeIndex>>& answers) {
+void ConverterJSON::putAnswers(const std::vector<std::vector<RelativeIndex>>& answers,
+                               const std::vector<std::vector<Snippet>>& snippets) {
     if (answers.empty()) {
         std::cerr << "No answers to write to answers.json." << std::endl;
         return;
     }
 
+    SE_METRICS_SCOPE(Stage::JsonOutput);
     QJsonObject answers_json;
     int request_id = 1;
 
     // Iterate over each request's results
-    for (const auto& result_for_request : answers) {
+    for (size_t request = 0; request < answers.size(); ++request) {
+        const auto& result_for_request = answers[request];
+        const std::vector<Snippet>* request_snippets =
+            request < snippets.size() && snippets[request].size() == result_for_request.size() ? &snippets[request] : nullptr;
         QString request_key = QString("request%1").arg(request_id);
         ++request_id;
 
@@ -200,10 +602,14 @@ void ConverterJSON::putAnswers(const std::vector<std::vector<RelativeIndex>>& an
 
             if (result_for_request.size() > 1) {
                 QJsonArray relevance_array;
-                for (const auto& rel : result_for_request) {
+                for (size_t i = 0; i < result_for_request.size(); ++i) {
+                    const auto& rel = result_for_request[i];
                     QJsonObject rel_obj;
                     rel_obj["docid"] = static_cast<int>(rel.doc_id);
                     rel_obj["rank"] = rel.rank;
+                    if (request_snippets != nullptr) {
+                        rel_obj["snippet"] = QString::fromStdString((*request_snippets)[i].text);
+                    }
                     relevance_array.append(rel_obj);
                 }
                 result["relevance"] = relevance_array;
@@ -211,6 +617,9 @@ void ConverterJSON::putAnswers(const std::vector<std::vector<RelativeIndex>>& an
                 const auto& rel = result_for_request.front();
                 result["docid"] = static_cast<int>(rel.doc_id);
                 result["rank"] = rel.rank;
+                if (request_snippets != nullptr) {
+                    result["snippet"] = QString::fromStdString(request_snippets->front().text);
+                }
             }
         }
 
@@ -0,0 +1,104 @@
+#include "Deduplicator.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <functional>
+#include <stdexcept>
+
+namespace {
+
+// splitmix64 finalizer, spreads std::hash output over all 64 bits
+uint64_t Mix(uint64_t value) {
+  value ^= value >> 30;
+  value *= 0xBF58476D1CE4E5B9ull;
+  value ^= value >> 27;
+  value *= 0x94D049BB133111EBull;
+  value ^= value >> 31;
+  return value;
+}
+
+} // namespace
+
+Deduplicator::Deduplicator(unsigned max_distance)
+  : _max_distance(max_distance), _band_count(max_distance + 1), _bands(max_distance + 1) {
+  if (max_distance >= 64) {
+    throw std::invalid_argument("SimHash distance must be below 64 bits.");
+  }
+}
+
+/**
+ * @brief Computes the exact and SimHash fingerprints of a document.
+ * Every term votes on each of the 64 SimHash bits with a weight equal to its count.
+ * @param text The normalized document text.
+ * @param word_counts Term frequencies of the document.
+ * @return Fingerprints of the document.
+ */
+DocumentFingerprint Deduplicator::Fingerprint(std::string_view text,
+                                              const std::pmr::unordered_map<std::string_view, size_t>& word_counts) {
+  DocumentFingerprint fingerprint;
+  fingerprint.content_hash = Mix(std::hash<std::string_view>{}(text));
+
+  std::array<int64_t, 64> votes{};
+  for (const auto& [word, count] : word_counts) {
+    uint64_t hash = Mix(std::hash<std::string_view>{}(word));
+    auto weight = static_cast<int64_t>(count);
+    for (size_t bit = 0; bit < 64; ++bit) {
+      votes[bit] += ((hash >> bit) & 1) ? weight : -weight;
+    }
+  }
+  for (size_t bit = 0; bit < 64; ++bit) {
+    if (votes[bit] > 0) {
+      fingerprint.simhash |= uint64_t{1} << bit;
+    }
+  }
+  return fingerprint;
+}
+
+uint64_t Deduplicator::BandValue(uint64_t simhash, size_t band) const {
+  // The last band takes the remaining bits so that all 64 bits are covered
+  size_t band_bits = 64 / _band_count;
+  size_t shift = band * band_bits;
+  size_t bits = band + 1 == _band_count ? 64 - shift : band_bits;
+  return bits == 64 ? simhash : (simhash >> shift) & ((uint64_t{1} << bits) - 1);
+}
+
+size_t Deduplicator::Add(size_t doc_id, const DocumentFingerprint& fingerprint) {
+  auto [exact, inserted] = _exact.try_emplace(fingerprint.content_hash, doc_id);
+  if (!inserted) {
+    ++_stats.exact_duplicates;
+    return exact->second;
+  }
+
+  // Near-duplicate candidates share at least one band with the document
+  size_t best_match = doc_id;
+  unsigned best_distance = _max_distance + 1;
+  for (size_t band = 0; band < _band_count; ++band) {
+    auto it = _bands[band].find(BandValue(fingerprint.simhash, band));
+    if (it == _bands[band].end()) {
+      continue;
+    }
+    for (size_t candidate : it->second) {
+      auto distance = static_cast<unsigned>(std::popcount(_simhashes[candidate] ^ fingerprint.simhash));
+      if (distance < best_distance || (distance == best_distance && candidate < best_match)) {
+        best_distance = distance;
+        best_match = candidate;
+      }
+    }
+  }
+
+  if (best_match != doc_id) {
+    ++_stats.near_duplicates;
+    exact->second = best_match;
+    return best_match;
+  }
+
+  _simhashes[doc_id] = fingerprint.simhash;
+  for (size_t band = 0; band < _band_count; ++band) {
+    _bands[band][BandValue(fingerprint.simhash, band)].push_back(doc_id);
+  }
+  return doc_id;
+}
+
+const DeduplicationStats& Deduplicator::GetStats() const {
+  return _stats;
+}
@@ -0,0 +1,296 @@
+#include "DocumentBitmap.h"
+#include <algorithm>
+#include <bit>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+
+// Largest array container; beyond it a bitmap (8 KiB) is smaller
+constexpr size_t kMaxArraySize = 4096;
+
+// 64-bit words in a bitmap container
+constexpr size_t kBitmapWords = 65536 / 64;
+
+} // namespace
+
+bool DocumentBitmap::Container::Contains(uint16_t low) const {
+  if (IsBitmap()) {
+    return (bits[low >> 6] >> (low & 63)) & 1;
+  }
+  return std::binary_search(array.begin(), array.end(), low);
+}
+
+void DocumentBitmap::Container::Add(uint16_t low) {
+  if (IsBitmap()) {
+    uint64_t mask = uint64_t{1} << (low & 63);
+    cardinality += (bits[low >> 6] & mask) == 0;
+    bits[low >> 6] |= mask;
+    return;
+  }
+  if (array.empty() || array.back() < low) {
+    array.push_back(low);
+  } else {
+    auto it = std::lower_bound(array.begin(), array.end(), low);
+    if (*it == low) {
+      return;
+    }
+    array.insert(it, low);
+  }
+  ++cardinality;
+  if (array.size() > kMaxArraySize) {
+    ToBitmap();
+  }
+}
+
+/**
+ * @return True if low was in the container.
+ */
+bool DocumentBitmap::Container::Remove(uint16_t low) {
+  if (IsBitmap()) {
+    uint64_t mask = uint64_t{1} << (low & 63);
+    if ((bits[low >> 6] & mask) == 0) {
+      return false;
+    }
+    bits[low >> 6] &= ~mask;
+    --cardinality;
+    ToArrayIfSparse();
+    return true;
+  }
+  auto it = std::lower_bound(array.begin(), array.end(), low);
+  if (it == array.end() || *it != low) {
+    return false;
+  }
+  array.erase(it);
+  --cardinality;
+  return true;
+}
+
+void DocumentBitmap::Container::ToBitmap() {
+  bits.assign(kBitmapWords, 0);
+  for (uint16_t low : array) {
+    bits[low >> 6] |= uint64_t{1} << (low & 63);
+  }
+  array.clear();
+  array.shrink_to_fit();
+}
+
+void DocumentBitmap::Container::ToArrayIfSparse() {
+  if (!IsBitmap() || cardinality > kMaxArraySize) {
+    return;
+  }
+  array.clear();
+  array.reserve(cardinality);
+  for (size_t word = 0; word < kBitmapWords; ++word) {
+    for (uint64_t value = bits[word]; value != 0; value &= value - 1) {
+      array.push_back(static_cast<uint16_t>(word * 64 + std::countr_zero(value)));
+    }
+  }
+  bits.clear();
+  bits.shrink_to_fit();
+}
+
+const DocumentBitmap::Container* DocumentBitmap::Find(uint32_t key) const {
+  auto it = std::lower_bound(containers.begin(), containers.end(), key,
+    [](const Container& container, uint32_t value) { return container.key < value; });
+  return it != containers.end() && it->key == key ? &*it : nullptr;
+}
+
+void DocumentBitmap::Add(size_t doc_id) {
+  if (doc_id > UINT32_MAX) {
+    throw std::out_of_range("Document ID does not fit into a 32-bit bitmap.");
+  }
+  auto key = static_cast<uint32_t>(doc_id >> 16);
+  auto low = static_cast<uint16_t>(doc_id & 0xFFFF);
+
+  if (containers.empty() || containers.back().key < key) {
+    containers.push_back({ key, {}, {}, 0 });
+    containers.back().Add(low);
+    return;
+  }
+  auto it = std::lower_bound(containers.begin(), containers.end(), key,
+    [](const Container& container, uint32_t value) { return container.key < value; });
+  if (it == containers.end() || it->key != key) {
+    it = containers.insert(it, { key, {}, {}, 0 });
+  }
+  it->Add(low);
+}
+
+void DocumentBitmap::Remove(size_t doc_id) {
+  if (doc_id > UINT32_MAX) {
+    return;
+  }
+  auto key = static_cast<uint32_t>(doc_id >> 16);
+  auto it = std::lower_bound(containers.begin(), containers.end(), key,
+    [](const Container& container, uint32_t value) { return container.key < value; });
+  if (it == containers.end() || it->key != key || !it->Remove(static_cast<uint16_t>(doc_id & 0xFFFF))) {
+    return;
+  }
+  if (it->cardinality == 0) {
+    containers.erase(it);
+  }
+}
+
+bool DocumentBitmap::Contains(size_t doc_id) const {
+  if (doc_id > UINT32_MAX) {
+    return false;
+  }
+  const Container* container = Find(static_cast<uint32_t>(doc_id >> 16));
+  return container != nullptr && container->Contains(static_cast<uint16_t>(doc_id & 0xFFFF));
+}
+
+size_t DocumentBitmap::Cardinality() const {
+  size_t total = 0;
+  for (const auto& container : containers) {
+    total += container.cardinality;
+  }
+  return total;
+}
+
+bool DocumentBitmap::Empty() const {
+  return containers.empty();
+}
+
+size_t DocumentBitmap::SizeInBytes() const {
+  size_t bytes = containers.capacity() * sizeof(Container);
+  for (const auto& container : containers) {
+    bytes += container.array.capacity() * sizeof(uint16_t) + container.bits.capacity() * sizeof(uint64_t);
+  }
+  return bytes;
+}
+
+/**
+ * @brief Intersects container by container. Array-array pairs use a sorted merge, pairs
+ * with a bitmap probe the bitmap, and bitmap-bitmap pairs AND the words.
+ * @param other Set to intersect with.
+ */
+void DocumentBitmap::IntersectWith(const DocumentBitmap& other) {
+  std::vector<Container> result;
+  for (auto& container : containers) {
+    const Container* match = other.Find(container.key);
+    if (match == nullptr) {
+      continue;
+    }
+
+    if (container.IsBitmap() && match->IsBitmap()) {
+      container.cardinality = 0;
+      for (size_t word = 0; word < kBitmapWords; ++word) {
+        container.bits[word] &= match->bits[word];
+        container.cardinality += static_cast<size_t>(std::popcount(container.bits[word]));
+      }
+      container.ToArrayIfSparse();
+    } else if (container.IsBitmap()) {
+      std::vector<uint16_t> kept;
+      std::copy_if(match->array.begin(), match->array.end(), std::back_inserter(kept),
+        [&container](uint16_t low) { return container.Contains(low); });
+      container.bits.clear();
+      container.array = std::move(kept);
+      container.cardinality = container.array.size();
+    } else {
+      std::erase_if(container.array, [match](uint16_t low) { return !match->Contains(low); });
+      container.cardinality = container.array.size();
+    }
+
+    if (container.cardinality != 0) {
+      result.push_back(std::move(container));
+    }
+  }
+  containers = std::move(result);
+}
+
+/**
+ * @brief Merges container by container; arrays that outgrow the array limit become bitmaps.
+ * @param other Set to merge in.
+ */
+void DocumentBitmap::UnionWith(const DocumentBitmap& other) {
+  std::vector<Container> result;
+  result.reserve(containers.size() + other.containers.size());
+  auto mine = containers.begin();
+  auto theirs = other.containers.begin();
+
+  while (mine != containers.end() || theirs != other.containers.end()) {
+    if (theirs == other.containers.end() || (mine != containers.end() && mine->key < theirs->key)) {
+      result.push_back(std::move(*mine++));
+      continue;
+    }
+    if (mine == containers.end() || theirs->key < mine->key) {
+      result.push_back(*theirs++);
+      continue;
+    }
+
+    Container merged = std::move(*mine++);
+    const Container& added = *theirs++;
+    if (!merged.IsBitmap() && !added.IsBitmap() && merged.array.size() + added.array.size() <= kMaxArraySize) {
+      std::vector<uint16_t> united;
+      united.reserve(merged.array.size() + added.array.size());
+      std::set_union(merged.array.begin(), merged.array.end(), added.array.begin(), added.array.end(),
+                     std::back_inserter(united));
+      merged.array = std::move(united);
+      merged.cardinality = merged.array.size();
+    } else {
+      if (!merged.IsBitmap()) {
+        merged.ToBitmap();
+      }
+      if (added.IsBitmap()) {
+        for (size_t word = 0; word < kBitmapWords; ++word) {
+          merged.bits[word] |= added.bits[word];
+        }
+      } else {
+        for (uint16_t low : added.array) {
+          merged.bits[low >> 6] |= uint64_t{1} << (low & 63);
+        }
+      }
+      merged.cardinality = 0;
+      for (uint64_t word : merged.bits) {
+        merged.cardinality += static_cast<size_t>(std::popcount(word));
+      }
+      merged.ToArrayIfSparse();
+    }
+    result.push_back(std::move(merged));
+  }
+  containers = std::move(result);
+}
+
+std::vector<size_t> DocumentBitmap::ToVector() const {
+  std::vector<size_t> ids;
+  ids.reserve(Cardinality());
+  for (const auto& container : containers) {
+    size_t base = static_cast<size_t>(container.key) << 16;
+    if (container.IsBitmap()) {
+      for (size_t word = 0; word < kBitmapWords; ++word) {
+        for (uint64_t value = container.bits[word]; value != 0; value &= value - 1) {
+          ids.push_back(base + word * 64 + static_cast<size_t>(std::countr_zero(value)));
+        }
+      }
+    } else {
+      for (uint16_t low : container.array) {
+        ids.push_back(base + low);
+      }
+    }
+  }
+  return ids;
+}
+
+uint32_t DocumentBitmap::Hash() const {
+  uint32_t hash = 2166136261u;
+  auto add = [&hash](uint32_t doc_id) {
+    for (int shift = 0; shift < 32; shift += 8) {
+      hash = (hash ^ ((doc_id >> shift) & 0xFF)) * 16777619u;
+    }
+  };
+  for (const auto& container : containers) {
+    uint32_t high = container.key << 16;
+    if (!container.IsBitmap()) {
+      for (uint16_t low : container.array) {
+        add(high | low);
+      }
+      continue;
+    }
+    for (size_t word = 0; word < kBitmapWords; ++word) {
+      for (uint64_t value = container.bits[word]; value != 0; value &= value - 1) {
+        add(high | static_cast<uint32_t>(word * 64 + std::countr_zero(value)));
+      }
+    }
+  }
+  return hash;
+}
@@ -0,0 +1,73 @@
+#include "DocumentFilter.h"
+#include <algorithm>
+#include <stdexcept>
+
+DocumentFilter DocumentFilter::Parse(std::string_view expression) {
+  DocumentFilter filter;
+  const std::string_view whitespace = " \t\n\v\f\r";
+
+  while (true) {
+    size_t start = expression.find_first_not_of(whitespace);
+    if (start == std::string_view::npos) {
+      break;
+    }
+    expression.remove_prefix(start);
+    size_t end = std::min(expression.find_first_of(whitespace), expression.size());
+    std::string_view term = expression.substr(0, end);
+    expression.remove_prefix(end);
+
+    size_t colon = term.find(':');
+    if (colon == 0 || colon == std::string_view::npos || colon + 1 == term.size()) {
+      throw std::invalid_argument("Filter clause '" + std::string(term) + "' must have the form field:value.");
+    }
+    std::string field(term.substr(0, colon));
+    std::string_view value = term.substr(colon + 1);
+
+    size_t range = value.find("..");
+    if (range != std::string_view::npos) {
+      filter.Between(std::move(field), std::string(value.substr(0, range)), std::string(value.substr(range + 2)));
+      continue;
+    }
+
+    std::vector<std::string> values;
+    while (true) {
+      size_t comma = std::min(value.find(','), value.size());
+      if (comma != 0) {
+        values.emplace_back(value.substr(0, comma));
+      }
+      if (comma == value.size()) {
+        break;
+      }
+      value.remove_prefix(comma + 1);
+    }
+    filter.Where(std::move(field), std::move(values));
+  }
+
+  return filter;
+}
+
+DocumentFilter& DocumentFilter::Where(std::string field, std::vector<std::string> values) {
+  Clause clause;
+  clause.field = std::move(field);
+  clause.values = std::move(values);
+  clauses.push_back(std::move(clause));
+  return *this;
+}
+
+DocumentFilter& DocumentFilter::Between(std::string field, std::string low, std::string high) {
+  Clause clause;
+  clause.field = std::move(field);
+  clause.is_range = true;
+  clause.low = std::move(low);
+  clause.high = std::move(high);
+  clauses.push_back(std::move(clause));
+  return *this;
+}
+
+bool DocumentFilter::Empty() const {
+  return clauses.empty();
+}
+
+const std::vector<DocumentFilter::Clause>& DocumentFilter::Clauses() const {
+  return clauses;
+}
\ No newline at end of file
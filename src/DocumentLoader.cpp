@@ -0,0 +1,225 @@
+#include "DocumentLoader.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SEARCH_ENGINE_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define SEARCH_ENGINE_HAVE_MMAP 0
+#endif
+
+namespace {
+
+#if SEARCH_ENGINE_HAVE_MMAP
+/**
+ * @brief Maps a file read-only and faults its pages in.
+ * @return False if the file cannot be opened or mapped.
+ */
+bool MapFile(const std::string& path, const char*& data, size_t& size) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat info {};
+  if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+    ::close(fd);
+    return false;
+  }
+
+  size = static_cast<size_t>(info.st_size);
+  if (size == 0) {
+    ::close(fd);
+    data = nullptr;
+    return true;
+  }
+
+  int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+  flags |= MAP_POPULATE; // Read the whole file now, while other workers do the same
+#endif
+  void* mapping = ::mmap(nullptr, size, PROT_READ, flags, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+#ifndef MAP_POPULATE
+  ::madvise(mapping, size, MADV_WILLNEED);
+#endif
+  data = static_cast<const char*>(mapping);
+  return true;
+}
+#endif
+
+/**
+ * @brief Reads a whole file into an owned buffer.
+ * @return False if the file cannot be opened or read.
+ */
+bool ReadFile(const std::string& path, std::unique_ptr<char[]>& buffer, size_t& size) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    return false;
+  }
+  std::streamoff end = file.tellg();
+  if (end < 0) {
+    return false;
+  }
+  size = static_cast<size_t>(end);
+  buffer = std::make_unique<char[]>(size);
+  file.seekg(0);
+  return static_cast<bool>(file.read(buffer.get(), static_cast<std::streamsize>(size)));
+}
+
+} // namespace
+
+MappedDocuments::~MappedDocuments() {
+  Release();
+}
+
+MappedDocuments::MappedDocuments(MappedDocuments&& other) noexcept
+  : mappings(std::move(other.mappings)), paths(std::move(other.paths)), failed_paths(std::move(other.failed_paths)),
+    total_bytes(other.total_bytes), load_seconds(other.load_seconds) {
+  other.mappings.clear();
+  other.total_bytes = 0;
+}
+
+MappedDocuments& MappedDocuments::operator=(MappedDocuments&& other) noexcept {
+  if (this != &other) {
+    Release();
+    mappings = std::move(other.mappings);
+    paths = std::move(other.paths);
+    failed_paths = std::move(other.failed_paths);
+    total_bytes = other.total_bytes;
+    load_seconds = other.load_seconds;
+    other.mappings.clear();
+    other.total_bytes = 0;
+  }
+  return *this;
+}
+
+void MappedDocuments::Release() {
+#if SEARCH_ENGINE_HAVE_MMAP
+  for (auto& mapping : mappings) {
+    if (mapping.mapped) {
+      ::munmap(const_cast<char*>(mapping.data), mapping.size);
+    }
+  }
+#endif
+  mappings.clear();
+}
+
+size_t MappedDocuments::size() const {
+  return mappings.size();
+}
+
+std::string_view MappedDocuments::operator[](size_t doc_id) const {
+  const Mapping& mapping = mappings[doc_id];
+  return { mapping.data, mapping.size };
+}
+
+bool MappedDocuments::Mapped() const {
+  return std::any_of(mappings.begin(), mappings.end(), [](const Mapping& mapping) { return mapping.mapped; });
+}
+
+size_t MappedDocuments::TotalBytes() const {
+  return total_bytes;
+}
+
+const std::vector<std::string>& MappedDocuments::Paths() const {
+  return paths;
+}
+
+const std::vector<std::string>& MappedDocuments::FailedPaths() const {
+  return failed_paths;
+}
+
+double MappedDocuments::LoadSeconds() const {
+  return load_seconds;
+}
+
+double MappedDocuments::GigabytesPerSecond() const {
+  return load_seconds > 0.0 ? static_cast<double>(total_bytes) / load_seconds / 1e9 : 0.0;
+}
+
+DocumentLoader::DocumentLoader(size_t queue_depth, bool copy_files)
+  : _queue_depth(queue_depth), _copy_files(copy_files) {
+  if (_queue_depth == 0) {
+    _queue_depth = std::thread::hardware_concurrency();
+    if (_queue_depth == 0) _queue_depth = 2;
+  }
+}
+
+/**
+ * @brief Loads the given files with up to queue_depth files in flight.
+ * Workers claim files through a shared counter, so large and small files balance out.
+ * @param paths Paths of the document files.
+ * @return Contents of the loaded files in the order of paths; unreadable files are skipped.
+ */
+MappedDocuments DocumentLoader::Load(const std::vector<std::string>& paths) const {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<MappedDocuments::Mapping> loaded(paths.size());
+  std::atomic<size_t> next_file{0};
+
+  auto worker = [&]() {
+    for (size_t i = next_file.fetch_add(1); i < paths.size(); i = next_file.fetch_add(1)) {
+      SE_METRICS_SCOPE(Stage::FileRead);
+      MappedDocuments::Mapping& mapping = loaded[i];
+      // An exception leaving a loader thread would terminate the process, so it only fails this file
+      try {
+#if SEARCH_ENGINE_HAVE_MMAP
+        if (!_copy_files) {
+          mapping.loaded = MapFile(paths[i], mapping.data, mapping.size);
+          mapping.mapped = mapping.loaded && mapping.size != 0;
+        } else
+#endif
+        {
+          mapping.loaded = ReadFile(paths[i], mapping.buffer, mapping.size);
+          mapping.data = mapping.buffer.get();
+        }
+      } catch (const std::exception& e) {
+        std::cerr << "Error reading file " << paths[i] << ": " << e.what() << std::endl;
+        mapping = MappedDocuments::Mapping{};
+      }
+      if (mapping.loaded) {
+        SE_METRICS_ADD(Counter::DocumentsLoaded, 1);
+        SE_METRICS_ADD(Counter::BytesRead, mapping.size);
+      }
+    }
+  };
+
+  size_t worker_count = std::min(_queue_depth, paths.size());
+  std::vector<std::thread> workers;
+  workers.reserve(worker_count);
+  for (size_t i = 1; i < worker_count; ++i) {
+    workers.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : workers) {
+    thread.join();
+  }
+
+  MappedDocuments documents;
+  documents.mappings.reserve(paths.size());
+  documents.paths.reserve(paths.size());
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if (!loaded[i].loaded) {
+      std::cerr << "Cannot open file: " << paths[i] << ". Skipping this file." << std::endl;
+      documents.failed_paths.push_back(paths[i]);
+      continue;
+    }
+    documents.total_bytes += loaded[i].size;
+    documents.paths.push_back(paths[i]);
+    documents.mappings.push_back(std::move(loaded[i]));
+  }
+  documents.load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return documents;
+}
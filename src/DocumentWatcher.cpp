@@ -0,0 +1,290 @@
+#include "DocumentWatcher.h"
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+#if defined(__linux__)
+#define SEARCH_ENGINE_HAVE_INOTIFY 1
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#define SEARCH_ENGINE_HAVE_INOTIFY 0
+#endif
+
+namespace {
+
+// A burst of events never delays a batch by more than this many debounce intervals
+constexpr int kMaxDebounceIntervals = 10;
+
+std::string NormalizePath(const std::string& path) {
+  std::error_code ec;
+  std::filesystem::path absolute = std::filesystem::absolute(path, ec);
+  return (ec ? std::filesystem::path(path) : absolute).lexically_normal().string();
+}
+
+/**
+ * @brief Size and modification time of a file, without reading it.
+ */
+FileFingerprint StatFile(const std::string& path) {
+  FileFingerprint fingerprint;
+  std::error_code ec;
+  if (!std::filesystem::is_regular_file(path, ec)) {
+    return fingerprint;
+  }
+  auto size = std::filesystem::file_size(path, ec);
+  auto mtime = std::filesystem::last_write_time(path, ec);
+  if (ec) {
+    return fingerprint;
+  }
+  fingerprint.exists = true;
+  fingerprint.size = size;
+  fingerprint.mtime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(mtime.time_since_epoch()).count();
+  return fingerprint;
+}
+
+bool SameContents(const FileFingerprint& a, const FileFingerprint& b) {
+  return a.exists == b.exists && (!a.exists || (a.size == b.size && a.content_hash == b.content_hash));
+}
+
+} // namespace
+
+DocumentWatcher::DocumentWatcher(InvertedIndex& index, const MappedDocuments& documents,
+                                 std::chrono::milliseconds debounce)
+  : _index(index), _debounce(debounce), _next_doc_id(documents.size()) {
+  if (documents.Mapped()) {
+    throw std::invalid_argument("Watched documents must be loaded as copies, not mapped.");
+  }
+  const auto& paths = documents.Paths();
+  for (size_t doc_id = 0; doc_id < paths.size(); ++doc_id) {
+    WatchedFile file;
+    file.path = paths[doc_id];
+    file.doc_id = doc_id;
+    file.fingerprint = StatFile(file.path);
+    file.fingerprint.exists = true;
+    file.fingerprint.size = documents[doc_id].size();
+    file.fingerprint.content_hash = std::hash<std::string_view>{}(documents[doc_id]);
+    _file_by_path.emplace(NormalizePath(file.path), _files.size());
+    _files.push_back(std::move(file));
+  }
+  for (const auto& path : documents.FailedPaths()) {
+    WatchedFile file;
+    file.path = path;
+    _file_by_path.emplace(NormalizePath(path), _files.size());
+    _files.push_back(std::move(file));
+  }
+
+#if SEARCH_ENGINE_HAVE_INOTIFY
+  if (::pipe2(_wake_fds, O_CLOEXEC | O_NONBLOCK) != 0) {
+    throw std::runtime_error("Cannot create the watcher wake-up pipe.");
+  }
+#endif
+}
+
+DocumentWatcher::~DocumentWatcher() {
+#if SEARCH_ENGINE_HAVE_INOTIFY
+  ::close(_wake_fds[0]);
+  ::close(_wake_fds[1]);
+#endif
+}
+
+void DocumentWatcher::SetMetadataSource(std::function<DocumentMetadata(const std::string& path)> source) {
+  _metadata_source = std::move(source);
+}
+
+FileFingerprint DocumentWatcher::Fingerprint(const std::string& path, std::string* contents) {
+  FileFingerprint fingerprint = StatFile(path);
+  if (!fingerprint.exists) {
+    return fingerprint;
+  }
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return {};
+  }
+  std::ostringstream buffer;
+  buffer << file.rdbuf();
+  std::string text = std::move(buffer).str();
+  fingerprint.size = text.size();
+  fingerprint.content_hash = std::hash<std::string_view>{}(text);
+  if (contents != nullptr) {
+    *contents = std::move(text);
+  }
+  return fingerprint;
+}
+
+std::vector<size_t> DocumentWatcher::StaleFiles() const {
+  std::vector<size_t> stale;
+  for (size_t i = 0; i < _files.size(); ++i) {
+    FileFingerprint current = StatFile(_files[i].path);
+    const FileFingerprint& known = _files[i].fingerprint;
+    if (current.exists != known.exists || current.size != known.size || current.mtime_ns != known.mtime_ns) {
+      stale.push_back(i);
+    }
+  }
+  return stale;
+}
+
+/**
+ * @brief Re-reads the reported files and re-indexes the ones whose contents changed.
+ * Files are compared by size and content hash, so a touch or a rewrite with the same
+ * contents costs a read but no re-indexing.
+ * @param files Indexes into _files.
+ * @param first_change Time of the first event of the batch.
+ * @return The applied batch.
+ */
+WatchBatch DocumentWatcher::Apply(const std::vector<size_t>& files, std::chrono::steady_clock::time_point first_change) {
+  auto start = std::chrono::steady_clock::now();
+  WatchBatch batch;
+  std::vector<DocumentUpdate> updates;
+  for (size_t i : files) {
+    WatchedFile& file = _files[i];
+    std::string contents;
+    FileFingerprint fingerprint = Fingerprint(file.path, &contents);
+    bool unchanged = SameContents(fingerprint, file.fingerprint) || (file.doc_id == SIZE_MAX && !fingerprint.exists);
+    file.fingerprint = fingerprint;
+    if (unchanged) {
+      ++batch.unchanged;
+      continue;
+    }
+    if (file.doc_id == SIZE_MAX) {
+      file.doc_id = _next_doc_id++;
+    }
+    DocumentUpdate update{ file.doc_id, std::move(contents) };
+    if (_metadata_source) {
+      update.metadata = fingerprint.exists ? _metadata_source(file.path) : DocumentMetadata{};
+    }
+    updates.push_back(std::move(update));
+  }
+
+  batch.updated = updates.size();
+  if (!updates.empty()) {
+    _index.UpdateDocuments(std::move(updates));
+  }
+  auto end = std::chrono::steady_clock::now();
+  batch.index_ms = std::chrono::duration<double, std::milli>(end - start).count();
+  batch.searchable_ms = std::chrono::duration<double, std::milli>(end - first_change).count();
+  return batch;
+}
+
+WatchBatch DocumentWatcher::Rescan() {
+  return Apply(StaleFiles(), std::chrono::steady_clock::now());
+}
+
+void DocumentWatcher::Stop() {
+  _stopping = true;
+#if SEARCH_ENGINE_HAVE_INOTIFY
+  char wake = 1;
+  [[maybe_unused]] auto written = ::write(_wake_fds[1], &wake, 1);
+#endif
+}
+
+/**
+ * @brief Collects inotify events on the directories of the files and applies them in batches.
+ * A batch is applied once the directory has been quiet for the debounce interval, or after
+ * kMaxDebounceIntervals intervals under a steady stream of writes. If the kernel queue
+ * overflows, events were lost and every file is checked against its fingerprint instead.
+ * @param on_batch Called after every applied batch.
+ */
+void DocumentWatcher::Run(std::function<void(const WatchBatch&)> on_batch) {
+#if SEARCH_ENGINE_HAVE_INOTIFY
+  int inotify_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd < 0) {
+    throw std::runtime_error("Cannot initialize inotify.");
+  }
+
+  std::unordered_map<int, std::filesystem::path> directories;
+  std::set<std::string> watched;
+  for (const auto& [path, file] : _file_by_path) {
+    std::string directory = std::filesystem::path(path).parent_path().string();
+    if (!watched.insert(directory).second) {
+      continue;
+    }
+    int wd = ::inotify_add_watch(inotify_fd, directory.c_str(),
+                                 IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+    if (wd < 0) {
+      ::close(inotify_fd);
+      throw std::runtime_error("Cannot watch directory: " + directory);
+    }
+    directories[wd] = directory;
+  }
+
+  std::set<size_t> pending;
+  bool overflow = false;
+  auto first_change = std::chrono::steady_clock::now();
+  auto last_event = first_change;
+  alignas(inotify_event) char buffer[64 * 1024];
+
+  auto due = [&]() {
+    return std::min(last_event + _debounce, first_change + _debounce * kMaxDebounceIntervals);
+  };
+
+  while (!_stopping) {
+    bool has_changes = overflow || !pending.empty();
+    int timeout = -1;
+    if (has_changes) {
+      auto wait = std::chrono::ceil<std::chrono::milliseconds>(due() - std::chrono::steady_clock::now());
+      timeout = static_cast<int>(std::max<int64_t>(wait.count(), 0));
+    }
+
+    pollfd descriptors[2] = { { inotify_fd, POLLIN, 0 }, { _wake_fds[0], POLLIN, 0 } };
+    int ready = ::poll(descriptors, 2, timeout);
+    if (ready < 0 && errno != EINTR) {
+      break;
+    }
+    if (ready > 0 && (descriptors[1].revents & POLLIN)) {
+      break;
+    }
+
+    if (ready > 0 && (descriptors[0].revents & POLLIN)) {
+      ssize_t length;
+      while ((length = ::read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (char* position = buffer; position < buffer + length;) {
+          auto* event = reinterpret_cast<inotify_event*>(position);
+          position += sizeof(inotify_event) + event->len;
+          if (event->mask & IN_Q_OVERFLOW) {
+            overflow = true;
+          } else if (event->len > 0) {
+            auto directory = directories.find(event->wd);
+            if (directory == directories.end()) {
+              continue;
+            }
+            auto file = _file_by_path.find((directory->second / event->name).lexically_normal().string());
+            if (file == _file_by_path.end()) {
+              continue;
+            }
+            pending.insert(file->second);
+          } else {
+            continue;
+          }
+          auto now = std::chrono::steady_clock::now();
+          if (!has_changes) {
+            first_change = now;
+            has_changes = true;
+          }
+          last_event = now;
+        }
+      }
+    }
+
+    if (has_changes && std::chrono::steady_clock::now() >= due()) {
+      std::vector<size_t> files = overflow ? StaleFiles() : std::vector<size_t>(pending.begin(), pending.end());
+      pending.clear();
+      overflow = false;
+      WatchBatch batch = Apply(files, first_change);
+      if (on_batch) {
+        on_batch(batch);
+      }
+    }
+  }
+  ::close(inotify_fd);
+#else
+  (void)on_batch;
+  throw std::runtime_error("Watch mode needs inotify; call Rescan periodically instead.");
+#endif
+}
@@ -1,23 +1,412 @@
 #include "InvertedIndex.h"
-#include <sstream>
+#include "Metrics.h"
+#include "ScratchArena.h"
+#include "TextNormalizer.h"
+#include <string_view>
 #include <future>
 #include <unordered_map>
 #include <iostream>
 #include <cctype>
+#include <algorithm>
+#include <numeric>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <queue>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
-std::string InvertedIndex::CleanWord(const std::string& word) {
-  std::string clean_word;
-  for (char c : word) {
-    if (std::isalnum(c)) {
-      clean_word += std::tolower(c);
+namespace {
+
+// Initial size of the per-thread arena for the temporaries of one document
+constexpr size_t kDocumentArenaBytes = 256 * 1024;
+
+/**
+ * @brief Length of the separator TextNormalizer turns into one space at text[pos]:
+ * 1 for an ASCII whitespace byte, 2 for a UTF-8 no-break space, 0 for anything else.
+ */
+size_t SeparatorLength(std::string_view text, size_t pos) {
+  char c = text[pos];
+  if (c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r') {
+    return 1;
+  }
+  return c == '\xC2' && pos + 1 < text.size() && text[pos + 1] == '\xA0' ? 2 : 0;
+}
+
+/**
+ * @brief End of the word of the original text that starts at begin.
+ * The normalizer turns every separator into one space and emits no other spaces,
+ * so the n-th space-separated word of a normalized text comes from the n-th word here.
+ */
+size_t WordEnd(std::string_view text, size_t begin) {
+  while (begin < text.size() && SeparatorLength(text, begin) == 0) {
+    ++begin;
+  }
+  return begin;
+}
+
+/**
+ * @brief Start of the word of the original text that follows the one starting at begin.
+ */
+size_t NextWord(std::string_view text, size_t begin) {
+  size_t end = WordEnd(text, begin);
+  return end < text.size() ? end + SeparatorLength(text, end) : end + 1;
+}
+
+// Term offsets are 32-bit: words starting past this byte of a document get none
+constexpr size_t kMaxTermOffset = UINT32_MAX;
+
+/**
+ * @brief Warns that the snippets of an oversized document only cover its start.
+ */
+void WarnOffsetsClamped(size_t doc_id) {
+  std::cerr << "Document " << doc_id << " is larger than 4 GiB; term offsets, and so snippets, "
+            << "only cover its first 4 GiB." << std::endl;
+}
+
+uint32_t TermKey(std::string_view term) {
+  return static_cast<uint32_t>(std::hash<std::string_view>{}(term));
+}
+
+/**
+ * @brief Heap bytes owned by a string beyond the small-string buffer.
+ */
+size_t StringHeapBytes(const std::string& value) {
+  static const size_t small_string_capacity = std::string().capacity();
+  return value.capacity() > small_string_capacity ? value.capacity() + 1 : 0;
+}
+
+/**
+ * @brief Bytes of one dictionary node: next pointer, key/value pair, cached hash and key storage.
+ */
+template <typename Postings = std::vector<Entry>>
+size_t NodeBytes(const std::string& word) {
+  return sizeof(void*) + sizeof(std::pair<const std::string, Postings>) + sizeof(size_t) + StringHeapBytes(word);
+}
+
+/**
+ * @brief Estimated bytes one new postings entry adds to a dictionary, with its node if the term is new.
+ */
+size_t PostingBytes(std::string_view term, bool new_term) {
+  size_t bytes = sizeof(Entry);
+  if (new_term) {
+    bytes += sizeof(void*) + sizeof(std::pair<const std::string, std::vector<Entry>>) + sizeof(size_t) + term.size();
+  }
+  return bytes;
+}
+
+bool ByDocId(const Entry& a, const Entry& b) {
+  return a.doc_id < b.doc_id;
+}
+
+bool ByImpact(const Entry& a, const Entry& b) {
+  return a.count != b.count ? a.count > b.count : a.doc_id < b.doc_id;
+}
+
+/**
+ * @brief Copies the top_k entries of a postings list in impact order (all of them if top_k is 0).
+ * Only those entries are sorted, so a short list costs a partial sort.
+ */
+std::vector<Entry> ImpactList(std::span<const Entry> entries, size_t top_k) {
+  std::vector<Entry> impact(entries.begin(), entries.end());
+  size_t length = top_k != 0 ? std::min(impact.size(), top_k) : impact.size();
+  std::partial_sort(impact.begin(), impact.begin() + length, impact.end(), ByImpact);
+  impact.resize(length);
+  impact.shrink_to_fit();
+  return impact;
+}
+
+/**
+ * @brief Place of the merged postings of one term in the postings file.
+ */
+struct MergedTerm {
+  std::string word;
+  size_t offset; // Index of the first entry
+  size_t count; // Number of entries
+};
+
+/**
+ * @brief Sorted partial indexes flushed to temporary files (SPIMI runs).
+ * Run files hold terms in ascending order, each followed by its postings:
+ * [term length][term bytes][entry count][entries...]. Files are removed on destruction.
+ */
+class SpillRuns {
+  public:
+    SpillRuns() = default;
+    SpillRuns(const SpillRuns&) = delete;
+    SpillRuns& operator=(const SpillRuns&) = delete;
+
+    ~SpillRuns() {
+      std::error_code ec;
+      for (const auto& path : paths) {
+        std::filesystem::remove(path, ec);
+      }
+    }
+
+    bool Empty() const { return runs.empty(); }
+    size_t Size() const { return runs.size(); }
+
+    /**
+     * Writes a partial index to a new run file in term order.
+     */
+    void Write(const InvertedIndex::FrequencyDictionary& partial) {
+      std::vector<const std::pair<const std::string, std::vector<Entry>>*> sorted;
+      sorted.reserve(partial.size());
+      for (const auto& item : partial) {
+        sorted.push_back(&item);
+      }
+      std::sort(sorted.begin(), sorted.end(), [](const auto* a, const auto* b) {
+        return a->first < b->first;
+      });
+
+      std::filesystem::path path = CreateFile();
+      runs.push_back(path);
+      std::ofstream out(path, std::ios::binary | std::ios::trunc);
+      if (!out) {
+        throw std::runtime_error("Cannot open index run file: " + path.string());
+      }
+
+      for (const auto* item : sorted) {
+        uint64_t word_size = item->first.size();
+        uint64_t entry_count = item->second.size();
+        out.write(reinterpret_cast<const char*>(&word_size), sizeof(word_size));
+        out.write(item->first.data(), static_cast<std::streamsize>(word_size));
+        out.write(reinterpret_cast<const char*>(&entry_count), sizeof(entry_count));
+        out.write(reinterpret_cast<const char*>(item->second.data()),
+                  static_cast<std::streamsize>(entry_count * sizeof(Entry)));
+      }
+      if (!out) {
+        throw std::runtime_error("Error writing index run file: " + path.string());
+      }
+    }
+
+    /**
+     * K-way merges all runs into one postings file of bare entries, streaming them so that
+     * no postings list is held in memory. Runs hold consecutive document ranges, so appending
+     * the postings of equal terms in run order keeps every postings list sorted by doc_id.
+     * @param path Receives the postings file, which is removed with the runs.
+     * @return Terms in ascending order with the place of their postings in the file.
+     */
+    std::vector<MergedTerm> Merge(std::filesystem::path& path) {
+      struct Cursor {
+        std::ifstream in;
+        std::string word;
+        std::vector<Entry> entries;
+
+        bool Next() {
+          uint64_t word_size = 0;
+          if (!in.read(reinterpret_cast<char*>(&word_size), sizeof(word_size))) {
+            return false;
+          }
+          word.resize(word_size);
+          uint64_t entry_count = 0;
+          in.read(word.data(), static_cast<std::streamsize>(word_size));
+          in.read(reinterpret_cast<char*>(&entry_count), sizeof(entry_count));
+          entries.resize(entry_count);
+          in.read(reinterpret_cast<char*>(entries.data()), static_cast<std::streamsize>(entry_count * sizeof(Entry)));
+          if (!in) {
+            throw std::runtime_error("Truncated index run file.");
+          }
+          return true;
+        }
+      };
+
+      SE_METRICS_SCOPE(Stage::Merge);
+      std::vector<Cursor> cursors(runs.size());
+      auto greater = [&cursors](size_t a, size_t b) {
+        int order = cursors[a].word.compare(cursors[b].word);
+        return order == 0 ? a > b : order > 0;
+      };
+      std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+
+      for (size_t i = 0; i < runs.size(); ++i) {
+        cursors[i].in.open(runs[i], std::ios::binary);
+        if (!cursors[i].in) {
+          throw std::runtime_error("Cannot open index run file: " + runs[i].string());
+        }
+        if (cursors[i].Next()) {
+          heap.push(i);
+        }
+      }
+
+      path = CreateFile();
+      std::ofstream out(path, std::ios::binary | std::ios::trunc);
+      if (!out) {
+        throw std::runtime_error("Cannot open postings file: " + path.string());
+      }
+      std::vector<MergedTerm> merged;
+      size_t written = 0;
+      while (!heap.empty()) {
+        size_t run = heap.top();
+        heap.pop();
+        const Cursor& cursor = cursors[run];
+        if (merged.empty() || merged.back().word != cursor.word) {
+          merged.push_back({ cursor.word, written, 0 });
+        }
+        out.write(reinterpret_cast<const char*>(cursor.entries.data()),
+                  static_cast<std::streamsize>(cursor.entries.size() * sizeof(Entry)));
+        merged.back().count += cursor.entries.size();
+        written += cursor.entries.size();
+        if (cursors[run].Next()) {
+          heap.push(run);
+        }
+      }
+      out.close();
+      if (!out) {
+        throw std::runtime_error("Error writing postings file: " + path.string());
+      }
+      return merged;
+    }
+
+  private:
+    std::vector<std::filesystem::path> runs;
+    std::vector<std::filesystem::path> paths; // Every file created, runs and postings file
+
+    /**
+     * Creates an empty temporary file that is removed on destruction.
+     */
+    std::filesystem::path CreateFile() {
+      // mkstemp picks a name no other process or index uses and creates the file atomically
+      std::string name = (std::filesystem::temp_directory_path() / "search_engine_run_XXXXXX").string();
+      int fd = ::mkstemp(name.data());
+      if (fd < 0) {
+        throw std::runtime_error("Cannot create index run file in " + std::filesystem::temp_directory_path().string());
+      }
+      ::close(fd);
+      paths.push_back(name);
+      return name;
+    }
+};
+
+} // namespace
+
+/**
+ * @brief Maps the postings file of a spilled build read-only. Pages are read in as queries
+ * touch them and can be dropped again under memory pressure, since the file backs them.
+ */
+struct InvertedIndex::PostingsFile {
+  const Entry* data = nullptr;
+  size_t size = 0; // Number of entries
+
+  PostingsFile(const std::filesystem::path& path, size_t entry_count) : size(entry_count) {
+    if (size == 0) {
+      return;
     }
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("Cannot open postings file: " + path.string());
+    }
+    void* mapping = ::mmap(nullptr, size * sizeof(Entry), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+      throw std::runtime_error("Cannot map postings file: " + path.string());
+    }
+    data = static_cast<const Entry*>(mapping);
   }
+
+  PostingsFile(const PostingsFile&) = delete;
+  PostingsFile& operator=(const PostingsFile&) = delete;
+
+  ~PostingsFile() {
+    if (data != nullptr) {
+      ::munmap(const_cast<Entry*>(data), size * sizeof(Entry));
+    }
+  }
+};
+
+std::string InvertedIndex::CleanWord(const std::string& word) const {
+  std::string clean_word = TextNormalizer::Normalize(word);
+  std::erase(clean_word, ' ');
   return clean_word;
 }
 
+/**
+ * @brief Builds the partial index of the documents this thread takes from a shared counter.
+ * Documents are taken one at a time, so the documents indexed by all threads of a round
+ * always form a contiguous range, and every thread's postings are sorted by doc_id.
+ * After each document the estimated growth of the partial index is added to round_bytes;
+ * once it exceeds the budget, no thread takes another document.
+ * Per-document temporaries (normalized text, term counts) come from an arena that is
+ * reset between documents, and the partial index lives in an arena of its own, so the
+ * tokenizer does not call malloc per word or per document.
+ * @param next_doc Next document to index, shared by the threads of the round.
+ * @param end_doc One past the last document to index.
+ * @param round_bytes Estimated bytes added by all threads of the round.
+ * @param byte_budget Bytes the round may add; 0 for no limit.
+ * @return Frequency dictionary of the documents indexed by this thread.
+ */
+InvertedIndex::PartialIndex InvertedIndex::IndexDocuments(std::atomic<size_t>& next_doc, size_t end_doc,
+                                                          std::atomic<size_t>& round_bytes, size_t byte_budget) {
+  PartialIndex partial;
+  ScratchArena document_arena(kDocumentArenaBytes);
+
+  while (byte_budget == 0 || round_bytes.load(std::memory_order_relaxed) <= byte_budget) {
+    size_t doc_id = next_doc.fetch_add(1);
+    if (doc_id >= end_doc) {
+      break;
+    }
+    SE_METRICS_SCOPE(Stage::Tokenize);
+    document_arena.Reset();
+    std::pmr::memory_resource* scratch = document_arena.Resource();
+
+    // Normalizing the whole document keeps spaces as the only separators
+    std::string_view doc_text = doc_texts[doc_id];
+    auto* buffer = static_cast<char*>(scratch->allocate(std::max<size_t>(doc_text.size(), 1), 1));
+    std::string_view text(buffer, TextNormalizer::NormalizeInto(doc_text, buffer));
+    std::string_view remaining = text;
+    std::pmr::unordered_map<std::string_view, size_t> word_count_in_doc(scratch);
+
+    // Count occurrences of each word in the document, following the words of the original
+    // text alongside when their offsets are recorded
+    size_t tokens = 0;
+    size_t original_word = 0;
+    while (!remaining.empty()) {
+      size_t word_end = std::min(remaining.find(' '), remaining.size());
+      std::string_view term = analyzer.Analyze(remaining.substr(0, word_end));
+      if (!term.empty()) {
+        ++word_count_in_doc[term];
+        ++tokens;
+        if (store_offsets && original_word <= kMaxTermOffset) {
+          term_offsets[doc_id].push_back({ TermKey(term), static_cast<uint32_t>(original_word) });
+        }
+      }
+      if (store_offsets) {
+        original_word = NextWord(doc_text, original_word);
+      }
+      remaining.remove_prefix(std::min(word_end + 1, remaining.size()));
+    }
+    SE_METRICS_ADD(Counter::TokensIndexed, tokens);
+    if (store_offsets) {
+      std::sort(term_offsets[doc_id].begin(), term_offsets[doc_id].end());
+      if (doc_text.size() > kMaxTermOffset) {
+        WarnOffsetsClamped(doc_id);
+      }
+    }
+
+    if (deduplicate) {
+      fingerprints[doc_id] = Deduplicator::Fingerprint(text, word_count_in_doc);
+    }
+
+    // Populate the local frequency dictionary
+    size_t added_bytes = 0;
+    for (const auto& [word, count] : word_count_in_doc) {
+      auto it = partial.dictionary.find(word);
+      added_bytes += PostingBytes(word, it == partial.dictionary.end());
+      if (it == partial.dictionary.end()) {
+        it = partial.dictionary.emplace(std::piecewise_construct, std::forward_as_tuple(word), std::forward_as_tuple()).first;
+      }
+      it->second.push_back({ doc_id, count });
+    }
+    round_bytes.fetch_add(added_bytes, std::memory_order_relaxed);
+  }
+
+  return partial;
+}
+
 /**
  * @brief Updates the document base and rebuilds the inverted index.
- * Processes documents in parallel to improve performance.
  * @param input_docs A vector containing the content of each document.
  */
 void InvertedIndex::UpdateDocumentBase(const std::vector<std::string>& input_docs) {
@@ -25,71 +414,685 @@ void InvertedIndex::UpdateDocumentBase(const std::vector<std::string>& input_doc
     throw std::invalid_argument("Input documents list is empty.");
   }
 
+  std::lock_guard<std::mutex> update_lock(update_mutex);
+  std::unique_lock<std::shared_mutex> lock(index_mutex);
   docs = input_docs;
+  mapped_docs.reset();
+  updated_docs.clear();
+  doc_texts.assign(docs.begin(), docs.end());
+  BuildIndex();
+}
+
+/**
+ * @brief Rebuilds the inverted index over memory-mapped documents.
+ * Documents are tokenized straight from the mapped pages.
+ * @param input_docs Documents loaded by DocumentLoader.
+ */
+void InvertedIndex::UpdateMappedDocumentBase(std::shared_ptr<const MappedDocuments> input_docs) {
+  if (!input_docs || input_docs->size() == 0) {
+    throw std::invalid_argument("Input documents list is empty.");
+  }
+
+  std::lock_guard<std::mutex> update_lock(update_mutex);
+  std::unique_lock<std::shared_mutex> lock(index_mutex);
+  docs.clear();
+  updated_docs.clear();
+  mapped_docs = std::move(input_docs);
+  doc_texts.clear();
+  doc_texts.reserve(mapped_docs->size());
+  for (size_t doc_id = 0; doc_id < mapped_docs->size(); ++doc_id) {
+    doc_texts.push_back((*mapped_docs)[doc_id]);
+  }
+  BuildIndex();
+}
+
+/**
+ * @brief Re-indexes the changed documents in place.
+ * Old and new term counts are computed before the exclusive lock is taken, so queries
+ * are only blocked while postings entries are removed and inserted. Postings stay sorted
+ * by doc_id, and the impact-ordered lists of the touched terms are rebuilt.
+ * @param updates New contents of the changed documents.
+ */
+void InvertedIndex::UpdateDocuments(std::vector<DocumentUpdate> updates) {
+  std::lock_guard<std::mutex> update_lock(update_mutex);
+
+  // The last update of a document in the batch wins
+  std::stable_sort(updates.begin(), updates.end(), [](const DocumentUpdate& a, const DocumentUpdate& b) {
+    return a.doc_id < b.doc_id;
+  });
+  std::vector<DocumentUpdate> batch;
+  for (auto& update : updates) {
+    if (!batch.empty() && batch.back().doc_id == update.doc_id) {
+      batch.back() = std::move(update);
+    } else {
+      batch.push_back(std::move(update));
+    }
+  }
+  for (size_t i = 0; i < batch.size(); ++i) {
+    if (batch[i].doc_id > doc_texts.size() + i) {
+      throw std::invalid_argument("Appended documents must take consecutive IDs.");
+    }
+  }
+  if (batch.empty()) {
+    return;
+  }
+
+  if (deduplicate) {
+    // The rebuild runs on a scratch index while queries keep reading this one. Map nodes keep
+    // their address when moved between maps, so the new texts stay where the scratch index points.
+    std::unordered_map<size_t, std::string> batch_texts;
+    InvertedIndex rebuilt;
+    rebuilt.doc_texts = doc_texts;
+    for (auto& update : batch) {
+      std::string_view text = batch_texts[update.doc_id] = std::move(update.text);
+      if (update.doc_id == rebuilt.doc_texts.size()) {
+        rebuilt.doc_texts.push_back(text);
+      } else {
+        rebuilt.doc_texts[update.doc_id] = text;
+      }
+    }
+    rebuilt.analyzer = analyzer;
+    rebuilt.impact_ordering = impact_ordering;
+    rebuilt.memory_limit = memory_limit;
+    rebuilt.deduplicate = true;
+    rebuilt.duplicate_distance = duplicate_distance;
+    rebuilt.store_offsets = store_offsets;
+    rebuilt.numa = numa;
+    rebuilt.BuildIndex();
+
+    // The old structures end up in the scratch index and are freed after the lock is released
+    std::unique_lock<std::shared_mutex> lock(index_mutex);
+    while (!batch_texts.empty()) {
+      auto text = batch_texts.extract(batch_texts.begin());
+      updated_docs.erase(text.key());
+      updated_docs.insert(std::move(text));
+    }
+    std::swap(doc_texts, rebuilt.doc_texts);
+    std::swap(freq_dictionary, rebuilt.freq_dictionary);
+    std::swap(disk_dictionary, rebuilt.disk_dictionary);
+    std::swap(postings_file, rebuilt.postings_file);
+    std::swap(impact_dictionary, rebuilt.impact_dictionary);
+    std::swap(canonical_ids, rebuilt.canonical_ids);
+    std::swap(aliases, rebuilt.aliases);
+    std::swap(dedup_stats, rebuilt.dedup_stats);
+    std::swap(term_offsets, rebuilt.term_offsets);
+    std::swap(replicas, rebuilt.replicas);
+    spilled_runs = rebuilt.spilled_runs;
+    for (const auto& update : batch) {
+      if (update.metadata) {
+        ApplyMetadata(update.doc_id, *update.metadata);
+      }
+    }
+    return;
+  }
+
+  // Only this thread changes doc_texts, so the old texts can be read without the exclusive lock.
+  // A mapped text may already show the new file contents, or end past a truncated file, so the
+  // old postings of mapped documents are found by sweeping the dictionary instead.
+  std::vector<std::unordered_map<std::string, size_t>> old_counts(batch.size());
+  std::vector<std::unordered_map<std::string, size_t>> new_counts(batch.size());
+  std::vector<std::vector<TermOffset>> new_offsets(store_offsets ? batch.size() : 0);
+  std::vector<size_t> swept_docs;
+  for (size_t i = 0; i < batch.size(); ++i) {
+    SE_METRICS_SCOPE(Stage::Tokenize);
+    size_t doc_id = batch[i].doc_id;
+    if (mapped_docs && mapped_docs->Mapped() && doc_id < mapped_docs->size() && !updated_docs.contains(doc_id)) {
+      swept_docs.push_back(doc_id);
+    } else if (doc_id < doc_texts.size()) {
+      old_counts[i] = CountTerms(doc_texts[doc_id]);
+    }
+    new_counts[i] = CountTerms(batch[i].text, store_offsets ? &new_offsets[i] : nullptr);
+    if (store_offsets && batch[i].text.size() > kMaxTermOffset) {
+      WarnOffsetsClamped(doc_id);
+    }
+  }
+
+  std::unique_lock<std::shared_mutex> lock(index_mutex);
+  SE_METRICS_SCOPE(Stage::Merge);
+  auto by_doc_id = [](const Entry& entry, size_t doc_id) { return entry.doc_id < doc_id; };
+  std::vector<std::string> touched_terms;
+  if (!swept_docs.empty()) {
+    auto is_swept = [&swept_docs](const Entry& entry) {
+      return std::binary_search(swept_docs.begin(), swept_docs.end(), entry.doc_id);
+    };
+    std::vector<std::string> swept_on_disk;
+    for (const auto& [word, entries] : disk_dictionary) {
+      if (std::any_of(entries.begin(), entries.end(), is_swept)) {
+        swept_on_disk.push_back(word);
+      }
+    }
+    for (const auto& word : swept_on_disk) {
+      MaterializeTerm(word);
+    }
+    for (auto it = freq_dictionary.begin(); it != freq_dictionary.end();) {
+      auto& entries = it->second;
+      auto removed = std::remove_if(entries.begin(), entries.end(), is_swept);
+      if (removed == entries.end()) {
+        ++it;
+        continue;
+      }
+      entries.erase(removed, entries.end());
+      touched_terms.emplace_back(it->first);
+      it = entries.empty() ? freq_dictionary.erase(it) : std::next(it);
+    }
+  }
+  for (size_t i = 0; i < batch.size(); ++i) {
+    size_t doc_id = batch[i].doc_id;
+    for (const auto& [word, count] : old_counts[i]) {
+      auto it = MaterializeTerm(word);
+      if (it == freq_dictionary.end()) {
+        continue;
+      }
+      auto& entries = it->second;
+      auto entry = std::lower_bound(entries.begin(), entries.end(), doc_id, by_doc_id);
+      if (entry != entries.end() && entry->doc_id == doc_id) {
+        entries.erase(entry);
+      }
+      if (entries.empty()) {
+        freq_dictionary.erase(it);
+      }
+      touched_terms.push_back(word);
+    }
+    for (const auto& [word, count] : new_counts[i]) {
+      auto it = MaterializeTerm(word);
+      if (it == freq_dictionary.end()) {
+        it = freq_dictionary.emplace(word, std::vector<Entry>{}).first;
+      }
+      auto& entries = it->second;
+      entries.insert(std::lower_bound(entries.begin(), entries.end(), doc_id, by_doc_id), Entry{ doc_id, count });
+      touched_terms.push_back(word);
+    }
+
+    std::string& text = updated_docs[doc_id] = std::move(batch[i].text);
+    if (doc_id == doc_texts.size()) {
+      doc_texts.push_back(text);
+      canonical_ids.push_back(doc_id);
+    } else {
+      doc_texts[doc_id] = text;
+    }
+    if (store_offsets) {
+      term_offsets.resize(doc_texts.size());
+      term_offsets[doc_id] = std::move(new_offsets[i]);
+    }
+    if (batch[i].metadata) {
+      ApplyMetadata(doc_id, *batch[i].metadata);
+    }
+  }
+
+  std::sort(touched_terms.begin(), touched_terms.end());
+  touched_terms.erase(std::unique(touched_terms.begin(), touched_terms.end()), touched_terms.end());
+  for (const auto& term : touched_terms) {
+    RefreshImpactPostings(term);
+  }
+  RefreshReplicas(touched_terms);
+}
+
+size_t InvertedIndex::DocumentCount() const {
+  std::shared_lock<std::shared_mutex> lock(index_mutex);
+  return doc_texts.size();
+}
+
+std::shared_lock<std::shared_mutex> InvertedIndex::LockForReading() const {
+  return std::shared_lock<std::shared_mutex>(index_mutex);
+}
+
+/**
+ * @brief Counts the terms of a document with the normalization and analysis of IndexDocuments.
+ * @param text Document contents.
+ * @return Term -> number of occurrences.
+ */
+std::unordered_map<std::string, size_t> InvertedIndex::CountTerms(std::string_view text,
+                                                                  std::vector<TermOffset>* offsets) const {
+  std::string normalized(std::max<size_t>(text.size(), 1), '\0');
+  normalized.resize(TextNormalizer::NormalizeInto(text, normalized.data()));
+  std::string_view remaining = normalized;
+  std::unordered_map<std::string, size_t> counts;
+  size_t original_word = 0;
+  while (!remaining.empty()) {
+    size_t word_end = std::min(remaining.find(' '), remaining.size());
+    std::string_view term = analyzer.Analyze(remaining.substr(0, word_end));
+    if (!term.empty()) {
+      ++counts[std::string(term)];
+      if (offsets != nullptr && original_word <= kMaxTermOffset) {
+        offsets->push_back({ TermKey(term), static_cast<uint32_t>(original_word) });
+      }
+    }
+    if (offsets != nullptr) {
+      original_word = NextWord(text, original_word);
+    }
+    remaining.remove_prefix(std::min(word_end + 1, remaining.size()));
+  }
+  if (offsets != nullptr) {
+    std::sort(offsets->begin(), offsets->end());
+  }
+  return counts;
+}
+
+/**
+ * @brief Rebuilds the index over doc_texts.
+ * Processes documents in parallel to improve performance. With a memory limit set,
+ * the budget is checked after every document: the round stops at the document that fills
+ * it and the partial index is spilled to a sorted run on disk. The runs are k-way merged
+ * into a postings file at the end, and postings are served from its mapping, so the limit
+ * bounds the postings held in memory both while building and afterwards.
+ */
+void InvertedIndex::BuildIndex() {
   freq_dictionary.clear();
+  disk_dictionary.clear();
+  postings_file.reset();
+  spilled_runs = 0;
+  aliases.clear();
+  dedup_stats = {};
+  canonical_ids.resize(doc_texts.size());
+  std::iota(canonical_ids.begin(), canonical_ids.end(), 0);
+  if (deduplicate) {
+    fingerprints.assign(doc_texts.size(), {});
+  }
+  term_offsets.clear();
+  if (store_offsets) {
+    term_offsets.resize(doc_texts.size());
+  }
 
   size_t num_threads = std::thread::hardware_concurrency();
   if (num_threads == 0) num_threads = 2; // Fallback if hardware_concurrency() can't be determine the number
 
-  std::vector<std::future<std::unordered_map<std::string, std::vector<Entry>>>> futures;
-  futures.reserve(num_threads);
+  size_t total_docs = doc_texts.size();
 
-  size_t total_docs = docs.size();
-  size_t docs_per_thread = (total_docs + num_threads - 1) / num_threads;
+  SpillRuns runs;
+  Deduplicator deduplicator(duplicate_distance);
+  FrequencyDictionary combined_freq_dictionary; // Temporary structure to store combined results
+  size_t combined_bytes = 0; // Running estimate of the memory held by combined_freq_dictionary
 
-  // Divide documents into blocks and process each block in a separate thread
-  for (size_t i = 0; i < num_threads; ++i) {
-    size_t start_doc = i * docs_per_thread;
-    if (start_doc >= total_docs) break;
-    size_t end_doc = std::min(start_doc + docs_per_thread, total_docs);
+  // Without a budget all documents are indexed in a single round; with one, a round ends
+  // at the document that fills the budget and the partial index is spilled after it
+  for (size_t round_start = 0; round_start < total_docs;) {
+    std::atomic<size_t> next_doc{round_start};
+    std::atomic<size_t> round_bytes{0};
+    size_t byte_budget = 0;
+    if (memory_limit != 0) {
+      byte_budget = std::max<size_t>(memory_limit - std::min(combined_bytes, memory_limit), 1);
+    }
 
-    futures.emplace_back(std::async(std::launch::async, [this, start_doc, end_doc]() {
-        std::unordered_map<std::string, std::vector<Entry>> local_freq_dict;
+    std::vector<std::future<PartialIndex>> futures;
+    futures.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+      futures.emplace_back(std::async(std::launch::async, [this, &next_doc, &round_bytes, total_docs, byte_budget,
+                                                           worker = i]() {
+          // Partial indexes are first touched by a thread on each node in turn
+          if (numa != nullptr && numa->NodeCount() > 1) {
+            numa->PinWorker(worker);
+          }
+          return IndexDocuments(next_doc, total_docs, round_bytes, byte_budget);
+      }));
+    }
+    std::vector<PartialIndex> partials;
+    partials.reserve(futures.size());
+    for (auto& future : futures) {
+      try {
+        partials.push_back(future.get());
+      } catch (const std::exception& e) {
+        std::cerr << "Error updating document base: " << e.what() << std::endl;
+      }
+    }
+    // Every document below the counter was taken by a thread that finished it
+    size_t round_end = std::min(next_doc.load(), total_docs);
+    bool budget_reached = byte_budget != 0 && round_bytes.load() > byte_budget;
 
-        for (size_t doc_id = start_doc; doc_id < end_doc; ++doc_id) {
-          std::istringstream iss(docs[doc_id]);
-          std::string word;
-          std::unordered_map<std::string, size_t> word_count_in_doc;
+    SE_METRICS_SCOPE(Stage::Merge);
 
-          // Count occurrences of each word in the document
-          while (iss >> word) {
-            word = CleanWord(word);
-            ++word_count_in_doc[word];
-          }
+    // Documents are resolved in order, so each copy maps to the earliest matching document
+    bool has_duplicates = false;
+    if (deduplicate) {
+      for (size_t doc_id = round_start; doc_id < round_end; ++doc_id) {
+        canonical_ids[doc_id] = deduplicator.Add(doc_id, fingerprints[doc_id]);
+        has_duplicates |= canonical_ids[doc_id] != doc_id;
+      }
+    }
 
-          // Populate the local frequency dictionary
-          for (const auto& [word, count] : word_count_in_doc) {
-            local_freq_dict[word].push_back({ doc_id, count });
+    // Threads took interleaved documents, so the postings of each thread are merged by doc_id
+    for (auto& partial : partials) {
+      for (auto& [word, entries] : partial.dictionary) {
+        if (has_duplicates) {
+          dedup_stats.postings_saved += std::erase_if(entries, [this](const Entry& entry) {
+            return canonical_ids[entry.doc_id] != entry.doc_id;
+          });
+          if (entries.empty()) {
+            continue;
           }
         }
+        auto it = combined_freq_dictionary.find(std::string_view(word));
+        if (it == combined_freq_dictionary.end()) {
+          it = combined_freq_dictionary.emplace(std::string(word), std::vector<Entry>{}).first;
+          combined_bytes += NodeBytes(it->first);
+        }
+        combined_bytes += entries.size() * sizeof(Entry);
+        std::vector<Entry>& postings = it->second;
+        size_t sorted_size = postings.size();
+        postings.insert(postings.end(), entries.begin(), entries.end());
+        if (sorted_size > 0 && postings[sorted_size].doc_id < postings[sorted_size - 1].doc_id) {
+          std::inplace_merge(postings.begin(), postings.begin() + sorted_size, postings.end(), ByDocId);
+        }
+      }
+    }
+    partials.clear();
+
+    // Flush the partial index once it no longer fits into the budget
+    if (memory_limit != 0 && (budget_reached || combined_bytes > memory_limit)) {
+      runs.Write(combined_freq_dictionary);
+      combined_freq_dictionary.clear();
+      combined_bytes = 0;
+    }
+    round_start = round_end;
+  }
+
+  if (deduplicate) {
+    DeduplicationStats found = deduplicator.GetStats();
+    dedup_stats.exact_duplicates = found.exact_duplicates;
+    dedup_stats.near_duplicates = found.near_duplicates;
+    for (size_t doc_id = 0; doc_id < canonical_ids.size(); ++doc_id) {
+      if (canonical_ids[doc_id] != doc_id) {
+        aliases[canonical_ids[doc_id]].push_back(doc_id);
+      }
+    }
+    fingerprints.clear();
+    fingerprints.shrink_to_fit();
+  }
+
+  // Update the main frequency dictionary
+  if (runs.Empty()) {
+    freq_dictionary = std::move(combined_freq_dictionary);
+  } else {
+    if (!combined_freq_dictionary.empty()) {
+      runs.Write(combined_freq_dictionary);
+      combined_freq_dictionary.clear();
+    }
+    spilled_runs = runs.Size();
+    std::filesystem::path path;
+    std::vector<MergedTerm> merged = runs.Merge(path);
+    size_t entry_count = merged.empty() ? 0 : merged.back().offset + merged.back().count;
+    // The mapping outlives the file, which is removed with the runs
+    postings_file = std::make_shared<const PostingsFile>(path, entry_count);
+    disk_dictionary.reserve(merged.size());
+    for (auto& term : merged) {
+      disk_dictionary.emplace(std::move(term.word), std::span<const Entry>(postings_file->data + term.offset, term.count));
+    }
+  }
+
+  BuildImpactPostings();
+  PlaceOnNodes();
+}
 
-        return local_freq_dict;
+/**
+ * @brief Builds the impact-ordered postings of the frequent terms.
+ */
+void InvertedIndex::BuildImpactPostings() {
+  impact_dictionary.clear();
+  if (impact_ordering.min_document_frequency == 0) {
+    return;
+  }
+
+  SE_METRICS_SCOPE(Stage::Merge);
+  for (const auto& [word, entries] : freq_dictionary) {
+    if (entries.size() >= impact_ordering.min_document_frequency) {
+      impact_dictionary.emplace(word, ImpactList(entries, impact_ordering.top_k));
+    }
+  }
+  for (const auto& [word, entries] : disk_dictionary) {
+    if (entries.size() >= impact_ordering.min_document_frequency) {
+      impact_dictionary.emplace(word, ImpactList(entries, impact_ordering.top_k));
+    }
+  }
+}
+
+void InvertedIndex::RefreshImpactPostings(const std::string& term) {
+  if (impact_ordering.min_document_frequency == 0) {
+    return;
+  }
+  std::span<const Entry> postings = Postings(term);
+  if (postings.size() < impact_ordering.min_document_frequency) {
+    impact_dictionary.erase(term);
+    return;
+  }
+  impact_dictionary.insert_or_assign(term, ImpactList(postings, impact_ordering.top_k));
+}
+
+/**
+ * @brief Copies the dictionaries to the memory of every NUMA node.
+ * Each copy is made by a thread pinned to its node, so its pages are first touched there.
+ * The copy for node 0 replaces the dictionaries built by threads spread over all nodes.
+ * Postings served from disk are shared by all nodes through the page cache.
+ */
+void InvertedIndex::PlaceOnNodes() {
+  replicas.clear();
+  if (numa == nullptr || numa->NodeCount() < 2) {
+    return;
+  }
+
+  SE_METRICS_SCOPE(Stage::Merge);
+  std::vector<std::unique_ptr<NodeReplica>> copies(numa->NodeCount());
+  std::vector<std::future<void>> placing;
+  for (size_t node = 0; node < copies.size(); ++node) {
+    placing.push_back(std::async(std::launch::async, [this, &copies, node]() {
+      numa->RunOnNode(node, [this, &copies, node]() {
+        copies[node] = std::make_unique<NodeReplica>(NodeReplica{ freq_dictionary, impact_dictionary });
+      });
     }));
   }
+  for (auto& copy : placing) {
+    copy.get();
+  }
 
-  // Temporary structure to store combined results
-  std::unordered_map<std::string, std::vector<Entry>> combined_freq_dictionary;
+  freq_dictionary = std::move(copies.front()->dictionary);
+  impact_dictionary = std::move(copies.front()->impact);
+  replicas.assign(std::make_move_iterator(copies.begin() + 1), std::make_move_iterator(copies.end()));
+}
 
-  // Merge results from all threads
-  for (auto& future : futures) {
-    try {
-      auto local_freq_dict = future.get();
-      for (const auto& [word, entries] : local_freq_dict) {
-        combined_freq_dictionary[word].insert(
-          combined_freq_dictionary[word].end(),
-          std::make_move_iterator(entries.begin()),
-          std::make_move_iterator(entries.end())
-        );
+void InvertedIndex::RefreshReplicas(const std::vector<std::string>& terms) {
+  for (size_t i = 0; i < replicas.size(); ++i) {
+    NodeReplica& replica = *replicas[i];
+    numa->RunOnNode(i + 1, [this, &replica, &terms]() {
+      for (const auto& term : terms) {
+        auto postings = freq_dictionary.find(std::string_view(term));
+        if (postings == freq_dictionary.end()) {
+          replica.dictionary.erase(term);
+        } else {
+          replica.dictionary.insert_or_assign(term, postings->second);
+        }
+        auto impact = impact_dictionary.find(std::string_view(term));
+        if (impact == impact_dictionary.end()) {
+          replica.impact.erase(term);
+        } else {
+          replica.impact.insert_or_assign(term, impact->second);
+        }
       }
-    } catch (const std::exception& e) {
-      std::cerr << "Error updating document base: " << e.what() << std::endl;
+    });
+  }
+}
+
+size_t InvertedIndex::LocalNode() const {
+  return replicas.empty() ? 0 : numa->CurrentNode() % (replicas.size() + 1);
+}
+
+void InvertedIndex::SetNumaTopology(const NumaTopology* topology) {
+  numa = topology;
+}
+
+const NumaTopology* InvertedIndex::GetNumaTopology() const {
+  return numa;
+}
+
+void InvertedIndex::SetMemoryLimit(size_t bytes) {
+  memory_limit = bytes;
+}
+
+void InvertedIndex::SetDocumentMetadata(const std::vector<DocumentMetadata>& metadata) {
+  metadata_index.clear();
+  for (size_t doc_id = 0; doc_id < metadata.size(); ++doc_id) {
+    for (const auto& [field, value] : metadata[doc_id]) {
+      metadata_index[field][value].Add(doc_id);
     }
   }
+}
 
-  // Update the main frequency dictionary
-  freq_dictionary = std::move(combined_freq_dictionary);
+void InvertedIndex::ApplyMetadata(size_t doc_id, const DocumentMetadata& metadata) {
+  for (auto field = metadata_index.begin(); field != metadata_index.end();) {
+    auto& values = field->second;
+    for (auto value = values.begin(); value != values.end();) {
+      value->second.Remove(doc_id);
+      value = value->second.Empty() ? values.erase(value) : std::next(value);
+    }
+    field = values.empty() ? metadata_index.erase(field) : std::next(field);
+  }
+  for (const auto& [field, value] : metadata) {
+    metadata_index[field][value].Add(doc_id);
+  }
 }
 
+/**
+ * @brief Evaluates a filter on the metadata bitmaps.
+ * Values accepted by a clause are united, and the clauses are intersected.
+ * Postings only hold canonical documents, so a duplicate that matches brings in its canonical document.
+ * @param filter A non-empty filter.
+ * @return IDs of the matching documents, with the canonical documents of matching duplicates.
+ */
+DocumentBitmap InvertedIndex::MatchDocuments(const DocumentFilter& filter) const {
+  std::shared_lock<std::shared_mutex> lock(index_mutex); // UpdateDocuments may change the metadata
+  DocumentBitmap matches;
+  bool first_clause = true;
+  for (const auto& clause : filter.Clauses()) {
+    DocumentBitmap clause_matches;
+    auto field = metadata_index.find(clause.field);
+    if (field != metadata_index.end()) {
+      const auto& values = field->second;
+      if (clause.is_range) {
+        auto it = clause.low.empty() ? values.begin() : values.lower_bound(clause.low);
+        for (; it != values.end() && (clause.high.empty() || it->first <= clause.high); ++it) {
+          clause_matches.UnionWith(it->second);
+        }
+      } else {
+        for (const auto& value : clause.values) {
+          auto it = values.find(value);
+          if (it != values.end()) {
+            clause_matches.UnionWith(it->second);
+          }
+        }
+      }
+    }
+
+    if (first_clause) {
+      matches = std::move(clause_matches);
+      first_clause = false;
+    } else {
+      matches.IntersectWith(clause_matches);
+    }
+    if (matches.Empty()) {
+      break;
+    }
+  }
+  for (const auto& [canonical_id, duplicates] : aliases) {
+    if (!matches.Contains(canonical_id) && std::any_of(duplicates.begin(), duplicates.end(), [&matches](size_t doc_id) {
+          return matches.Contains(doc_id);
+        })) {
+      matches.Add(canonical_id);
+    }
+  }
+  return matches;
+}
+
+void InvertedIndex::SetImpactOrdering(ImpactOrdering ordering) {
+  impact_ordering = ordering;
+}
+
+ImpactOrdering InvertedIndex::GetImpactOrdering() const {
+  return impact_ordering;
+}
+
+void InvertedIndex::SetDeduplication(bool enabled, unsigned max_distance) {
+  deduplicate = enabled;
+  duplicate_distance = max_distance;
+}
+
+size_t InvertedIndex::GetCanonicalId(size_t doc_id) const {
+  return doc_id < canonical_ids.size() ? canonical_ids[doc_id] : doc_id;
+}
+
+std::vector<size_t> InvertedIndex::GetAliases(size_t doc_id) const {
+  auto it = aliases.find(doc_id);
+  return it != aliases.end() ? it->second : std::vector<size_t>{};
+}
+
+DeduplicationStats InvertedIndex::GetDeduplicationStats() const {
+  return dedup_stats;
+}
+
+size_t InvertedIndex::GetSpilledRunCount() const {
+  return spilled_runs;
+}
+
+/**
+ * @brief Computes the memory currently used by the index.
+ * Node sizes follow the libstdc++ layout of std::unordered_map (next pointer,
+ * value and cached hash); heap storage is counted by capacity, not size.
+ * Mapped documents are counted by file size; postings served from disk only by the
+ * entries still referenced, as terms changed since the build were copied to memory.
+ * @return Bytes used by the term dictionary, the postings, the stored documents and the impact-ordered postings.
+ */
+IndexMemoryUsage InvertedIndex::GetMemoryUsage() const {
+  IndexMemoryUsage usage;
+
+  usage.dictionary_bytes = freq_dictionary.bucket_count() * sizeof(void*);
+  for (const auto& [word, entries] : freq_dictionary) {
+    usage.dictionary_bytes += NodeBytes(word);
+    usage.postings_bytes += entries.capacity() * sizeof(Entry);
+  }
+  if (!disk_dictionary.empty()) {
+    usage.dictionary_bytes += disk_dictionary.bucket_count() * sizeof(void*);
+    for (const auto& [word, entries] : disk_dictionary) {
+      usage.dictionary_bytes += NodeBytes<std::span<const Entry>>(word);
+      usage.disk_postings_bytes += entries.size_bytes();
+    }
+  }
+
+  if (!impact_dictionary.empty()) {
+    usage.impact_bytes = impact_dictionary.bucket_count() * sizeof(void*);
+    for (const auto& [word, entries] : impact_dictionary) {
+      usage.impact_bytes += NodeBytes(word) + entries.capacity() * sizeof(Entry);
+    }
+  }
+
+  for (const auto& [field, values] : metadata_index) {
+    for (const auto& [value, documents] : values) {
+      usage.metadata_bytes += value.capacity() + documents.SizeInBytes();
+    }
+  }
+
+  usage.documents_bytes = docs.capacity() * sizeof(std::string) + doc_texts.capacity() * sizeof(std::string_view);
+  for (const auto& doc : docs) {
+    usage.documents_bytes += StringHeapBytes(doc);
+  }
+  for (const auto& [doc_id, doc] : updated_docs) {
+    usage.documents_bytes += sizeof(void*) + sizeof(std::pair<const size_t, std::string>) + StringHeapBytes(doc);
+  }
+  if (mapped_docs) {
+    usage.documents_bytes += mapped_docs->TotalBytes();
+  }
+
+  for (const auto& replica : replicas) {
+    for (const auto* dictionary : { &replica->dictionary, &replica->impact }) {
+      usage.replica_bytes += dictionary->bucket_count() * sizeof(void*);
+      for (const auto& [word, entries] : *dictionary) {
+        usage.replica_bytes += NodeBytes(word) + entries.capacity() * sizeof(Entry);
+      }
+    }
+  }
+
+  usage.offsets_bytes = term_offsets.capacity() * sizeof(std::vector<TermOffset>);
+  for (const auto& offsets : term_offsets) {
+    usage.offsets_bytes += offsets.capacity() * sizeof(TermOffset);
+  }
+
+  return usage;
+}
 
 /**
  * @brief Retrieves the frequency of a word across all documents.
@@ -97,13 +1100,118 @@ void InvertedIndex::UpdateDocumentBase(const std::vector<std::string>& input_doc
  * @return A vector of Entry objects containing document IDs and counts.
  */
 std::vector<Entry> InvertedIndex::GetWordCount(const std::string& word) {
-  std::string clean_word = CleanWord(word);
-  auto it = freq_dictionary.find(clean_word);
+  std::span<const Entry> entries = FindTerm(AnalyzeWord(word));
+  return std::vector<Entry>(entries.begin(), entries.end());
+}
+
+void InvertedIndex::SetAnalyzer(TextAnalyzer text_analyzer) {
+  analyzer = std::move(text_analyzer);
+}
+
+std::string InvertedIndex::AnalyzeWord(const std::string& word) const {
+  return std::string(analyzer.Analyze(CleanWord(word)));
+}
+
+std::string_view InvertedIndex::AnalyzeTerm(std::string_view normalized_word) const {
+  return analyzer.Analyze(normalized_word);
+}
+
+std::span<const Entry> InvertedIndex::FindTerm(std::string_view term) const {
+  if (term.empty()) {
+    return {};
+  }
+  size_t node = LocalNode();
+  if (node == 0) {
+    return Postings(term);
+  }
+  const FrequencyDictionary& dictionary = replicas[node - 1]->dictionary;
+  auto it = dictionary.find(term);
+  if (it != dictionary.end()) {
+    return it->second;
+  }
+  auto on_disk = disk_dictionary.find(term);
+  return on_disk != disk_dictionary.end() ? on_disk->second : std::span<const Entry>();
+}
+
+std::span<const Entry> InvertedIndex::FindImpactOrdered(std::string_view term) const {
+  if (term.empty() || impact_dictionary.empty()) {
+    return {};
+  }
+  size_t node = LocalNode();
+  const FrequencyDictionary& dictionary = node == 0 ? impact_dictionary : replicas[node - 1]->impact;
+  auto it = dictionary.find(term);
+  return it != dictionary.end() ? std::span<const Entry>(it->second) : std::span<const Entry>();
+}
+
+std::span<const Entry> InvertedIndex::Postings(std::string_view term) const {
+  auto it = freq_dictionary.find(term);
   if (it != freq_dictionary.end()) {
     return it->second;
   }
-  return {};
+  auto on_disk = disk_dictionary.find(term);
+  return on_disk != disk_dictionary.end() ? on_disk->second : std::span<const Entry>();
+}
+
+InvertedIndex::FrequencyDictionary::iterator InvertedIndex::MaterializeTerm(std::string_view term) {
+  auto it = freq_dictionary.find(term);
+  if (it != freq_dictionary.end()) {
+    return it;
+  }
+  auto on_disk = disk_dictionary.find(term);
+  if (on_disk == disk_dictionary.end()) {
+    return it;
+  }
+  it = freq_dictionary.emplace(on_disk->first, std::vector<Entry>(on_disk->second.begin(), on_disk->second.end())).first;
+  disk_dictionary.erase(on_disk);
+  return it;
+}
+
+void InvertedIndex::SetTermOffsets(bool enabled) {
+  store_offsets = enabled;
 }
 
+bool InvertedIndex::HasTermOffsets() const {
+  return store_offsets;
+}
 
+/**
+ * @brief Finds the occurrences of a term in a document through its stored offsets.
+ * Candidates come from a binary search on the term key; each candidate word is analyzed
+ * again, which rules out hash collisions and only touches the words that are returned.
+ * @param doc_id A document ID.
+ * @param term An analyzed term.
+ * @return Occurrences in document order; empty if offsets are not stored.
+ */
+std::vector<TermSpan> InvertedIndex::FindOccurrences(size_t doc_id, std::string_view term) const {
+  std::vector<TermSpan> spans;
+  if (term.empty() || doc_id >= term_offsets.size()) {
+    return spans;
+  }
+  const auto& offsets = term_offsets[doc_id];
+  uint32_t key = TermKey(term);
+  auto first = std::lower_bound(offsets.begin(), offsets.end(), TermOffset{ key, 0 });
+  std::string_view text = doc_texts[doc_id];
+  auto is_punctuation = [](char c) {
+    return static_cast<unsigned char>(c) < 0x80 && !std::isalnum(static_cast<unsigned char>(c));
+  };
+  for (auto it = first; it != offsets.end() && it->term_key == key; ++it) {
+    size_t begin = it->offset;
+    size_t end = WordEnd(text, begin);
+    std::string word = TextNormalizer::Normalize(text.substr(begin, end - begin));
+    if (analyzer.Analyze(word) != term) {
+      continue;
+    }
+    while (begin < end && is_punctuation(text[begin])) {
+      ++begin;
+    }
+    while (end > begin && is_punctuation(text[end - 1])) {
+      --end;
+    }
+    spans.push_back({ begin, end - begin });
+  }
+  return spans;
+}
 
+std::string_view InvertedIndex::GetDocumentText(size_t doc_id) const {
+  return doc_id < doc_texts.size() ? doc_texts[doc_id] : std::string_view();
+}
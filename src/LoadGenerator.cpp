@@ -0,0 +1,276 @@
+#include "LoadGenerator.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+
+namespace {
+
+// A run that completes less than this share of its arrival rate has fallen behind
+constexpr double kSustainedRatio = 0.95;
+
+bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+void SkipSpaces(std::string_view text, size_t& pos) {
+  while (pos < text.size() && IsSpace(text[pos])) {
+    ++pos;
+  }
+}
+
+void AppendUtf8(std::string& out, uint32_t code_point) {
+  if (code_point < 0x80) {
+    out += static_cast<char>(code_point);
+  } else if (code_point < 0x800) {
+    out += static_cast<char>(0xC0 | (code_point >> 6));
+    out += static_cast<char>(0x80 | (code_point & 0x3F));
+  } else if (code_point < 0x10000) {
+    out += static_cast<char>(0xE0 | (code_point >> 12));
+    out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (code_point & 0x3F));
+  } else {
+    out += static_cast<char>(0xF0 | (code_point >> 18));
+    out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (code_point & 0x3F));
+  }
+}
+
+uint32_t ParseHex4(std::string_view text, size_t pos) {
+  if (pos + 4 > text.size()) {
+    throw std::runtime_error("Truncated \\u escape in query log.");
+  }
+  uint32_t value = 0;
+  for (size_t i = pos; i < pos + 4; ++i) {
+    char c = text[i];
+    value <<= 4;
+    if (c >= '0' && c <= '9') value |= static_cast<uint32_t>(c - '0');
+    else if (c >= 'a' && c <= 'f') value |= static_cast<uint32_t>(c - 'a' + 10);
+    else if (c >= 'A' && c <= 'F') value |= static_cast<uint32_t>(c - 'A' + 10);
+    else throw std::runtime_error("Invalid \\u escape in query log.");
+  }
+  return value;
+}
+
+/**
+ * @brief Parses the JSON string literal starting at pos and moves pos past it.
+ */
+std::string ParseString(std::string_view text, size_t& pos) {
+  if (pos >= text.size() || text[pos] != '"') {
+    throw std::runtime_error("Expected a JSON string in query log.");
+  }
+  std::string out;
+  for (++pos; pos < text.size(); ++pos) {
+    char c = text[pos];
+    if (c == '"') {
+      ++pos;
+      return out;
+    }
+    if (c != '\\') {
+      out += c;
+      continue;
+    }
+    if (++pos >= text.size()) {
+      break;
+    }
+    switch (text[pos]) {
+      case 'b': out += '\b'; break;
+      case 'f': out += '\f'; break;
+      case 'n': out += '\n'; break;
+      case 'r': out += '\r'; break;
+      case 't': out += '\t'; break;
+      case 'u': {
+        uint32_t code_point = ParseHex4(text, pos + 1);
+        pos += 4;
+        // A high surrogate is followed by the low half of the pair
+        if (code_point >= 0xD800 && code_point < 0xDC00 && text.substr(pos + 1, 2) == "\\u") {
+          uint32_t low = ParseHex4(text, pos + 3);
+          if (low >= 0xDC00 && low < 0xE000) {
+            code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+            pos += 6;
+          }
+        }
+        AppendUtf8(out, code_point);
+        break;
+      }
+      default: out += text[pos]; break; // \" \\ and \/
+    }
+  }
+  throw std::runtime_error("Unterminated JSON string in query log.");
+}
+
+/**
+ * @brief Reads the array of a requests.json document.
+ */
+bool ReadRequestsArray(std::string_view text, std::vector<std::string>& queries) {
+  size_t key = text.find("\"requests\"");
+  if (key == std::string_view::npos) {
+    return false;
+  }
+  size_t pos = key + 10;
+  SkipSpaces(text, pos);
+  if (pos >= text.size() || text[pos] != ':') {
+    return false;
+  }
+  ++pos;
+  SkipSpaces(text, pos);
+  if (pos >= text.size() || text[pos] != '[') {
+    return false;
+  }
+  ++pos;
+  while (true) {
+    SkipSpaces(text, pos);
+    if (pos < text.size() && text[pos] == ']') {
+      return true;
+    }
+    queries.push_back(ParseString(text, pos));
+    SkipSpaces(text, pos);
+    if (pos < text.size() && text[pos] == ',') {
+      ++pos;
+    }
+    if (pos >= text.size()) {
+      throw std::runtime_error("Unterminated requests array in query log.");
+    }
+  }
+}
+
+} // namespace
+
+bool LoadReport::Saturated() const {
+  return achieved_qps < target_qps * kSustainedRatio;
+}
+
+LoadGenerator::LoadGenerator(std::vector<std::string> queries, Target target, size_t concurrency)
+  : _queries(std::move(queries)), _target(std::move(target)), _concurrency(concurrency) {
+  if (_queries.empty()) {
+    throw std::invalid_argument("Query log is empty.");
+  }
+  if (_concurrency == 0) {
+    throw std::invalid_argument("Load generator needs at least one worker.");
+  }
+}
+
+/**
+ * @brief Issues target_qps * duration queries on a fixed schedule.
+ * Workers take the next query from a shared counter and sleep until it is due; when
+ * all of them are busy, the query starts late and the delay is part of its latency.
+ * @param target_qps Arrival rate.
+ * @param duration Time during which queries are issued.
+ * @return Throughput and latency distributions of the run.
+ */
+LoadReport LoadGenerator::Run(double target_qps, std::chrono::milliseconds duration) const {
+  if (!(target_qps > 0.0)) {
+    throw std::invalid_argument("Target QPS must be positive.");
+  }
+  auto total = static_cast<uint64_t>(std::llround(target_qps * std::chrono::duration<double>(duration).count()));
+  total = std::max<uint64_t>(total, 1);
+  double interval_ns = 1e9 / target_qps;
+
+  size_t worker_count = static_cast<size_t>(std::min<uint64_t>(_concurrency, total));
+  std::vector<LatencyHistogram> latencies(worker_count);
+  std::vector<LatencyHistogram> services(worker_count);
+  std::atomic<uint64_t> next_query{0};
+  std::atomic<uint64_t> errors{0};
+  auto start = std::chrono::steady_clock::now();
+
+  auto worker = [&](size_t worker_id) {
+    for (uint64_t i = next_query.fetch_add(1); i < total; i = next_query.fetch_add(1)) {
+      auto intended = start + std::chrono::nanoseconds(std::llround(static_cast<double>(i) * interval_ns));
+      std::this_thread::sleep_until(intended);
+      auto actual = std::chrono::steady_clock::now();
+      try {
+        _target(_queries[i % _queries.size()]);
+      } catch (const std::exception&) {
+        errors.fetch_add(1, std::memory_order_relaxed);
+      }
+      auto finished = std::chrono::steady_clock::now();
+      latencies[worker_id].Record(static_cast<uint64_t>(std::chrono::nanoseconds(finished - intended).count()));
+      services[worker_id].Record(static_cast<uint64_t>(std::chrono::nanoseconds(finished - actual).count()));
+    }
+  };
+
+  std::vector<std::thread> workers;
+  workers.reserve(worker_count);
+  for (size_t i = 0; i < worker_count; ++i) {
+    workers.emplace_back(worker, i);
+  }
+  for (auto& thread : workers) {
+    thread.join();
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  LoadReport report;
+  report.target_qps = target_qps;
+  report.completed = total;
+  report.errors = errors;
+  report.achieved_qps = elapsed > 0.0 ? static_cast<double>(total) / elapsed : 0.0;
+  for (size_t i = 0; i < worker_count; ++i) {
+    report.latency.Merge(latencies[i]);
+    report.service.Merge(services[i]);
+  }
+  return report;
+}
+
+std::vector<LoadReport> LoadGenerator::Sweep(double start_qps, double growth, double max_qps,
+                                             std::chrono::milliseconds duration) const {
+  if (!(growth > 1.0)) {
+    throw std::invalid_argument("Sweep growth factor must be above 1.");
+  }
+  std::vector<LoadReport> reports;
+  for (double qps = start_qps;; qps = std::min(qps * growth, max_qps)) {
+    reports.push_back(Run(qps, duration));
+    if (reports.back().Saturated() || qps >= max_qps) {
+      return reports;
+    }
+  }
+}
+
+std::vector<std::string> LoadGenerator::ReadQueryLog(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Cannot open query log: " + path);
+  }
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  std::string content = buffer.str();
+
+  std::vector<std::string> queries;
+  if (ReadRequestsArray(content, queries)) {
+    return queries;
+  }
+
+  std::istringstream lines(content);
+  for (std::string line; std::getline(lines, line);) {
+    size_t pos = 0;
+    SkipSpaces(line, pos);
+    if (pos == line.size()) {
+      continue;
+    }
+    if (line[pos] == '"') {
+      queries.push_back(ParseString(line, pos));
+    } else if (line[pos] == '{') {
+      size_t key = line.find("\"query\"", pos);
+      if (key == std::string::npos) {
+        throw std::runtime_error("Query log line has no \"query\" field: " + line);
+      }
+      pos = key + 7;
+      SkipSpaces(line, pos);
+      if (pos < line.size() && line[pos] == ':') {
+        ++pos;
+      }
+      SkipSpaces(line, pos);
+      queries.push_back(ParseString(line, pos));
+    } else {
+      if (line.back() == '\r') {
+        line.pop_back();
+      }
+      queries.push_back(line.substr(pos));
+    }
+  }
+  return queries;
+}
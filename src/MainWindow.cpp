@@ -1,9 +1,122 @@
 #include "MainWindow.h"
+#include "ConverterJSON.h"
+#include "InvertedIndex.h"
+#include "SearchServer.h"
 #include <QFileDialog>
+#include <QFontDatabase>
 #include <QMessageBox>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QPromise>
+#include <QtConcurrent/QtConcurrent>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+
+namespace {
+
+/**
+ * @brief Formats the results of one request as a display row.
+ */
+QString formatResult(size_t request_number, const QString &request, const std::vector<RelativeIndex> &results) {
+    QString row = QString("request%1 \"%2\": ").arg(request_number, 3, 10, QChar('0')).arg(request);
+    if (results.empty()) {
+        return row + "no results";
+    }
+    QStringList hits;
+    for (const auto &rel : results) {
+        hits << QString("doc %1 (rank %2)").arg(rel.doc_id).arg(rel.rank, 0, 'g', 4);
+    }
+    return row + hits.join(", ");
+}
+
+/**
+ * @brief Background job: builds the index, answers every request and writes answers.json.
+ * All requests run as one batch, so they share the server's workers and the filter is
+ * evaluated once. Each answered request is published as soon as it is ready; once
+ * cancellation is requested, the requests not started yet are skipped.
+ */
+void runSearch(QPromise<QString> &promise) {
+    try {
+        ConverterJSON converter;
+
+        promise.setProgressRange(0, 0);
+        promise.setProgressValueAndText(0, "Loading documents...");
+        auto documents = converter.LoadTextDocuments();
+        auto requests = converter.GetRequests();
+        DocumentFilter filter = converter.GetRequestFilter();
+        int responses_limit = converter.GetResponsesLimit();
+        if (promise.isCanceled()) {
+            return;
+        }
+
+        promise.setProgressValueAndText(0, "Indexing documents...");
+        InvertedIndex index;
+        index.SetMemoryLimit(converter.GetMemoryLimit());
+        index.SetAnalyzer(converter.GetTextAnalyzer());
+        int dedup_distance = converter.GetDeduplicationDistance();
+        index.SetDeduplication(dedup_distance >= 0, dedup_distance >= 0 ? static_cast<unsigned>(dedup_distance) : 0);
+        index.SetImpactOrdering(converter.GetImpactOrdering());
+        SnippetOptions snippet_options = converter.GetSnippetOptions();
+        index.SetTermOffsets(snippet_options.window_bytes > 0);
+        index.SetDocumentMetadata(converter.GetDocumentMetadata(*documents));
+        if (converter.GetNumaPlacement()) {
+            index.SetNumaTopology(&NumaTopology::System());
+        }
+        index.UpdateMappedDocumentBase(std::move(documents));
+        if (promise.isCanceled()) {
+            return;
+        }
+
+        SearchServer server(index, responses_limit);
+        server.SetCommonTermFrequency(converter.GetCommonTermFrequency());
+        if (snippet_options.window_bytes > 0) {
+            server.SetSnippetOptions(snippet_options);
+        }
+        bool explain = converter.GetExplainQueries();
+        DocumentBitmap explain_filter;
+        if (explain && !filter.Empty()) {
+            explain_filter = index.MatchDocuments(filter);
+        }
+
+        promise.setProgressRange(0, static_cast<int>(requests.size()));
+        std::mutex publishing;
+        size_t answered = 0;
+        auto answers = server.search(requests, filter,
+            [&](size_t i, const std::vector<RelativeIndex> &results) {
+                // Called from the server's workers; rows are stored at the index of their request
+                QString row = formatResult(i + 1, QString::fromStdString(requests[i]), results);
+                std::lock_guard<std::mutex> lock(publishing);
+                promise.addResult(row, static_cast<int>(i));
+                ++answered;
+                promise.setProgressValueAndText(static_cast<int>(answered),
+                    QString("Searching %1/%2").arg(answered).arg(requests.size()));
+                return !promise.isCanceled();
+            });
+        if (promise.isCanceled()) {
+            return;
+        }
+        if (explain) {
+            for (const auto &request : requests) {
+                std::cout << "Query plan for '" << request << "':" << std::endl;
+                server.Explain(request, filter.Empty() ? nullptr : &explain_filter).Write(std::cout);
+            }
+        }
+
+        std::vector<std::vector<Snippet>> snippets;
+        if (snippet_options.window_bytes > 0) {
+            snippets = server.Snippets(requests, answers);
+        }
+        converter.putAnswers(answers, snippets);
+        promise.setProgressValueAndText(static_cast<int>(requests.size()), "Answers written to answers.json");
+    } catch (const std::exception &) {
+        // Rethrown to the GUI thread by QFuture::waitForFinished()
+        promise.setException(std::current_exception());
+    }
+}
+
+} // namespace
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent), centralWidget(new QWidget(this)) {
@@ -11,7 +124,17 @@ MainWindow::MainWindow(QWidget *parent)
     setupAnimations();
 }
 
-MainWindow::~MainWindow() = default;
+MainWindow::~MainWindow() {
+    // The worker only touches its own data, but must not outlive the watcher.
+    searchWatcher.cancel();
+    try {
+        if (!searchWatcher.isFinished()) {
+            searchWatcher.waitForFinished();
+        }
+    } catch (...) {
+        // A failed search rethrows its exception here; there is no one left to report it to
+    }
+}
 
 void MainWindow::setupUI() {
     setWindowTitle("Search Engine GUI");
@@ -25,13 +148,25 @@ void MainWindow::setupUI() {
 
     openFileButton = new QPushButton("Open JSON File", this);
     searchButton = new QPushButton("Search", this);
+    cancelButton = new QPushButton("Cancel", this);
+    cancelButton->setEnabled(false);
 
-    outputViewer = new QTextEdit(this);
-    outputViewer->setReadOnly(true);
+    progressBar = new QProgressBar(this);
+    progressBar->setTextVisible(true);
+    progressBar->setVisible(false);
+
+    resultsModel = new ResultsModel(this);
+    outputViewer = new QListView(this);
+    outputViewer->setModel(resultsModel);
+    outputViewer->setUniformItemSizes(true); // Lets the view skip per-row layout on large documents
+    outputViewer->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    outputViewer->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
 
     layout->addWidget(titleLabel);
     layout->addWidget(openFileButton);
     layout->addWidget(searchButton);
+    layout->addWidget(cancelButton);
+    layout->addWidget(progressBar);
     layout->addWidget(outputViewer);
 
     centralWidget->setLayout(layout);
@@ -39,6 +174,13 @@ void MainWindow::setupUI() {
 
     connect(openFileButton, &QPushButton::clicked, this, &MainWindow::openFile);
     connect(searchButton, &QPushButton::clicked, this, &MainWindow::processSearch);
+    connect(cancelButton, &QPushButton::clicked, this, &MainWindow::cancelSearch);
+
+    connect(&searchWatcher, &QFutureWatcher<QString>::progressRangeChanged, progressBar, &QProgressBar::setRange);
+    connect(&searchWatcher, &QFutureWatcher<QString>::progressValueChanged, progressBar, &QProgressBar::setValue);
+    connect(&searchWatcher, &QFutureWatcher<QString>::progressTextChanged, progressBar, &QProgressBar::setFormat);
+    connect(&searchWatcher, &QFutureWatcher<QString>::resultsReadyAt, this, &MainWindow::appendResults);
+    connect(&searchWatcher, &QFutureWatcher<QString>::finished, this, &MainWindow::searchFinished);
 }
 
 void MainWindow::setupAnimations() {
@@ -50,6 +192,13 @@ void MainWindow::setupAnimations() {
     animation->start();
 }
 
+void MainWindow::setBusy(bool busy) {
+    openFileButton->setEnabled(!busy);
+    searchButton->setEnabled(!busy);
+    cancelButton->setEnabled(busy);
+    progressBar->setVisible(true);
+}
+
 void MainWindow::openFile() {
     QString filePath = QFileDialog::getOpenFileName(this, "Open JSON File", "", "JSON Files (*.json)");
     if (filePath.isEmpty()) {
@@ -71,18 +220,60 @@ void MainWindow::openFile() {
         return;
     }
 
-    outputViewer->setText(jsonDoc.toJson(QJsonDocument::Indented));
+    QString text = QString::fromUtf8(jsonDoc.toJson(QJsonDocument::Indented));
+    resultsModel->setRows(text.split('\n', Qt::SkipEmptyParts));
 }
 
 void MainWindow::processSearch() {
+    if (searchWatcher.isRunning()) {
+        return;
+    }
+
+    resultsModel->clear();
+    shownRows = 0;
+    progressBar->setFormat("Starting...");
+    setBusy(true);
+    searchActive = true;
+    searchWatcher.setFuture(QtConcurrent::run(runSearch));
+}
+
+void MainWindow::cancelSearch() {
+    if (searchWatcher.isRunning()) {
+        progressBar->setFormat("Cancelling...");
+        searchWatcher.cancel();
+    }
+}
+
+void MainWindow::appendResults(int begin, int) {
+    // Queries finish out of order; a row is held back until the rows of all earlier requests are shown
+    if (begin > shownRows) {
+        return;
+    }
+    QStringList rows;
+    QFuture<QString> future = searchWatcher.future();
+    while (future.isResultReadyAt(shownRows)) {
+        rows << future.resultAt(shownRows++);
+    }
+    resultsModel->appendRows(rows);
+}
+
+void MainWindow::searchFinished() {
+    if (!searchActive) {
+        return;
+    }
+    searchActive = false;
+    setBusy(false);
+    if (searchWatcher.isCanceled()) {
+        progressBar->setFormat("Search cancelled");
+        return;
+    }
+
     try {
-        auto requests = jsonConverter.GetRequests();
-        QString output = "Search Requests:\n";
-        for (const auto &req : requests) {
-            output += QString::fromStdString(req) + "\n";
-        }
-        outputViewer->setText(output);
+        searchWatcher.future().waitForFinished();
     } catch (const std::exception &e) {
+        progressBar->setFormat("Search failed");
+        // Drop the failed future so its exception is not rethrown by a later wait
+        searchWatcher.setFuture(QFuture<QString>());
         QMessageBox::warning(this, "Error", e.what());
     }
 }
\ No newline at end of file
@@ -0,0 +1,406 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// Bumped by Metrics::Reset; blocks recorded in an earlier epoch count as empty
+std::atomic<uint64_t> metrics_epoch{0};
+
+// Each thread times one timeline in the low 32 bits of this many; the high 32 bits count
+// SetTimelineSampling calls, so that threads restart their count on a new setting
+std::atomic<uint64_t> timeline_sampling{Metrics::kDefaultTimelineSampling};
+
+/**
+ * @brief Metrics owned by a single thread at a time.
+ */
+struct ThreadMetrics {
+  std::array<LatencyHistogram, static_cast<size_t>(Stage::Count)> stages;
+  std::array<std::atomic<uint64_t>, static_cast<size_t>(Counter::Count)> counters{};
+  std::atomic<uint64_t> epoch{0}; // Epoch the values were recorded in.
+};
+
+/**
+ * @brief Owns every ThreadMetrics block and hands out blocks of finished threads.
+ */
+class MetricsRegistry {
+  public:
+    static MetricsRegistry& Instance() {
+      static MetricsRegistry registry;
+      return registry;
+    }
+
+    ThreadMetrics* Acquire() {
+      std::lock_guard<std::mutex> lock(registry_mutex);
+      if (!free_blocks.empty()) {
+        ThreadMetrics* block = free_blocks.back();
+        free_blocks.pop_back();
+        return block;
+      }
+      blocks.push_back(std::make_unique<ThreadMetrics>());
+      return blocks.back().get();
+    }
+
+    void Release(ThreadMetrics* block) {
+      std::lock_guard<std::mutex> lock(registry_mutex);
+      free_blocks.push_back(block);
+    }
+
+    template <typename Visitor>
+    void ForEach(Visitor&& visitor) {
+      std::lock_guard<std::mutex> lock(registry_mutex);
+      for (auto& block : blocks) {
+        visitor(*block);
+      }
+    }
+
+  private:
+    std::mutex registry_mutex; // Protects the block lists; never taken on the recording path.
+    std::vector<std::unique_ptr<ThreadMetrics>> blocks;
+    std::vector<ThreadMetrics*> free_blocks;
+};
+
+/**
+ * @brief Binds a ThreadMetrics block to the current thread and returns it on exit.
+ */
+struct ThreadMetricsHandle {
+  ThreadMetrics* block = nullptr;
+
+  ThreadMetrics& Get() {
+    if (block == nullptr) {
+      block = MetricsRegistry::Instance().Acquire();
+    }
+    // The owner clears its own block after a Reset, so no other thread ever writes to it
+    uint64_t epoch = metrics_epoch.load(std::memory_order_acquire);
+    if (block->epoch.load(std::memory_order_relaxed) != epoch) {
+      for (auto& stage : block->stages) {
+        stage.Reset();
+      }
+      for (auto& counter : block->counters) {
+        counter.store(0, std::memory_order_relaxed);
+      }
+      block->epoch.store(epoch, std::memory_order_release);
+    }
+    return *block;
+  }
+
+  ~ThreadMetricsHandle() {
+    if (block != nullptr) {
+      MetricsRegistry::Instance().Release(block);
+    }
+  }
+};
+
+thread_local ThreadMetricsHandle thread_metrics;
+
+// Timelines this thread skips before it times the next one, under the setting it was counted for
+thread_local uint32_t timelines_to_skip = 0;
+thread_local uint64_t timelines_sampling = Metrics::kDefaultTimelineSampling;
+
+// Single-writer increment: a plain load/store pair avoids a locked instruction.
+inline void AddRelaxed(std::atomic<uint64_t>& target, uint64_t value) {
+  target.store(target.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void WriteJsonString(std::ostream& out, const char* value) {
+  out << '"' << value << '"';
+}
+
+} // namespace
+
+LatencyHistogram::LatencyHistogram(const LatencyHistogram& other) {
+  Merge(other);
+}
+
+LatencyHistogram& LatencyHistogram::operator=(const LatencyHistogram& other) {
+  if (this != &other) {
+    Reset();
+    Merge(other);
+  }
+  return *this;
+}
+
+size_t LatencyHistogram::BucketIndex(uint64_t value) {
+  if (value < kSubBuckets) {
+    return static_cast<size_t>(value);
+  }
+  // Keep the kSubBucketBits most significant bits of the value.
+  size_t msb = 63 - static_cast<size_t>(std::countl_zero(value));
+  size_t shift = msb - (kSubBucketBits - 1);
+  size_t sub_bucket = static_cast<size_t>(value >> shift) - kHalfSubBuckets;
+  return kSubBuckets + (shift - 1) * kHalfSubBuckets + sub_bucket;
+}
+
+uint64_t LatencyHistogram::BucketLowerBound(size_t index) {
+  if (index < kSubBuckets) {
+    return index;
+  }
+  size_t shift = (index - kSubBuckets) / kHalfSubBuckets + 1;
+  uint64_t sub_bucket = (index - kSubBuckets) % kHalfSubBuckets + kHalfSubBuckets;
+  return sub_bucket << shift;
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(size_t index) {
+  if (index < kSubBuckets) {
+    return index;
+  }
+  size_t shift = (index - kSubBuckets) / kHalfSubBuckets + 1;
+  return BucketLowerBound(index) + ((uint64_t{1} << shift) - 1);
+}
+
+void LatencyHistogram::Record(uint64_t value) {
+  AddRelaxed(buckets[BucketIndex(value)], 1);
+  AddRelaxed(total_count, 1);
+  AddRelaxed(total_sum, value);
+  if (value < min_value.load(std::memory_order_relaxed)) {
+    min_value.store(value, std::memory_order_relaxed);
+  }
+  if (value > max_value.load(std::memory_order_relaxed)) {
+    max_value.store(value, std::memory_order_relaxed);
+  }
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+  for (size_t i = 0; i < kBucketCount; ++i) {
+    uint64_t count = other.buckets[i].load(std::memory_order_relaxed);
+    if (count != 0) {
+      AddRelaxed(buckets[i], count);
+    }
+  }
+  AddRelaxed(total_count, other.total_count.load(std::memory_order_relaxed));
+  AddRelaxed(total_sum, other.total_sum.load(std::memory_order_relaxed));
+  min_value.store(std::min(min_value.load(std::memory_order_relaxed),
+                           other.min_value.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+  max_value.store(std::max(max_value.load(std::memory_order_relaxed),
+                           other.max_value.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+}
+
+void LatencyHistogram::Reset() {
+  for (auto& bucket : buckets) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+  total_count.store(0, std::memory_order_relaxed);
+  total_sum.store(0, std::memory_order_relaxed);
+  min_value.store(UINT64_MAX, std::memory_order_relaxed);
+  max_value.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Count() const {
+  return total_count.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Sum() const {
+  return total_sum.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Min() const {
+  return Count() == 0 ? 0 : min_value.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Max() const {
+  return max_value.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::Mean() const {
+  uint64_t count = Count();
+  return count == 0 ? 0.0 : static_cast<double>(Sum()) / static_cast<double>(count);
+}
+
+uint64_t LatencyHistogram::Percentile(double percentile) const {
+  uint64_t count = Count();
+  if (count == 0) {
+    return 0;
+  }
+  percentile = std::clamp(percentile, 0.0, 100.0);
+  auto rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(count) + 0.5);
+  rank = std::clamp<uint64_t>(rank, 1, count);
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kBucketCount; ++i) {
+    seen += buckets[i].load(std::memory_order_relaxed);
+    if (seen >= rank) {
+      // Report the middle of the bucket, bounded by the observed extremes.
+      uint64_t lower = BucketLowerBound(i);
+      uint64_t value = lower + (BucketUpperBound(i) - lower) / 2;
+      return std::clamp(value, Min(), Max());
+    }
+  }
+  return Max();
+}
+
+void Metrics::Record(Stage stage, uint64_t nanoseconds) {
+  thread_metrics.Get().stages[static_cast<size_t>(stage)].Record(nanoseconds);
+}
+
+void Metrics::Add(Counter counter, uint64_t value) {
+  AddRelaxed(thread_metrics.Get().counters[static_cast<size_t>(counter)], value);
+}
+
+MetricsSnapshot Metrics::Snapshot() {
+  MetricsSnapshot snapshot;
+  uint64_t epoch = metrics_epoch.load(std::memory_order_acquire);
+  MetricsRegistry::Instance().ForEach([&snapshot, epoch](ThreadMetrics& block) {
+    if (block.epoch.load(std::memory_order_acquire) != epoch) {
+      return; // Not recorded into since the last Reset
+    }
+    for (size_t i = 0; i < block.stages.size(); ++i) {
+      snapshot.stages[i].Merge(block.stages[i]);
+    }
+    for (size_t i = 0; i < block.counters.size(); ++i) {
+      snapshot.counters[i] += block.counters[i].load(std::memory_order_relaxed);
+    }
+  });
+  return snapshot;
+}
+
+/**
+ * @brief Starts a new epoch instead of clearing the blocks in place, which would race with
+ * the single-writer updates of their threads. Each thread clears its block before it next
+ * records, and blocks of earlier epochs are left out of snapshots meanwhile.
+ */
+void Metrics::Reset() {
+  metrics_epoch.fetch_add(1, std::memory_order_acq_rel);
+}
+
+bool Metrics::SampleTimeline() {
+  uint64_t sampling = timeline_sampling.load(std::memory_order_relaxed);
+  if (sampling != timelines_sampling) {
+    timelines_sampling = sampling;
+    timelines_to_skip = 0;
+  }
+  if (timelines_to_skip > 0) {
+    --timelines_to_skip;
+    return false;
+  }
+  timelines_to_skip = static_cast<uint32_t>(sampling) - 1;
+  return true;
+}
+
+void Metrics::SetTimelineSampling(uint32_t interval) {
+  if (interval == 0) {
+    throw std::invalid_argument("The timeline sampling interval must be at least 1.");
+  }
+  uint64_t previous = timeline_sampling.load(std::memory_order_relaxed);
+  uint64_t generation = (previous >> 32) + 1;
+  timeline_sampling.store((generation << 32) | interval, std::memory_order_relaxed);
+}
+
+uint32_t Metrics::TimelineSampling() {
+  return static_cast<uint32_t>(timeline_sampling.load(std::memory_order_relaxed));
+}
+
+const char* Metrics::StageName(Stage stage) {
+  switch (stage) {
+    case Stage::FileRead: return "file_read";
+    case Stage::Tokenize: return "tokenize";
+    case Stage::Merge: return "merge";
+    case Stage::Lookup: return "lookup";
+    case Stage::Scoring: return "scoring";
+    case Stage::Query: return "query";
+    case Stage::JsonOutput: return "json_output";
+    case Stage::Snippet: return "snippet";
+    case Stage::Count: break;
+  }
+  return "unknown";
+}
+
+const char* Metrics::CounterName(Counter counter) {
+  switch (counter) {
+    case Counter::DocumentsLoaded: return "documents_loaded";
+    case Counter::BytesRead: return "bytes_read";
+    case Counter::TokensIndexed: return "tokens_indexed";
+    case Counter::QueriesProcessed: return "queries_processed";
+    case Counter::PostingsScanned: return "postings_scanned";
+    case Counter::Count: break;
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Writes the current metrics as a JSON document.
+ * Latencies are reported in nanoseconds.
+ * @param out Destination stream.
+ */
+void Metrics::WriteJson(std::ostream& out) {
+  MetricsSnapshot snapshot = Snapshot();
+
+  out << "{\n  \"stages\": {";
+  for (size_t i = 0; i < snapshot.stages.size(); ++i) {
+    const LatencyHistogram& histogram = snapshot.stages[i];
+    out << (i == 0 ? "\n    " : ",\n    ");
+    WriteJsonString(out, StageName(static_cast<Stage>(i)));
+    out << ": {\"count\": " << histogram.Count()
+        << ", \"sum_ns\": " << histogram.Sum()
+        << ", \"min_ns\": " << histogram.Min()
+        << ", \"mean_ns\": " << static_cast<uint64_t>(histogram.Mean())
+        << ", \"p50_ns\": " << histogram.Percentile(50.0)
+        << ", \"p90_ns\": " << histogram.Percentile(90.0)
+        << ", \"p99_ns\": " << histogram.Percentile(99.0)
+        << ", \"p999_ns\": " << histogram.Percentile(99.9)
+        << ", \"max_ns\": " << histogram.Max() << "}";
+  }
+  out << "\n  },\n  \"counters\": {";
+  for (size_t i = 0; i < snapshot.counters.size(); ++i) {
+    out << (i == 0 ? "\n    " : ",\n    ");
+    WriteJsonString(out, CounterName(static_cast<Counter>(i)));
+    out << ": " << snapshot.counters[i];
+  }
+  out << "\n  }\n}\n";
+}
+
+/**
+ * @brief Writes the current metrics in the Prometheus text exposition format.
+ * Stage latencies are exported as summaries in seconds.
+ * @param out Destination stream.
+ */
+void Metrics::WritePrometheus(std::ostream& out) {
+  MetricsSnapshot snapshot = Snapshot();
+  constexpr double kNanosecondsPerSecond = 1e9;
+  constexpr double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+  out << "# HELP search_engine_stage_seconds Latency of search engine pipeline stages.\n";
+  out << "# TYPE search_engine_stage_seconds summary\n";
+  for (size_t i = 0; i < snapshot.stages.size(); ++i) {
+    const LatencyHistogram& histogram = snapshot.stages[i];
+    const char* name = StageName(static_cast<Stage>(i));
+    for (double quantile : kQuantiles) {
+      out << "search_engine_stage_seconds{stage=\"" << name << "\",quantile=\"" << quantile << "\"} "
+          << static_cast<double>(histogram.Percentile(quantile * 100.0)) / kNanosecondsPerSecond << "\n";
+    }
+    out << "search_engine_stage_seconds_sum{stage=\"" << name << "\"} "
+        << static_cast<double>(histogram.Sum()) / kNanosecondsPerSecond << "\n";
+    out << "search_engine_stage_seconds_count{stage=\"" << name << "\"} " << histogram.Count() << "\n";
+  }
+
+  for (size_t i = 0; i < snapshot.counters.size(); ++i) {
+    const char* name = CounterName(static_cast<Counter>(i));
+    out << "# TYPE search_engine_" << name << "_total counter\n";
+    out << "search_engine_" << name << "_total " << snapshot.counters[i] << "\n";
+  }
+}
+
+/**
+ * @brief Writes the current metrics to a file.
+ * @param path Destination file; ".prom" and ".txt" select the Prometheus format.
+ */
+void Metrics::WriteReport(const std::string& path) {
+  std::ofstream out(path);
+  if (!out) {
+    throw std::runtime_error("Cannot open stats file for writing: " + path);
+  }
+
+  auto ends_with = [&path](const std::string& suffix) {
+    return path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+  };
+
+  if (ends_with(".prom") || ends_with(".txt")) {
+    WritePrometheus(out);
+  } else {
+    WriteJson(out);
+  }
+}
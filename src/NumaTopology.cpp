@@ -0,0 +1,206 @@
+#include "NumaTopology.h"
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(SEARCH_ENGINE_HAVE_LIBNUMA)
+#include <numa.h>
+#endif
+
+namespace {
+
+// Node the calling thread was pinned to by PinWorker, -1 if it was not pinned
+thread_local long pinned_node = -1;
+
+/**
+ * @brief Parses a sysfs CPU list such as "0-3,8-11".
+ */
+std::vector<int> ParseCpuList(const std::string& list) {
+  std::vector<int> cpus;
+  std::stringstream ranges(list);
+  std::string range;
+  while (std::getline(ranges, range, ',')) {
+    if (range.empty()) {
+      continue;
+    }
+    size_t dash = range.find('-');
+    int first = std::stoi(range.substr(0, dash));
+    int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+std::vector<std::vector<int>> DetectNodes() {
+  std::vector<std::vector<int>> nodes;
+#if defined(SEARCH_ENGINE_HAVE_LIBNUMA)
+  if (numa_available() >= 0) {
+    bitmask* cpus = numa_allocate_cpumask();
+    for (int node = 0; node <= numa_max_node(); ++node) {
+      if (numa_node_to_cpus(node, cpus) != 0) {
+        continue;
+      }
+      std::vector<int> node_cpus;
+      for (unsigned cpu = 0; cpu < cpus->size; ++cpu) {
+        if (numa_bitmask_isbitset(cpus, cpu)) {
+          node_cpus.push_back(static_cast<int>(cpu));
+        }
+      }
+      if (!node_cpus.empty()) {
+        nodes.push_back(std::move(node_cpus));
+      }
+    }
+    numa_free_cpumask(cpus);
+  }
+#endif
+#if defined(__linux__)
+  // Without libnuma, or if libnuma reports no NUMA support, read sysfs directly
+  if (nodes.empty()) {
+    for (int node = 0;; ++node) {
+      std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+      if (!cpulist) {
+        break;
+      }
+      std::string list;
+      std::getline(cpulist, list);
+      try {
+        std::vector<int> node_cpus = ParseCpuList(list);
+        if (!node_cpus.empty()) {
+          nodes.push_back(std::move(node_cpus));
+        }
+      } catch (const std::exception&) {
+        nodes.clear();
+        break;
+      }
+    }
+  }
+#endif
+  if (nodes.empty()) {
+    std::vector<int> cpus(std::max(1u, std::thread::hardware_concurrency()));
+    for (size_t cpu = 0; cpu < cpus.size(); ++cpu) {
+      cpus[cpu] = static_cast<int>(cpu);
+    }
+    nodes.push_back(std::move(cpus));
+  }
+  return nodes;
+}
+
+} // namespace
+
+NumaTopology::NumaTopology(std::vector<std::vector<int>> node_cpus) : _node_cpus(std::move(node_cpus)) {
+  std::erase_if(_node_cpus, [](const std::vector<int>& cpus) { return cpus.empty(); });
+  if (_node_cpus.empty()) {
+    _node_cpus.push_back({ 0 });
+  }
+  for (size_t node = 0; node < _node_cpus.size(); ++node) {
+    for (int cpu : _node_cpus[node]) {
+      if (static_cast<size_t>(cpu) >= _cpu_node.size()) {
+        _cpu_node.resize(cpu + 1, SIZE_MAX);
+      }
+      if (_cpu_node[cpu] == SIZE_MAX) {
+        _cpu_node[cpu] = node;
+      }
+    }
+  }
+}
+
+const NumaTopology& NumaTopology::System() {
+  static const NumaTopology topology(DetectNodes());
+  return topology;
+}
+
+size_t NumaTopology::NodeCount() const {
+  return _node_cpus.size();
+}
+
+const std::vector<int>& NumaTopology::CpusOfNode(size_t node) const {
+  return _node_cpus.at(node);
+}
+
+size_t NumaTopology::NodeOfWorker(size_t worker) const {
+  return worker % _node_cpus.size();
+}
+
+bool NumaTopology::PinWorker(size_t worker) const {
+  size_t node = NodeOfWorker(worker);
+#if defined(__linux__)
+  // The whole node: the scheduler still balances the threads of the node over its cores
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : _node_cpus[node]) {
+    if (cpu >= 0 && cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  if (CPU_COUNT(&set) == 0 || pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+    return false;
+  }
+  pinned_node = static_cast<long>(node);
+  return true;
+#else
+  (void)node;
+  return false;
+#endif
+}
+
+size_t NumaTopology::CurrentNode() const {
+  if (pinned_node >= 0) {
+    return static_cast<size_t>(pinned_node) % _node_cpus.size();
+  }
+#if defined(__linux__)
+  int cpu = sched_getcpu();
+  if (cpu >= 0 && static_cast<size_t>(cpu) < _cpu_node.size() && _cpu_node[cpu] != SIZE_MAX) {
+    return _cpu_node[cpu];
+  }
+#endif
+  return 0;
+}
+
+void NumaTopology::RunOnNode(size_t node, const std::function<void()>& task) const {
+  std::exception_ptr error;
+  std::thread worker([&]() {
+    try {
+      PinWorker(node);
+#if defined(SEARCH_ENGINE_HAVE_LIBNUMA)
+      // Allocate from the node of the pinned CPU even if the process policy interleaves
+      if (numa_available() >= 0) {
+        numa_set_localalloc();
+      }
+#endif
+      task();
+    } catch (...) {
+      error = std::current_exception();
+    }
+  });
+  worker.join();
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+int NumaTopology::NodeOfAddress(const void* address) {
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+  // MPOL_F_NODE | MPOL_F_ADDR: report the node of the page holding address
+  constexpr unsigned long kNodeOfAddress = 1 | 2;
+  int node = -1;
+  if (syscall(SYS_get_mempolicy, &node, nullptr, 0, address, kNodeOfAddress) == 0) {
+    return node;
+  }
+#else
+  (void)address;
+#endif
+  return -1;
+}
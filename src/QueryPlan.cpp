@@ -0,0 +1,30 @@
+#include "QueryPlan.h"
+
+const char* ToString(QueryStrategy strategy) {
+  switch (strategy) {
+    case QueryStrategy::NoMatches: return "no-matches";
+    case QueryStrategy::ImpactOrdered: return "impact-ordered";
+    case QueryStrategy::Exhaustive: return "exhaustive";
+    case QueryStrategy::RareTermsFirst: return "rare-terms-first";
+  }
+  return "unknown";
+}
+
+void QueryPlan::Write(std::ostream& out) const {
+  out << "strategy: " << ToString(strategy);
+  if (impact_fallback) {
+    out << " (impact list ran out, rescored exhaustively)";
+  }
+  if (truncated) {
+    out << " [truncated]";
+  }
+  out << "\n";
+  for (const auto& planned : terms) {
+    out << "  term '" << planned.term << "': df=" << planned.document_frequency
+        << " bytes=" << planned.postings_bytes
+        << (planned.impact_ordered ? " impact-ordered" : "")
+        << (planned.scoring_only ? " scoring-only" : "") << "\n";
+  }
+  out << "postings read: " << postings_read << ", random lookups: " << random_lookups
+      << ", candidates: " << candidates << ", time: " << elapsed_us << " us\n";
+}
@@ -0,0 +1,35 @@
+#include "ResultsModel.h"
+
+ResultsModel::ResultsModel(QObject *parent)
+    : QAbstractListModel(parent) {}
+
+int ResultsModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : static_cast<int>(lines.size());
+}
+
+QVariant ResultsModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid() || index.row() >= lines.size() || role != Qt::DisplayRole) {
+        return {};
+    }
+    return lines.at(index.row());
+}
+
+void ResultsModel::setRows(QStringList rows) {
+    beginResetModel();
+    lines = std::move(rows);
+    endResetModel();
+}
+
+void ResultsModel::appendRows(const QStringList &rows) {
+    if (rows.isEmpty()) {
+        return;
+    }
+    const int first = static_cast<int>(lines.size());
+    beginInsertRows(QModelIndex(), first, first + static_cast<int>(rows.size()) - 1);
+    lines.append(rows);
+    endInsertRows();
+}
+
+void ResultsModel::clear() {
+    setRows({});
+}
\ No newline at end of file
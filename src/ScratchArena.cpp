@@ -0,0 +1,38 @@
+#include "ScratchArena.h"
+
+ScratchArena::ScratchArena(size_t initial_bytes)
+  : buffer(std::make_unique<std::byte[]>(initial_bytes)), capacity(initial_bytes) {
+  resource.emplace(buffer.get(), capacity, &upstream);
+}
+
+std::pmr::memory_resource* ScratchArena::Resource() {
+  return &*resource;
+}
+
+void ScratchArena::Reset() {
+  resource.reset();
+  if (upstream.overflow_bytes != 0) {
+    // Grow to the peak of the last round so that it fits without overflowing next time
+    capacity += upstream.overflow_bytes;
+    buffer = std::make_unique<std::byte[]>(capacity);
+    upstream.overflow_bytes = 0;
+  }
+  resource.emplace(buffer.get(), capacity, &upstream);
+}
+
+size_t ScratchArena::Capacity() const {
+  return capacity;
+}
+
+void* ScratchArena::OverflowCounter::do_allocate(size_t bytes, size_t alignment) {
+  overflow_bytes += bytes;
+  return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void ScratchArena::OverflowCounter::do_deallocate(void* pointer, size_t bytes, size_t alignment) {
+  std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+}
+
+bool ScratchArena::OverflowCounter::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+  return this == &other;
+}
\ No newline at end of file
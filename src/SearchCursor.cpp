@@ -0,0 +1,130 @@
+#include "SearchCursor.h"
+#include <stdexcept>
+
+namespace {
+
+// Bumped whenever the layout of the encoded cursor changes
+constexpr uint8_t kCursorVersion = 1;
+
+constexpr char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+void PutVarint(std::string& bytes, uint64_t value) {
+  while (value >= 0x80) {
+    bytes.push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  bytes.push_back(static_cast<char>(value));
+}
+
+uint64_t GetVarint(std::string_view& bytes) {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (bytes.empty()) {
+      break;
+    }
+    auto byte = static_cast<uint8_t>(bytes.front());
+    bytes.remove_prefix(1);
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return value;
+    }
+  }
+  throw std::invalid_argument("Invalid search cursor.");
+}
+
+int AlphabetIndex(char c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '-') return 62;
+  if (c == '_') return 63;
+  return -1;
+}
+
+} // namespace
+
+/**
+ * @brief Encodes the cursor as base64url (without padding) of a version byte, three varints
+ * and the 4-byte query hash; typical cursors are about 20 characters long.
+ */
+std::string SearchCursor::Encode() const {
+  std::string bytes;
+  bytes.push_back(static_cast<char>(kCursorVersion));
+  PutVarint(bytes, score);
+  PutVarint(bytes, doc_id);
+  PutVarint(bytes, max_score);
+  for (int shift = 0; shift < 32; shift += 8) {
+    bytes.push_back(static_cast<char>((query_hash >> shift) & 0xFF));
+  }
+
+  std::string text;
+  text.reserve((bytes.size() * 4 + 2) / 3);
+  uint32_t bits = 0;
+  int bit_count = 0;
+  for (char byte : bytes) {
+    bits = (bits << 8) | static_cast<uint8_t>(byte);
+    bit_count += 8;
+    while (bit_count >= 6) {
+      bit_count -= 6;
+      text.push_back(kAlphabet[(bits >> bit_count) & 0x3F]);
+    }
+  }
+  if (bit_count > 0) {
+    text.push_back(kAlphabet[(bits << (6 - bit_count)) & 0x3F]);
+  }
+  return text;
+}
+
+SearchCursor SearchCursor::Decode(std::string_view text) {
+  std::string bytes;
+  uint32_t bits = 0;
+  int bit_count = 0;
+  for (char c : text) {
+    int value = AlphabetIndex(c);
+    if (value < 0) {
+      throw std::invalid_argument("Invalid search cursor.");
+    }
+    bits = (bits << 6) | static_cast<uint32_t>(value);
+    bit_count += 6;
+    if (bit_count >= 8) {
+      bit_count -= 8;
+      bytes.push_back(static_cast<char>((bits >> bit_count) & 0xFF));
+    }
+  }
+
+  std::string_view remaining(bytes);
+  if (remaining.empty() || static_cast<uint8_t>(remaining.front()) != kCursorVersion) {
+    throw std::invalid_argument("Invalid search cursor.");
+  }
+  remaining.remove_prefix(1);
+  SearchCursor cursor;
+  cursor.score = GetVarint(remaining);
+  cursor.doc_id = GetVarint(remaining);
+  cursor.max_score = GetVarint(remaining);
+  if (remaining.size() != 4 || cursor.score == 0 || cursor.score > cursor.max_score) {
+    throw std::invalid_argument("Invalid search cursor.");
+  }
+  for (int i = 0; i < 4; ++i) {
+    cursor.query_hash |= static_cast<uint32_t>(static_cast<uint8_t>(remaining[i])) << (8 * i);
+  }
+  return cursor;
+}
+
+/**
+ * @brief 32-bit FNV-1a of the query string, continued over a marker byte and the hash of
+ * the filter bitmap when the query is filtered.
+ */
+uint32_t SearchCursor::HashQuery(std::string_view query, const DocumentBitmap* allowed) {
+  uint32_t hash = 2166136261u;
+  for (char c : query) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  if (allowed != nullptr) {
+    uint32_t filter_hash = allowed->Hash();
+    hash = (hash ^ 0xFFu) * 16777619u; // Never a byte of a UTF-8 query
+    for (int shift = 0; shift < 32; shift += 8) {
+      hash = (hash ^ ((filter_hash >> shift) & 0xFF)) * 16777619u;
+    }
+  }
+  return hash;
+}
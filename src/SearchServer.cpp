@@ -1,11 +1,18 @@
 #include "SearchServer.h"
-#include <sstream>
-#include <set>
-#include <future>
+#include "Metrics.h"
+#include "ScratchArena.h"
+#include "TextNormalizer.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <memory_resource>
 #include <unordered_map>
+#include <unordered_set>
 #include <algorithm>
+#include <cmath>
 #include <iostream>
-#include <execution>
+#include <stdexcept>
 
 /**
  * @brief Constructs a SearchServer with a reference to an InvertedIndex.
@@ -16,124 +23,902 @@ SearchServer::SearchServer(InvertedIndex& idx, int responses_limit)
   : _index(idx), _responses_limit(responses_limit) {}
 
 /**
- * @brief Processes a list of search queries asynchronously.
+ * @brief Persistent worker threads behind batch searches and SearchAsync.
+ * The threads live as long as the server, so each one keeps its query arena from one
+ * query to the next. A batch is posted as a function pointer and its context, so joining
+ * it allocates nothing; asynchronous queries are queued as tasks.
+ */
+struct SearchServer::WorkerPool {
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::condition_variable batch_done;
+  std::deque<std::packaged_task<SearchOutcome()>> tasks;
+  void (*batch)(void*) = nullptr; // Work of the posted batch, run by every worker that joins it.
+  void* batch_context = nullptr;
+  size_t batch_slots = 0; // Workers that may still join the posted batch.
+  size_t batch_running = 0; // Workers currently inside the batch.
+  bool stopping = false;
+  std::vector<std::thread> threads;
+
+  /**
+   * @param thread_count Number of workers.
+   * @param numa Nodes to spread the workers over, or nullptr to leave them unpinned.
+   */
+  WorkerPool(size_t thread_count, const NumaTopology* numa) {
+    threads.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+      threads.emplace_back([this, numa, i]() {
+        if (numa != nullptr && numa->NodeCount() > 1) {
+          numa->PinWorker(i);
+        }
+        Run();
+      });
+    }
+  }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    ready.notify_all();
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  /**
+   * Runs work on the calling thread and on up to `helpers` workers, and returns once every
+   * one of them has returned from it. While another batch is in flight, the calling thread
+   * runs the work alone.
+   */
+  void RunBatch(void (*work)(void*), void* context, size_t helpers) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (batch != nullptr || helpers == 0) {
+      lock.unlock();
+      work(context);
+      return;
+    }
+    batch = work;
+    batch_context = context;
+    batch_slots = std::min(helpers, threads.size());
+    lock.unlock();
+    ready.notify_all();
+
+    work(context);
+
+    lock.lock();
+    batch = nullptr;
+    batch_slots = 0;
+    batch_done.wait(lock, [this]() { return batch_running == 0; });
+  }
+
+  void Run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      ready.wait(lock, [this]() { return stopping || !tasks.empty() || batch_slots > 0; });
+      if (batch_slots > 0) {
+        --batch_slots;
+        ++batch_running;
+        void (*work)(void*) = batch;
+        void* context = batch_context;
+        lock.unlock();
+        work(context);
+        lock.lock();
+        if (--batch_running == 0) {
+          batch_done.notify_all();
+        }
+        continue;
+      }
+      if (tasks.empty()) {
+        return;
+      }
+      std::packaged_task<SearchOutcome()> task = std::move(tasks.front());
+      tasks.pop_front();
+      lock.unlock();
+      task();
+      lock.lock();
+    }
+  }
+};
+
+SearchServer::WorkerPool& SearchServer::Workers() {
+  std::call_once(_workers_started, [this]() {
+    size_t num_threads = _worker_threads > 0 ? _worker_threads : std::thread::hardware_concurrency();
+    if (num_threads == 0) num_threads = 2;
+    _workers = std::make_unique<WorkerPool>(num_threads, _index.GetNumaTopology());
+  });
+  return *_workers;
+}
+
+void SearchServer::SetWorkerThreads(size_t threads) {
+  if (_workers != nullptr) {
+    throw std::runtime_error("Worker threads must be set before the first query.");
+  }
+  _worker_threads = threads;
+}
+
+SearchServer::~SearchServer() = default;
+
+namespace {
+
+// Postings read between two checks of the query budget
+constexpr size_t kPostingsBlock = 1024;
+
+// Per-thread arena for the scratch data of one query, reset at the start of every query
+thread_local ScratchArena query_arena;
+
+bool ByScore(const DocumentScore& a, const DocumentScore& b) {
+  return a.score != b.score ? a.score > b.score : a.doc_id < b.doc_id;
+}
+
+bool ByImpact(const Entry& a, const Entry& b) {
+  return a.count != b.count ? a.count > b.count : a.doc_id < b.doc_id;
+}
+
+/**
+ * @brief Offers a candidate to a bounded heap of the best `limit` documents.
+ * Heap order puts the worst of the kept documents on top, so a candidate costs O(log limit)
+ * and the heap never grows beyond limit entries.
+ */
+void PushBounded(std::pmr::vector<DocumentScore>& top, const DocumentScore& candidate, size_t limit) {
+  if (top.size() < limit) {
+    top.push_back(candidate);
+    std::push_heap(top.begin(), top.end(), ByScore);
+  } else if (limit > 0 && ByScore(candidate, top.front())) {
+    std::pop_heap(top.begin(), top.end(), ByScore);
+    top.back() = candidate;
+    std::push_heap(top.begin(), top.end(), ByScore);
+  }
+}
+
+/**
+ * @return True if the candidate ranks strictly after the cursor boundary, or there is no boundary.
+ */
+bool IsAfter(const DocumentScore* after, const DocumentScore& candidate) {
+  return after == nullptr || ByScore(*after, candidate);
+}
+
+/**
+ * @brief A query term read in impact order, with its doc-ordered postings for random access.
+ */
+struct ImpactCursor {
+  const Entry* impact = nullptr; // Entries by decreasing count.
+  size_t size = 0;
+  size_t position = 0;
+  bool complete = false; // The impact list holds every posting of the term.
+  std::span<const Entry> postings; // Entries by doc_id.
+
+  // Upper bound of the count of any entry not read yet
+  size_t Frontier() const {
+    if (position < size) return impact[position].count;
+    return complete || size == 0 ? 0 : impact[size - 1].count;
+  }
+};
+
+/**
+ * @brief A query term with its postings, looked up once while planning.
+ */
+struct TermPostings {
+  std::string_view term;
+  std::span<const Entry> postings; // Entries by doc_id.
+  std::span<const Entry> impact; // Impact-ordered entries, empty if the term has none.
+  bool scoring_only = false;
+};
+
+/**
+ * @brief Work done while scoring a query.
+ */
+struct ScoringStats {
+  size_t postings_read = 0;
+  size_t random_lookups = 0;
+  size_t candidates = 0;
+};
+
+size_t CountInPostings(std::span<const Entry> postings, size_t doc_id) {
+  auto it = std::lower_bound(postings.begin(), postings.end(), doc_id,
+    [](const Entry& entry, size_t id) { return entry.doc_id < id; });
+  return it != postings.end() && it->doc_id == doc_id ? it->count : 0;
+}
+
+/**
+ * @brief Finds the top results of a query from impact-ordered postings (threshold algorithm).
+ * Terms are read score-at-a-time: the next entry always comes from the list with the highest
+ * remaining count, and each newly seen document is scored exactly by binary search in the
+ * doc-ordered postings of every term. Reading stops once the worst of the best `limit` scores
+ * beats the sum of the remaining counts, which no unseen document can reach.
+ * Documents outside the allowed set are skipped without being scored, and so are documents
+ * ranked at or above `after`: a single term resumes right after it by binary search in its
+ * impact list. When the budget runs out, the best documents seen so far are returned and
+ * truncated is set.
+ * @return False if a truncated impact list ran out before the results were settled;
+ * the caller then scores all postings.
+ */
+bool TopByImpact(const std::pmr::vector<TermPostings>& terms, size_t limit, const DocumentBitmap* allowed,
+                 std::pmr::memory_resource* scratch, std::pmr::vector<DocumentScore>& top,
+                 const QueryBudget* budget, const DocumentScore* after, bool& truncated, ScoringStats& stats) {
+  std::pmr::vector<ImpactCursor> cursors(scratch);
+  for (const TermPostings& term : terms) {
+    ImpactCursor cursor;
+    cursor.postings = term.postings;
+    if (!term.impact.empty()) {
+      cursor.impact = term.impact.data();
+      cursor.size = term.impact.size();
+      cursor.complete = term.impact.size() == term.postings.size();
+    } else {
+      // Infrequent terms have short postings, so sorting a copy of them is cheap
+      std::span<const Entry> postings = term.postings;
+      auto* sorted = static_cast<Entry*>(scratch->allocate(postings.size() * sizeof(Entry), alignof(Entry)));
+      std::copy(postings.begin(), postings.end(), sorted);
+      std::sort(sorted, sorted + postings.size(), ByImpact);
+      stats.postings_read += postings.size();
+      cursor.impact = sorted;
+      cursor.size = postings.size();
+      cursor.complete = true;
+    }
+    cursors.push_back(cursor);
+  }
+
+  top.clear();
+  if (limit == 0) {
+    return true;
+  }
+
+  // A single term ranks documents in impact order, so its top results are a prefix of the list
+  if (cursors.size() == 1) {
+    const ImpactCursor& cursor = cursors.front();
+    size_t position = 0;
+    if (after != nullptr) {
+      Entry boundary{ after->doc_id, after->score };
+      position = std::upper_bound(cursor.impact, cursor.impact + cursor.size, boundary, ByImpact) - cursor.impact;
+    }
+    size_t first = position;
+    for (; position < cursor.size && top.size() < limit; ++position) {
+      const Entry& entry = cursor.impact[position];
+      if (allowed == nullptr || allowed->Contains(entry.doc_id)) {
+        top.push_back({ entry.doc_id, entry.count });
+      }
+    }
+    stats.postings_read += position - first;
+    stats.candidates += top.size();
+    if (top.size() < limit && !cursor.complete) {
+      top.clear();
+      return false;
+    }
+    return true;
+  }
+
+  // Heap order puts the worst of the best candidates on top
+  top.reserve(limit);
+  std::pmr::unordered_set<size_t> seen(scratch);
+  size_t scanned = 0;
+
+  while (true) {
+    if (budget != nullptr && scanned % kPostingsBlock == 0 && budget->Exhausted()) {
+      truncated = true;
+      break;
+    }
+    size_t threshold = 0;
+    ImpactCursor* next = nullptr;
+    for (auto& cursor : cursors) {
+      threshold += cursor.Frontier();
+      if (cursor.position < cursor.size && (next == nullptr || cursor.Frontier() > next->Frontier())) {
+        next = &cursor;
+      }
+    }
+    if (top.size() == limit && top.front().score > threshold) {
+      break;
+    }
+    if (next == nullptr) {
+      bool all_complete = std::all_of(cursors.begin(), cursors.end(),
+        [](const ImpactCursor& cursor) { return cursor.complete; });
+      if (!all_complete) {
+        stats.postings_read += scanned;
+        return false;
+      }
+      break;
+    }
+
+    const Entry& entry = next->impact[next->position++];
+    ++scanned;
+    if (!seen.insert(entry.doc_id).second || (allowed != nullptr && !allowed->Contains(entry.doc_id))) {
+      continue;
+    }
+    DocumentScore candidate{ entry.doc_id, 0 };
+    for (const auto& cursor : cursors) {
+      candidate.score += &cursor == next ? entry.count : CountInPostings(cursor.postings, entry.doc_id);
+    }
+    stats.random_lookups += cursors.size() - 1;
+    ++stats.candidates;
+    if (IsAfter(after, candidate)) {
+      PushBounded(top, candidate, limit);
+    }
+  }
+  stats.postings_read += scanned;
+
+  std::sort(top.begin(), top.end(), ByScore);
+  return true;
+}
+
+} // namespace
+
+/**
+ * @brief Processes a list of search queries in parallel.
  * @param queries_input Vector of search query strings.
  * @return Vector of vectors containing RelativeIndex objects for each query.
  */
 std::vector<std::vector<RelativeIndex>> SearchServer::search(const std::vector<std::string>& queries_input) {
-  std::vector<std::future<std::vector<RelativeIndex>>> futures;
-  std::vector<std::vector<RelativeIndex>> result;
-  futures.reserve(queries_input.size());
-  result.reserve(queries_input.size());
-
-  // Process each query asynchronously
-  for (const auto& query : queries_input) {
-    futures.push_back(std::async(std::launch::async, [this, query]() {
-        try {
-            return ProcessQuery(query);
-        } catch (const std::exception& e) {
-            std::cerr << "Error processing query '" << query << "': " << e.what() << std::endl;
-            return std::vector<RelativeIndex>{};
-        }
-    }));
+  return search(queries_input, DocumentFilter{});
+}
+
+/**
+ * @brief Processes a list of search queries in parallel over the documents matching a filter.
+ * The filter is evaluated once into a bitmap shared by all queries. The calling thread and
+ * the server's persistent workers take queries through a shared counter; every thread
+ * reuses its own query arena from one query and one batch to the next.
+ * @param queries_input Vector of search query strings.
+ * @param filter Metadata filter; an empty filter accepts every document.
+ * @param on_answered Called after every answered query; returning false skips the queries not started yet.
+ * @return Vector of vectors containing RelativeIndex objects for each query.
+ */
+std::vector<std::vector<RelativeIndex>> SearchServer::search(const std::vector<std::string>& queries_input,
+                                                             const DocumentFilter& filter,
+                                                             const AnswerCallback& on_answered) {
+  std::vector<std::vector<RelativeIndex>> result(queries_input.size());
+  DocumentBitmap allowed_documents;
+  const DocumentBitmap* allowed = nullptr;
+  if (!filter.Empty()) {
+    allowed_documents = _index.MatchDocuments(filter);
+    allowed = &allowed_documents;
   }
+  std::atomic<size_t> next_query{0};
 
-  // Collect results from all futures
-  for (auto& future : futures) {
-    try {
-      result.push_back(future.get());
-    } catch (const std::exception& e) {
-      std::cerr << "Error getting results from future: " << e.what() << std::endl;
-      result.emplace_back();
+  auto worker = [&]() {
+    for (size_t i = next_query.fetch_add(1); i < queries_input.size(); i = next_query.fetch_add(1)) {
+      try {
+        result[i] = ProcessQuery(queries_input[i], allowed).results;
+      } catch (const std::exception& e) {
+        std::cerr << "Error processing query '" << queries_input[i] << "': " << e.what() << std::endl;
+      }
+      if (on_answered && !on_answered(i, result[i])) {
+        next_query = queries_input.size();
+      }
     }
-  }
+  };
 
+  // Pool workers are pinned over the NUMA nodes and read their node's copy of the index;
+  // the calling thread keeps its affinity and reads the copy of the node it runs on
+  if (queries_input.size() > 1) {
+    WorkerPool& pool = Workers();
+    size_t helpers = std::min(pool.threads.size() - 1, queries_input.size() - 1);
+    pool.RunBatch([](void* context) { (*static_cast<decltype(worker)*>(context))(); }, &worker, helpers);
+  } else {
+    worker();
+  }
   return result;
 }
 
+/**
+ * @brief Scores a single query without normalizing the scores.
+ * @param query The search query string.
+ * @param allowed Documents that may be returned, or nullptr for all documents.
+ * @return Up to responses_limit documents by decreasing score, then by doc_id.
+ */
+std::vector<DocumentScore> SearchServer::SearchScores(const std::string& query, const DocumentBitmap* allowed) {
+  query_arena.Reset();
+  std::pmr::vector<DocumentScore> top(query_arena.Resource());
+  ScoreQuery(query, allowed, query_arena.Resource(), top);
+  return std::vector<DocumentScore>(top.begin(), top.end());
+}
+
+/**
+ * @brief Returns one page of a query, resuming after the cursor of the previous page.
+ * @param query The search query string.
+ * @param cursor next_cursor of the previous page, or empty for the first page.
+ * @param allowed Documents that may be returned, or nullptr for all documents.
+ * @return Up to responses_limit results and the cursor of the next page.
+ */
+SearchPage SearchServer::SearchPaged(const std::string& query, const std::string& cursor, const DocumentBitmap* allowed) {
+  uint32_t query_hash = SearchCursor::HashQuery(query, allowed);
+  SearchCursor previous;
+  DocumentScore boundary{ 0, 0 };
+  if (!cursor.empty()) {
+    previous = SearchCursor::Decode(cursor);
+    if (previous.query_hash != query_hash) {
+      throw std::invalid_argument("The search cursor was issued for another query or filter.");
+    }
+    boundary = { previous.doc_id, previous.score };
+  }
+
+  query_arena.Reset();
+  std::pmr::vector<DocumentScore> top(query_arena.Resource());
+  ScoreQuery(query, allowed, query_arena.Resource(), top, nullptr, nullptr, cursor.empty() ? nullptr : &boundary);
+  SearchPage page;
+  if (top.empty()) {
+    return page;
+  }
+
+  // Ranks stay relative to the best result of the first page, so pages can be concatenated
+  size_t max_score = cursor.empty() ? top.front().score : previous.max_score;
+  page.results.reserve(top.size());
+  for (const auto& [doc_id, score] : top) {
+    page.results.push_back({ doc_id, static_cast<float>(score) / static_cast<float>(max_score) });
+  }
+  if (top.size() == static_cast<size_t>(std::max(_responses_limit, 0))) {
+    page.next_cursor = SearchCursor{ top.back().score, top.back().doc_id, max_score, query_hash }.Encode();
+  }
+  return page;
+}
+
+void SearchServer::SetCommonTermFrequency(size_t document_frequency) {
+  _common_term_frequency = document_frequency;
+}
+
+/**
+ * @brief Runs a query with tracing enabled and returns the planner's choices.
+ * @param query The search query string.
+ * @param allowed Documents that may be returned, or nullptr for all documents.
+ * @return The plan, with the work done and the evaluation time.
+ */
+QueryPlan SearchServer::Explain(const std::string& query, const DocumentBitmap* allowed) {
+  QueryPlan plan;
+  auto start = std::chrono::steady_clock::now();
+  query_arena.Reset();
+  std::pmr::vector<DocumentScore> top(query_arena.Resource());
+  ScoreQuery(query, allowed, query_arena.Resource(), top, nullptr, &plan);
+  plan.elapsed_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+  return plan;
+}
+
+void SearchServer::SetSnippetOptions(SnippetOptions options) {
+  if (options.window_bytes == 0) {
+    throw std::invalid_argument("Snippet window must be at least one byte.");
+  }
+  _snippet_options = std::move(options);
+}
+
+/**
+ * @brief Cuts the excerpt of a document that best covers the terms of a query.
+ * The occurrences of every query term are taken from the stored offsets and merged in
+ * document order. A window of window_bytes is slid over them: it scores the weights of
+ * the distinct terms it covers, rarer terms weighing more, with the number of
+ * occurrences breaking ties. The best window is centered on its occurrences, widened to
+ * word boundaries, and every query term inside it is highlighted.
+ * @param query The search query string.
+ * @param doc_id A document, usually one of the query's results.
+ * @return The excerpt; the start of the document if no query term occurs in it.
+ */
+Snippet SearchServer::MakeSnippet(const std::string& query, size_t doc_id) {
+  if (!_index.HasTermOffsets()) {
+    throw std::runtime_error("Snippets need term offsets; enable them before building the index.");
+  }
+  SE_METRICS_SCOPE(Stage::Snippet);
+  auto index_lock = _index.LockForReading();
+
+  std::string normalized = TextNormalizer::Normalize(query);
+  std::string_view remaining = normalized;
+  std::vector<std::string_view> terms;
+  while (!remaining.empty()) {
+    size_t word_end = std::min(remaining.find(' '), remaining.size());
+    std::string_view term = _index.AnalyzeTerm(remaining.substr(0, word_end));
+    if (!term.empty()) {
+      terms.push_back(term);
+    }
+    remaining.remove_prefix(std::min(word_end + 1, remaining.size()));
+  }
+  std::sort(terms.begin(), terms.end());
+  terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+
+  // Occurrences of the query terms in document order, with the rarity of each term
+  struct Occurrence {
+    TermSpan span;
+    size_t term;
+  };
+  std::vector<Occurrence> occurrences;
+  std::vector<double> weights(terms.size(), 0.0);
+  size_t max_frequency = 1;
+  for (size_t i = 0; i < terms.size(); ++i) {
+    if (std::span<const Entry> postings = _index.FindTerm(terms[i]); !postings.empty()) {
+      weights[i] = static_cast<double>(postings.size());
+      max_frequency = std::max(max_frequency, postings.size());
+      for (const TermSpan& span : _index.FindOccurrences(doc_id, terms[i])) {
+        occurrences.push_back({ span, i });
+      }
+    }
+  }
+  for (double& weight : weights) {
+    weight = weight > 0.0 ? 1.0 + std::log(static_cast<double>(max_frequency) / weight) : 0.0;
+  }
+  std::sort(occurrences.begin(), occurrences.end(), [](const Occurrence& a, const Occurrence& b) {
+    return a.span.offset < b.span.offset;
+  });
+
+  // Slide the window over the occurrences; [first, last) is the window starting at first
+  const size_t window = _snippet_options.window_bytes;
+  std::vector<size_t> in_window(terms.size(), 0);
+  double score = 0.0, best_score = -1.0;
+  size_t best_first = 0, best_last = 0;
+  for (size_t first = 0, last = 0; first < occurrences.size(); ++first) {
+    while (last < occurrences.size() &&
+           (last == first || occurrences[last].span.offset + occurrences[last].span.length <=
+                             occurrences[first].span.offset + window)) {
+      if (in_window[occurrences[last].term]++ == 0) {
+        score += weights[occurrences[last].term];
+      }
+      ++last;
+    }
+    bool better = score > best_score + 1e-9 || (score > best_score - 1e-9 && last - first > best_last - best_first);
+    if (better) {
+      best_score = score;
+      best_first = first;
+      best_last = last;
+    }
+    if (--in_window[occurrences[first].term] == 0) {
+      score -= weights[occurrences[first].term];
+    }
+  }
+
+  // Center the window on its occurrences, then widen it to whole words
+  std::string_view text = _index.GetDocumentText(doc_id);
+  auto is_separator = [](char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+  };
+  size_t covered_begin = 0, covered_end = 0;
+  for (size_t i = best_first; i < best_last; ++i) {
+    if (i == best_first) {
+      covered_begin = occurrences[i].span.offset;
+    }
+    covered_end = std::max(covered_end, occurrences[i].span.offset + occurrences[i].span.length);
+  }
+  size_t slack = window > covered_end - covered_begin ? window - (covered_end - covered_begin) : 0;
+  size_t begin = covered_begin - std::min(covered_begin, slack / 2);
+  size_t end = std::min(text.size(), std::max(covered_end, begin + window));
+  if (end - begin < window) {
+    begin = std::min(begin, end > window ? end - window : 0);
+  }
+  if (begin > 0 && !is_separator(text[begin - 1])) {
+    size_t word_start = begin;
+    while (word_start < covered_begin && !is_separator(text[word_start])) {
+      ++word_start;
+    }
+    if (word_start < covered_begin) {
+      begin = word_start + 1;
+    } else {
+      while (begin < covered_begin && (static_cast<unsigned char>(text[begin]) & 0xC0) == 0x80) {
+        ++begin;
+      }
+    }
+  }
+  if (end < text.size() && !is_separator(text[end])) {
+    size_t floor = std::max(begin, covered_end);
+    size_t word_end = end;
+    while (word_end > floor && !is_separator(text[word_end - 1])) {
+      --word_end;
+    }
+    if (word_end > floor) {
+      end = word_end - 1;
+    } else {
+      while (end > floor && (static_cast<unsigned char>(text[end]) & 0xC0) == 0x80) {
+        --end;
+      }
+    }
+  }
+
+  Snippet snippet;
+  snippet.doc_id = doc_id;
+  snippet.begin = begin;
+  snippet.end = end;
+  auto next = std::lower_bound(occurrences.begin(), occurrences.end(), begin, [](const Occurrence& occurrence, size_t offset) {
+    return occurrence.span.offset < offset;
+  });
+  bool after_space = true;
+  for (size_t i = begin; i < end;) {
+    if (next != occurrences.end() && next->span.offset == i && i + next->span.length <= end) {
+      snippet.text += _snippet_options.highlight_open;
+      snippet.text.append(text.substr(i, next->span.length));
+      snippet.text += _snippet_options.highlight_close;
+      ++snippet.highlights;
+      i += next->span.length;
+      ++next;
+      after_space = false;
+      continue;
+    }
+    while (next != occurrences.end() && next->span.offset <= i) {
+      ++next;
+    }
+    if (is_separator(text[i])) {
+      if (!after_space) {
+        snippet.text += ' ';
+      }
+      after_space = true;
+    } else {
+      snippet.text += text[i];
+      after_space = false;
+    }
+    ++i;
+  }
+  if (!snippet.text.empty() && snippet.text.back() == ' ') {
+    snippet.text.pop_back();
+  }
+  return snippet;
+}
+
+/**
+ * @brief Cuts the snippet of every result of every query.
+ * @param queries_input Vector of search query strings.
+ * @param answers Results of the queries, as returned by search.
+ * @return Snippets in the order of the results.
+ */
+std::vector<std::vector<Snippet>> SearchServer::Snippets(const std::vector<std::string>& queries_input,
+                                                         const std::vector<std::vector<RelativeIndex>>& answers) {
+  if (queries_input.size() != answers.size()) {
+    throw std::invalid_argument("Every query needs its list of results.");
+  }
+  std::vector<std::vector<Snippet>> snippets(answers.size());
+  for (size_t i = 0; i < answers.size(); ++i) {
+    snippets[i].reserve(answers[i].size());
+    for (const auto& result : answers[i]) {
+      snippets[i].push_back(MakeSnippet(queries_input[i], result.doc_id));
+    }
+  }
+  return snippets;
+}
+
+/**
+ * @brief Queues a query on the server's worker pool, started on first use.
+ * The deadline covers the time spent waiting in the queue, so a query that is already
+ * late when a worker picks it up returns at once with no results, marked truncated.
+ * @param query The search query string.
+ * @param deadline Time by which the results are needed.
+ * @param token Token the caller can use to cancel the query.
+ * @return Future holding the outcome, or the exception raised for an invalid query.
+ */
+std::future<SearchOutcome> SearchServer::SearchAsync(const std::string& query,
+                                                     std::chrono::steady_clock::time_point deadline,
+                                                     CancellationToken token) {
+  QueryBudget budget{ deadline, std::move(token) };
+  std::packaged_task<SearchOutcome()> task([this, query, budget]() {
+    return ProcessQuery(query, nullptr, &budget);
+  });
+  std::future<SearchOutcome> outcome = task.get_future();
+  {
+    WorkerPool& pool = Workers();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.tasks.push_back(std::move(task));
+  }
+  _workers->ready.notify_one();
+  return outcome;
+}
+
 /**
  * @brief Processes a single search query.
+ * All scratch data (normalized query, terms, per-document counts, candidates) is allocated
+ * from the thread's query arena, so once the arena has grown to fit the workload the only
+ * heap allocation is the returned vector.
  * @param query The search query string.
- * @return Vector of RelativeIndex objects representing search results.
+ * @param allowed Documents that may be returned, or nullptr for all documents.
+ * @param budget Limits on the evaluation, or nullptr to run to completion.
+ * @return Normalized results and whether the budget cut them short.
  */
-std::vector<RelativeIndex> SearchServer::ProcessQuery(const std::string& query) {
+SearchOutcome SearchServer::ProcessQuery(const std::string& query, const DocumentBitmap* allowed,
+                                         const QueryBudget* budget) {
+  query_arena.Reset();
+  std::pmr::vector<DocumentScore> top(query_arena.Resource());
+  SearchOutcome outcome;
+  outcome.truncated = ScoreQuery(query, allowed, query_arena.Resource(), top, budget);
+  if (top.empty()) {
+    // No documents found matching the query
+    return outcome;
+  }
+
+  // The first document has the maximum absolute relevance
+  size_t max_absolute_relevance = top.front().score;
+  if (max_absolute_relevance == 0) {
+    throw std::runtime_error("Maximum absolute relevance is zero. Possible division by zero.");
+  }
+
+  // Calculate the relative relevance for each document
+  outcome.results.reserve(top.size());
+  for (const auto& [doc_id, score] : top) {
+    float rank = static_cast<float>(score) / static_cast<float>(max_absolute_relevance);
+    outcome.results.push_back({ doc_id, rank });
+  }
+  return outcome;
+}
+
+/**
+ * @brief Plans and evaluates a query, returning its best documents by absolute score.
+ * Terms are ordered from the lowest to the highest document frequency. Terms above the
+ * common-term frequency only add to the scores of documents found through rarer terms;
+ * otherwise impact-ordered postings are used when a term has them, with an exhaustive
+ * OR over all postings as the general case.
+ * The budget is checked between blocks of kPostingsBlock postings; once it runs out,
+ * the documents counted so far are ranked as they are, without common-term counts unless
+ * every candidate already has them. With a cursor boundary, documents
+ * ranked at or above it are dropped before they reach the bounded heap of results.
+ * @param query The search query string.
+ * @param allowed Documents that may be returned, or nullptr for all documents.
+ * @param scratch Arena for all temporary data.
+ * @param top Receives up to responses_limit documents by decreasing score, then by doc_id.
+ * @param budget Limits on the evaluation, or nullptr to run to completion.
+ * @param trace Receives the plan and the work done, or nullptr.
+ * @param after Only documents ranked strictly after this one are returned, or nullptr for all.
+ * @return True if the budget ran out before all postings were read.
+ */
+bool SearchServer::ScoreQuery(const std::string& query, const DocumentBitmap* allowed, std::pmr::memory_resource* scratch,
+                              std::pmr::vector<DocumentScore>& top, const QueryBudget* budget, QueryPlan* trace,
+                              const DocumentScore* after) {
   if (query.empty()) {
     throw std::invalid_argument("Received empty query.");
   }
 
-  std::istringstream iss(query);
-  std::string word;
-  std::unordered_map<size_t, size_t> doc_to_count;
-  std::set<std::string> unique_words;
+  // Stages share their boundary timestamps and only sampled queries read the clock at all,
+  // which keeps the instrumentation within budget on short queries
+  SE_METRICS_TIMELINE(Stage::Query, Stage::Lookup);
+  SE_METRICS_ADD(Counter::QueriesProcessed, 1);
 
-  // Extract unique words from the query
-  while (iss >> word) {
-    unique_words.insert(word);
+  if (query.find_first_not_of(" \t\n\v\f\r") == std::string::npos) {
+    throw std::invalid_argument("Query contains no valid words.");
   }
+  top.clear();
 
-  if (unique_words.empty()) {
-    throw std::invalid_argument("Query contains no valid words.");
+  // Postings are read through pointers into the index, so document updates wait for the query
+  auto index_lock = _index.LockForReading();
+  if (budget != nullptr && budget->Exhausted()) {
+    if (trace != nullptr) {
+      trace->truncated = true;
+    }
+    return true;
   }
 
-  // Accumulate word counts for each document
-  for (const auto& word : unique_words) {
-    auto entries = _index.GetWordCount(word);
-    for (const auto& entry : entries) {
-      doc_to_count[entry.doc_id] += entry.count;
+  // Normalize the whole query at once; spaces are left as the only separators
+  auto* buffer = static_cast<char*>(scratch->allocate(query.size(), 1));
+  std::string_view remaining(buffer, TextNormalizer::NormalizeInto(query, buffer));
+
+  // Extract unique terms from the query, analyzed the same way as the documents
+  std::pmr::vector<std::string_view> unique_words(scratch);
+  while (!remaining.empty()) {
+    size_t word_end = std::min(remaining.find(' '), remaining.size());
+    std::string_view term = _index.AnalyzeTerm(remaining.substr(0, word_end));
+    if (!term.empty()) {
+      unique_words.push_back(term);
     }
+    remaining.remove_prefix(std::min(word_end + 1, remaining.size()));
   }
+  std::sort(unique_words.begin(), unique_words.end());
+  unique_words.erase(std::unique(unique_words.begin(), unique_words.end()), unique_words.end());
 
-  if (doc_to_count.empty()) {
-    // No documents found matching the query
-    return {};
+  // Plan: look up every term once and order them from the rarest to the most common
+  std::pmr::vector<TermPostings> terms(scratch);
+  for (std::string_view word : unique_words) {
+    if (std::span<const Entry> postings = _index.FindTerm(word); !postings.empty()) {
+      terms.push_back({ word, postings, _index.FindImpactOrdered(word), false });
+    }
   }
+  SE_METRICS_NEXT(Stage::Scoring);
+  std::sort(terms.begin(), terms.end(), [](const TermPostings& a, const TermPostings& b) {
+    return a.postings.size() != b.postings.size() ? a.postings.size() < b.postings.size() : a.term < b.term;
+  });
 
-  // Find the maximum absolute relevance
-  size_t max_absolute_relevance = 0;
-  for (const auto& [doc_id, count] : doc_to_count) {
-    if (count > max_absolute_relevance) {
-      max_absolute_relevance = count;
+  // Common terms only score the candidates of rarer terms; a query made only of common terms runs as usual
+  size_t scoring_only_count = 0;
+  if (_common_term_frequency > 0) {
+    for (auto& term : terms) {
+      term.scoring_only = term.postings.size() > _common_term_frequency;
+      scoring_only_count += term.scoring_only ? 1 : 0;
+    }
+    if (scoring_only_count == terms.size()) {
+      for (auto& term : terms) {
+        term.scoring_only = false;
+      }
+      scoring_only_count = 0;
     }
   }
 
-  if (max_absolute_relevance == 0) {
-    throw std::runtime_error("Maximum absolute relevance is zero. Possible division by zero.");
+  QueryStrategy strategy = QueryStrategy::Exhaustive;
+  if (terms.empty()) {
+    strategy = QueryStrategy::NoMatches;
+  } else if (scoring_only_count > 0) {
+    strategy = QueryStrategy::RareTermsFirst;
+  } else if (std::any_of(terms.begin(), terms.end(), [](const TermPostings& term) { return !term.impact.empty(); })) {
+    strategy = QueryStrategy::ImpactOrdered;
+  }
+  if (trace != nullptr) {
+    trace->terms.clear();
+    for (const auto& term : terms) {
+      trace->terms.push_back({ std::string(term.term), term.postings.size(), term.postings.size() * sizeof(Entry),
+                               !term.impact.empty(), term.scoring_only });
+    }
+    trace->strategy = strategy;
   }
 
-  std::vector<RelativeIndex> relative_indices;
-  relative_indices.reserve(doc_to_count.size());
+  size_t limit = static_cast<size_t>(std::max(_responses_limit, 0));
+  bool truncated = false;
+  ScoringStats stats;
+  auto finish = [&]() {
+    SE_METRICS_ADD(Counter::PostingsScanned, stats.postings_read);
+    if (trace != nullptr) {
+      trace->truncated = truncated;
+      trace->postings_read = stats.postings_read;
+      trace->random_lookups = stats.random_lookups;
+      trace->candidates = stats.candidates;
+    }
+    return truncated;
+  };
 
-  // Calculate the relative relevance for each document
-  for (const auto& [doc_id, count] : doc_to_count) {
-    float rank = static_cast<float>(count) / static_cast<float>(max_absolute_relevance);
-    relative_indices.push_back({ doc_id, rank });
-  }
-
-  // Use partial_sort to get top N results
-  if (relative_indices.size() > static_cast<size_t>(_responses_limit)) {
-    std::partial_sort(relative_indices.begin(),
-      relative_indices.begin() + _responses_limit,
-      relative_indices.end(),
-      [](const RelativeIndex& a, const RelativeIndex& b) {
-        if (a.rank == b.rank) {
-          return a.doc_id < b.doc_id;
+  // Frequent terms have impact-ordered postings, so the best documents can be found without reading every posting
+  if (strategy == QueryStrategy::ImpactOrdered) {
+    if (TopByImpact(terms, limit, allowed, scratch, top, budget, after, truncated, stats)) {
+      return finish();
+    }
+    top.clear();
+    if (trace != nullptr) {
+      trace->strategy = QueryStrategy::Exhaustive;
+      trace->impact_fallback = true;
+    }
+  }
+
+  // Accumulate word counts for each document, reading postings in blocks between budget checks
+  std::pmr::unordered_map<size_t, size_t> doc_to_count(scratch);
+  for (const TermPostings& term : terms) {
+    if (term.scoring_only || truncated) {
+      continue;
+    }
+    std::span<const Entry> entries = term.postings;
+    for (size_t block = 0; block < entries.size(); block += kPostingsBlock) {
+      if (budget != nullptr && budget->Exhausted()) {
+        truncated = true;
+        break;
+      }
+      size_t block_end = std::min(block + kPostingsBlock, entries.size());
+      stats.postings_read += block_end - block;
+      for (size_t i = block; i < block_end; ++i) {
+        const Entry& entry = entries[i];
+        if (allowed == nullptr || allowed->Contains(entry.doc_id)) {
+          doc_to_count[entry.doc_id] += entry.count;
         }
-        return a.rank > b.rank;
-      });
-    relative_indices.resize(_responses_limit);
-  } else {
-    // Sort all results
-    std::sort(relative_indices.begin(), relative_indices.end(),
-      [](const RelativeIndex& a, const RelativeIndex& b) {
-        if (a.rank == b.rank) {
-          return a.doc_id < b.doc_id;
+      }
+    }
+  }
+  stats.candidates += doc_to_count.size();
+
+  // Common terms add their counts to the candidates found above. The counts are kept aside
+  // until every candidate has them, so a pass cut short does not rank partially scored
+  // documents against fully scored ones: all candidates keep their rare-term counts instead.
+  if (scoring_only_count > 0 && !truncated) {
+    std::pmr::vector<size_t> common_counts(scratch);
+    common_counts.reserve(doc_to_count.size());
+    for (const auto& candidate : doc_to_count) {
+      if (budget != nullptr && common_counts.size() % kPostingsBlock == 0 && budget->Exhausted()) {
+        truncated = true;
+        break;
+      }
+      size_t common_count = 0;
+      for (const TermPostings& term : terms) {
+        if (term.scoring_only) {
+          common_count += CountInPostings(term.postings, candidate.first);
         }
-        return a.rank > b.rank;
-      });
+      }
+      common_counts.push_back(common_count);
+      stats.random_lookups += scoring_only_count;
+    }
+    if (!truncated) {
+      auto common_count = common_counts.begin();
+      for (auto& candidate : doc_to_count) {
+        candidate.second += *common_count++;
+      }
+    }
   }
 
-  return relative_indices;
+  // Keep the top N results after the cursor in a bounded heap
+  top.clear();
+  top.reserve(std::min(doc_to_count.size(), limit));
+  for (const auto& [doc_id, count] : doc_to_count) {
+    DocumentScore candidate{ doc_id, count };
+    if (IsAfter(after, candidate)) {
+      PushBounded(top, candidate, limit);
+    }
+  }
+  std::sort(top.begin(), top.end(), ByScore);
+  return finish();
 }
-
-
-
@@ -0,0 +1,166 @@
+#include "ShardCoordinator.h"
+#include "ShardProtocol.h"
+#include <algorithm>
+#include <stdexcept>
+
+#include <unistd.h>
+
+ShardCoordinator::ShardCoordinator(std::vector<std::string> shard_addresses, std::chrono::milliseconds timeout,
+                                   int responses_limit)
+  : _timeout(timeout), _responses_limit(responses_limit) {
+  if (shard_addresses.empty()) {
+    throw std::invalid_argument("Coordinator needs at least one shard.");
+  }
+  for (auto& address : shard_addresses) {
+    auto shard = std::make_unique<Shard>();
+    shard->address = std::move(address);
+    _shards.push_back(std::move(shard));
+  }
+}
+
+ShardCoordinator::~ShardCoordinator() {
+  for (auto& shard : _shards) {
+    for (int fd : shard->idle_connections) {
+      ::close(fd);
+    }
+  }
+}
+
+size_t ShardCoordinator::ShardCount() const {
+  return _shards.size();
+}
+
+/**
+ * @brief Sends a request to a shard, on an idle pooled connection when allowed.
+ * @param shard The shard.
+ * @param payload Encoded request.
+ * @param allow_pooled False to always open a fresh connection.
+ * @param pooled Set to true if a pooled connection was used.
+ * @return The connection, or -1 if the request could not be sent.
+ */
+int ShardCoordinator::Send(Shard& shard, const std::string& payload, bool allow_pooled, bool& pooled) {
+  int fd = -1;
+  pooled = false;
+  if (allow_pooled) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (!shard.idle_connections.empty()) {
+      fd = shard.idle_connections.back();
+      shard.idle_connections.pop_back();
+      pooled = true;
+    }
+  }
+  try {
+    if (fd < 0) {
+      fd = ShardProtocol::Connect(shard.address);
+    }
+    ShardProtocol::SendFrame(fd, payload);
+    return fd;
+  } catch (const std::exception&) {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    return -1;
+  }
+}
+
+void ShardCoordinator::Release(Shard& shard, int fd) {
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  shard.idle_connections.push_back(fd);
+}
+
+/**
+ * @brief Sends the query to every shard, then collects the answers until the deadline.
+ * A connection that timed out may still receive a late answer, so it is closed rather
+ * than returned to the pool. A pooled connection that fails before the deadline is retried
+ * once on a fresh connection, since the shard may have closed it while it was idle.
+ * @param query The search query string.
+ * @param filter Metadata filter expression, empty for none.
+ * @return Merged results and the shards that did not answer in time.
+ */
+CoordinatedResult ShardCoordinator::Search(const std::string& query, const std::string& filter) {
+  auto deadline = std::chrono::steady_clock::now() + _timeout;
+  ShardRequest request;
+  request.limit = static_cast<uint32_t>(std::max(_responses_limit, 0));
+  request.query = query;
+  request.filter = filter;
+  std::string payload = ShardProtocol::EncodeRequest(request);
+
+  CoordinatedResult result;
+  std::vector<int> connections(_shards.size(), -1);
+  std::vector<bool> pooled(_shards.size(), false);
+  for (size_t i = 0; i < _shards.size(); ++i) {
+    bool reused = false;
+    connections[i] = Send(*_shards[i], payload, true, reused);
+    if (connections[i] < 0 && reused) {
+      // The pooled connection went stale while idle, e.g. the shard restarted
+      connections[i] = Send(*_shards[i], payload, false, reused);
+    }
+    pooled[i] = reused;
+  }
+
+  std::vector<DocumentScore> merged;
+  std::string error;
+  std::string answer;
+  auto receive = [&](int fd, ShardResponse& response) {
+    if (!ShardProtocol::ReceiveFrame(fd, answer, deadline)) {
+      return false;
+    }
+    try {
+      response = ShardProtocol::DecodeResponse(answer);
+      return true;
+    } catch (const std::exception&) {
+      return false;
+    }
+  };
+  for (size_t i = 0; i < _shards.size(); ++i) {
+    if (connections[i] < 0) {
+      result.failed_shards.push_back(i);
+      continue;
+    }
+    ShardResponse response;
+    bool received = receive(connections[i], response);
+    if (!received && pooled[i] && std::chrono::steady_clock::now() < deadline) {
+      // A pooled connection closed by the shard accepts the request, then reads as closed;
+      // retry once on a fresh connection before counting the shard as failed
+      ::close(connections[i]);
+      bool reused = false;
+      connections[i] = Send(*_shards[i], payload, false, reused);
+      received = connections[i] >= 0 && receive(connections[i], response);
+    }
+    if (!received) {
+      if (connections[i] >= 0) {
+        ::close(connections[i]);
+      }
+      result.failed_shards.push_back(i);
+      continue;
+    }
+    Release(*_shards[i], connections[i]);
+    if (!response.ok) {
+      error = response.error;
+      result.failed_shards.push_back(i);
+      continue;
+    }
+    merged.insert(merged.end(), response.results.begin(), response.results.end());
+  }
+
+  // Every shard rejected the query itself, e.g. because it is empty
+  if (!error.empty() && result.failed_shards.size() == _shards.size()) {
+    throw std::invalid_argument(error);
+  }
+
+  size_t result_size = std::min(merged.size(), static_cast<size_t>(request.limit));
+  std::partial_sort(merged.begin(), merged.begin() + result_size, merged.end(),
+    [](const DocumentScore& a, const DocumentScore& b) {
+      return a.score != b.score ? a.score > b.score : a.doc_id < b.doc_id;
+    });
+  if (result_size == 0 || merged.front().score == 0) {
+    return result;
+  }
+
+  auto max_score = static_cast<float>(merged.front().score);
+  result.results.reserve(result_size);
+  for (size_t i = 0; i < result_size; ++i) {
+    result.results.push_back({ merged[i].doc_id, static_cast<float>(merged[i].score) / max_score });
+  }
+  return result;
+}
\ No newline at end of file
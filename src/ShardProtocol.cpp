@@ -0,0 +1,281 @@
+#include "ShardProtocol.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // SO_NOSIGPIPE is set on the socket instead
+#endif
+
+namespace {
+
+constexpr uint32_t kRequestMagic = 0x31514553; // "SEQ1"
+constexpr uint32_t kResponseMagic = 0x31524553; // "SER1"
+
+// Largest accepted frame, guards against reading garbage as a length
+constexpr uint32_t kMaxFrameBytes = 64u << 20;
+
+void Append(std::string& out, uint32_t value) {
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void Append(std::string& out, uint64_t value) {
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void Append(std::string& out, std::string_view text) {
+  Append(out, static_cast<uint32_t>(text.size()));
+  out.append(text);
+}
+
+/**
+ * @brief Reads fixed-size fields from a payload, throwing on truncated input.
+ */
+class Reader {
+  public:
+    explicit Reader(std::string_view payload) : data(payload) {}
+
+    template <typename T>
+    T Read() {
+      T value;
+      Take(reinterpret_cast<char*>(&value), sizeof(value));
+      return value;
+    }
+
+    std::string ReadString() {
+      auto size = Read<uint32_t>();
+      std::string text(size, '\0');
+      Take(text.data(), size);
+      return text;
+    }
+
+  private:
+    std::string_view data;
+
+    void Take(char* out, size_t size) {
+      if (data.size() < size) {
+        throw std::runtime_error("Truncated shard message.");
+      }
+      std::memcpy(out, data.data(), size);
+      data.remove_prefix(size);
+    }
+};
+
+[[noreturn]] void ThrowSystemError(const std::string& what) {
+  throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+/**
+ * @brief Socket address parsed from "unix:/path" or "[tcp:]host:port".
+ */
+struct SocketAddress {
+  sockaddr_storage storage{};
+  socklen_t length = 0;
+  bool is_unix = false;
+  std::string path;
+};
+
+SocketAddress ParseAddress(const std::string& address) {
+  SocketAddress parsed;
+  if (address.rfind("unix:", 0) == 0) {
+    parsed.is_unix = true;
+    parsed.path = address.substr(5);
+    auto* un = reinterpret_cast<sockaddr_un*>(&parsed.storage);
+    if (parsed.path.empty() || parsed.path.size() >= sizeof(un->sun_path)) {
+      throw std::invalid_argument("Invalid Unix socket path: " + address);
+    }
+    un->sun_family = AF_UNIX;
+    std::memcpy(un->sun_path, parsed.path.c_str(), parsed.path.size() + 1);
+    parsed.length = sizeof(sockaddr_un);
+    return parsed;
+  }
+
+  std::string host_port = address.rfind("tcp:", 0) == 0 ? address.substr(4) : address;
+  size_t colon = host_port.rfind(':');
+  if (colon == std::string::npos) {
+    throw std::invalid_argument("Shard address must be unix:/path or host:port: " + address);
+  }
+  std::string host = host_port.substr(0, colon);
+  if (host.empty() || host == "localhost") {
+    host = "127.0.0.1";
+  }
+  auto* in = reinterpret_cast<sockaddr_in*>(&parsed.storage);
+  in->sin_family = AF_INET;
+  in->sin_port = htons(static_cast<uint16_t>(std::stoi(host_port.substr(colon + 1))));
+  if (::inet_pton(AF_INET, host.c_str(), &in->sin_addr) != 1) {
+    throw std::invalid_argument("Shard host must be an IPv4 address: " + address);
+  }
+  parsed.length = sizeof(sockaddr_in);
+  return parsed;
+}
+
+void ConfigureSocket(int fd, bool is_unix) {
+#ifdef SO_NOSIGPIPE
+  int one = 1;
+  ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+  if (!is_unix) {
+    int nodelay = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+  }
+}
+
+} // namespace
+
+std::string ShardProtocol::EncodeRequest(const ShardRequest& request) {
+  std::string out;
+  Append(out, kRequestMagic);
+  Append(out, request.limit);
+  Append(out, std::string_view(request.query));
+  Append(out, std::string_view(request.filter));
+  return out;
+}
+
+ShardRequest ShardProtocol::DecodeRequest(std::string_view payload) {
+  Reader reader(payload);
+  if (reader.Read<uint32_t>() != kRequestMagic) {
+    throw std::runtime_error("Not a shard request.");
+  }
+  ShardRequest request;
+  request.limit = reader.Read<uint32_t>();
+  request.query = reader.ReadString();
+  request.filter = reader.ReadString();
+  return request;
+}
+
+std::string ShardProtocol::EncodeResponse(const ShardResponse& response) {
+  std::string out;
+  Append(out, kResponseMagic);
+  Append(out, static_cast<uint32_t>(response.ok ? 0 : 1));
+  if (!response.ok) {
+    Append(out, std::string_view(response.error));
+    return out;
+  }
+  Append(out, static_cast<uint32_t>(response.results.size()));
+  for (const auto& result : response.results) {
+    Append(out, static_cast<uint64_t>(result.doc_id));
+    Append(out, static_cast<uint64_t>(result.score));
+  }
+  return out;
+}
+
+ShardResponse ShardProtocol::DecodeResponse(std::string_view payload) {
+  Reader reader(payload);
+  if (reader.Read<uint32_t>() != kResponseMagic) {
+    throw std::runtime_error("Not a shard response.");
+  }
+  ShardResponse response;
+  response.ok = reader.Read<uint32_t>() == 0;
+  if (!response.ok) {
+    response.error = reader.ReadString();
+    return response;
+  }
+  auto count = reader.Read<uint32_t>();
+  response.results.reserve(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    auto doc_id = reader.Read<uint64_t>();
+    auto score = reader.Read<uint64_t>();
+    response.results.push_back({ static_cast<size_t>(doc_id), static_cast<size_t>(score) });
+  }
+  return response;
+}
+
+int ShardProtocol::Listen(const std::string& address) {
+  SocketAddress parsed = ParseAddress(address);
+  int fd = ::socket(parsed.storage.ss_family, SOCK_STREAM, 0);
+  if (fd < 0) {
+    ThrowSystemError("Cannot create socket for " + address);
+  }
+  if (parsed.is_unix) {
+    ::unlink(parsed.path.c_str());
+  } else {
+    int reuse = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  }
+  if (::bind(fd, reinterpret_cast<sockaddr*>(&parsed.storage), parsed.length) != 0 || ::listen(fd, 128) != 0) {
+    int error = errno;
+    ::close(fd);
+    errno = error;
+    ThrowSystemError("Cannot listen on " + address);
+  }
+  return fd;
+}
+
+int ShardProtocol::Connect(const std::string& address) {
+  SocketAddress parsed = ParseAddress(address);
+  int fd = ::socket(parsed.storage.ss_family, SOCK_STREAM, 0);
+  if (fd < 0) {
+    ThrowSystemError("Cannot create socket for " + address);
+  }
+  if (::connect(fd, reinterpret_cast<sockaddr*>(&parsed.storage), parsed.length) != 0) {
+    int error = errno;
+    ::close(fd);
+    errno = error;
+    ThrowSystemError("Cannot connect to " + address);
+  }
+  ConfigureSocket(fd, parsed.is_unix);
+  return fd;
+}
+
+void ShardProtocol::SendFrame(int fd, std::string_view payload) {
+  std::string frame;
+  frame.reserve(sizeof(uint32_t) + payload.size());
+  Append(frame, static_cast<uint32_t>(payload.size()));
+  frame.append(payload);
+
+  size_t sent = 0;
+  while (sent < frame.size()) {
+    ssize_t written = ::send(fd, frame.data() + sent, frame.size() - sent, MSG_NOSIGNAL);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      ThrowSystemError("Cannot send shard message");
+    }
+    sent += static_cast<size_t>(written);
+  }
+}
+
+bool ShardProtocol::ReceiveFrame(int fd, std::string& payload, std::chrono::steady_clock::time_point deadline) {
+  auto read_exactly = [fd, deadline](char* out, size_t size) {
+    size_t received = 0;
+    while (received < size) {
+      auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+      if (remaining.count() <= 0) {
+        return false;
+      }
+      pollfd descriptor{ fd, POLLIN, 0 };
+      int ready = ::poll(&descriptor, 1, static_cast<int>(remaining.count()));
+      if (ready < 0 && errno == EINTR) {
+        continue;
+      }
+      if (ready <= 0) {
+        return false;
+      }
+      ssize_t count = ::recv(fd, out + received, size - received, 0);
+      if (count < 0 && errno == EINTR) {
+        continue;
+      }
+      if (count <= 0) {
+        return false;
+      }
+      received += static_cast<size_t>(count);
+    }
+    return true;
+  };
+
+  uint32_t size = 0;
+  if (!read_exactly(reinterpret_cast<char*>(&size), sizeof(size)) || size > kMaxFrameBytes) {
+    return false;
+  }
+  payload.resize(size);
+  return read_exactly(payload.data(), size);
+}
\ No newline at end of file
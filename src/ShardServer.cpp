@@ -0,0 +1,143 @@
+#include "ShardServer.h"
+#include "SearchServer.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <iostream>
+#include <iterator>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// Time allowed for the rest of a request once its first bytes have arrived
+constexpr std::chrono::seconds kFrameTimeout{10};
+
+} // namespace
+
+ShardServer::ShardServer(InvertedIndex& index, size_t first_doc_id)
+  : _index(index), _first_doc_id(first_doc_id) {}
+
+ShardServer::~ShardServer() {
+  Stop();
+  if (_listen_fd >= 0) {
+    ::close(_listen_fd);
+  }
+}
+
+void ShardServer::Listen(const std::string& address) {
+  _listen_fd = ShardProtocol::Listen(address);
+}
+
+void ShardServer::Serve() {
+  while (!_stopping) {
+    int fd = ::accept(_listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      break; // The listening socket was shut down by Stop
+    }
+
+    std::vector<std::thread> finished;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (_stopping) {
+        ::close(fd);
+        break;
+      }
+      // Reaps the threads of closed connections, so long-running shards do not accumulate them
+      auto running = std::partition(_threads.begin(), _threads.end(), [this](const std::thread& thread) {
+        return std::find(_finished.begin(), _finished.end(), thread.get_id()) == _finished.end();
+      });
+      std::move(running, _threads.end(), std::back_inserter(finished));
+      _threads.erase(running, _threads.end());
+      _finished.clear();
+
+      _connections.push_back(fd);
+      _threads.emplace_back(&ShardServer::HandleConnection, this, fd);
+    }
+    for (auto& thread : finished) {
+      thread.join();
+    }
+  }
+}
+
+void ShardServer::Stop() {
+  if (_stopping.exchange(true)) {
+    return;
+  }
+  // Wakes up accept; the descriptor is closed by the destructor, once Serve has returned
+  if (_listen_fd >= 0) {
+    ::shutdown(_listen_fd, SHUT_RDWR);
+  }
+
+  std::vector<std::thread> threads;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (int fd : _connections) {
+      ::shutdown(fd, SHUT_RDWR);
+    }
+    threads = std::move(_threads);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+/**
+ * @brief Runs a request on the local index and converts the IDs to global ones.
+ * Failures are reported in the response instead of closing the connection.
+ * @param request Decoded request.
+ * @return Response with global document IDs.
+ */
+ShardResponse ShardServer::Answer(const ShardRequest& request) {
+  ShardResponse response;
+  try {
+    SearchServer server(_index, static_cast<int>(request.limit));
+    DocumentBitmap allowed;
+    bool filtered = !request.filter.empty();
+    if (filtered) {
+      allowed = _index.MatchDocuments(DocumentFilter::Parse(request.filter));
+    }
+    response.results = server.SearchScores(request.query, filtered ? &allowed : nullptr);
+    for (auto& result : response.results) {
+      result.doc_id += _first_doc_id;
+    }
+  } catch (const std::exception& e) {
+    response.ok = false;
+    response.error = e.what();
+    response.results.clear();
+  }
+  return response;
+}
+
+void ShardServer::HandleConnection(int fd) {
+  std::string payload;
+  while (!_stopping) {
+    // Connections stay open between queries; wait for the next one without a deadline
+    pollfd descriptor{ fd, POLLIN, 0 };
+    int ready = ::poll(&descriptor, 1, 1000);
+    if (ready == 0 || (ready < 0 && errno == EINTR)) {
+      continue;
+    }
+    auto deadline = std::chrono::steady_clock::now() + kFrameTimeout;
+    if (ready < 0 || !ShardProtocol::ReceiveFrame(fd, payload, deadline)) {
+      break;
+    }
+    try {
+      ShardResponse response = Answer(ShardProtocol::DecodeRequest(payload));
+      ShardProtocol::SendFrame(fd, ShardProtocol::EncodeResponse(response));
+    } catch (const std::exception& e) {
+      std::cerr << "Shard connection closed: " << e.what() << std::endl;
+      break;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _connections.erase(std::remove(_connections.begin(), _connections.end(), fd), _connections.end());
+  _finished.push_back(std::this_thread::get_id());
+  ::close(fd);
+}
\ No newline at end of file
@@ -0,0 +1,209 @@
+#include "TextAnalyzer.h"
+#include "TextNormalizer.h"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+namespace {
+
+// Shortest stem left behind by suffix stripping
+constexpr size_t kMinStemLength = 3;
+
+// Displacement seeds tried per bucket before the table is enlarged
+constexpr uint32_t kMaxDisplacement = 1u << 16;
+
+bool EndsWith(std::string_view word, std::string_view suffix) {
+  return word.size() >= suffix.size() && word.substr(word.size() - suffix.size()) == suffix;
+}
+
+bool IsVowel(char c) {
+  return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u' || c == 'y';
+}
+
+bool HasVowel(std::string_view word) {
+  return std::any_of(word.begin(), word.end(), IsVowel);
+}
+
+} // namespace
+
+const std::vector<std::string>& TextAnalyzer::DefaultStopWords() {
+  static const std::vector<std::string> words = {
+    "a", "about", "after", "all", "also", "an", "and", "any", "are", "as", "at", "be", "been",
+    "but", "by", "can", "could", "did", "do", "does", "for", "from", "had", "has", "have", "he",
+    "her", "his", "how", "i", "if", "in", "into", "is", "it", "its", "just", "me", "more", "most",
+    "my", "no", "not", "of", "on", "or", "other", "our", "out", "she", "so", "some", "such",
+    "than", "that", "the", "their", "them", "then", "there", "these", "they", "this", "those",
+    "to", "up", "us", "was", "we", "were", "what", "when", "where", "which", "while", "who",
+    "will", "with", "would", "you", "your"
+  };
+  return words;
+}
+
+/**
+ * @brief 64-bit FNV-1a over the word followed by a splitmix64 finalizer.
+ */
+uint64_t TextAnalyzer::Hash(std::string_view word, uint64_t seed) {
+  uint64_t hash = 14695981039346656037ull ^ (seed * 0x9E3779B97F4A7C15ull);
+  for (char c : word) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ull;
+  }
+  hash ^= hash >> 30;
+  hash *= 0xBF58476D1CE4E5B9ull;
+  hash ^= hash >> 27;
+  hash *= 0x94D049BB133111EBull;
+  hash ^= hash >> 31;
+  return hash;
+}
+
+/**
+ * @brief Builds a minimal perfect hash over the stop words (hash and displace).
+ * Words are grouped into buckets by a first hash; buckets are placed largest first
+ * by searching, per bucket, for a seed that sends all its words to free slots.
+ * @param words Words to drop during analysis.
+ */
+void TextAnalyzer::SetStopWords(const std::vector<std::string>& words) {
+  std::vector<std::string> normalized;
+  normalized.reserve(words.size());
+  for (const auto& word : words) {
+    std::string clean_word = TextNormalizer::Normalize(word);
+    std::erase(clean_word, ' ');
+    if (!clean_word.empty()) {
+      normalized.push_back(std::move(clean_word));
+    }
+  }
+  std::sort(normalized.begin(), normalized.end());
+  normalized.erase(std::unique(normalized.begin(), normalized.end()), normalized.end());
+
+  stop_words.clear();
+  displacements.clear();
+  stop_word_count = normalized.size();
+  if (normalized.empty()) {
+    return;
+  }
+
+  size_t bucket_count = normalized.size() / 2 + 1;
+  std::vector<std::vector<size_t>> buckets(bucket_count);
+  for (size_t i = 0; i < normalized.size(); ++i) {
+    buckets[Hash(normalized[i], 0) % bucket_count].push_back(i);
+  }
+  std::vector<size_t> order(bucket_count);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&buckets](size_t a, size_t b) {
+    return buckets[a].size() > buckets[b].size();
+  });
+
+  for (size_t slot_count = normalized.size() + normalized.size() / 4 + 1;; slot_count *= 2) {
+    std::vector<std::string> slots(slot_count);
+    std::vector<uint32_t> seeds(bucket_count, 0);
+    bool placed_all = true;
+
+    for (size_t bucket : order) {
+      if (buckets[bucket].empty()) {
+        break;
+      }
+      bool placed = false;
+      std::vector<size_t> candidate;
+      for (uint32_t seed = 1; seed < kMaxDisplacement && !placed; ++seed) {
+        candidate.clear();
+        placed = true;
+        for (size_t word : buckets[bucket]) {
+          size_t slot = Hash(normalized[word], seed) % slot_count;
+          if (!slots[slot].empty() || std::find(candidate.begin(), candidate.end(), slot) != candidate.end()) {
+            placed = false;
+            break;
+          }
+          candidate.push_back(slot);
+        }
+        if (placed) {
+          for (size_t i = 0; i < candidate.size(); ++i) {
+            slots[candidate[i]] = normalized[buckets[bucket][i]];
+          }
+          seeds[bucket] = seed;
+        }
+      }
+      if (!placed) {
+        placed_all = false;
+        break;
+      }
+    }
+
+    if (placed_all) {
+      stop_words = std::move(slots);
+      displacements = std::move(seeds);
+      return;
+    }
+  }
+}
+
+void TextAnalyzer::SetStemming(bool enabled) {
+  stemming = enabled;
+}
+
+size_t TextAnalyzer::StopWordCount() const {
+  return stop_word_count;
+}
+
+bool TextAnalyzer::IsStopWord(std::string_view word) const {
+  if (displacements.empty()) {
+    return false;
+  }
+  uint32_t seed = displacements[Hash(word, 0) % displacements.size()];
+  return stop_words[Hash(word, seed) % stop_words.size()] == word;
+}
+
+/**
+ * @brief Lightweight English stemmer: strips plural, -ed, -ing, -ly and -ness endings.
+ * Only suffixes are removed, so the stem is a prefix of the word.
+ * @param word A normalized word.
+ * @return The stem.
+ */
+std::string_view TextAnalyzer::Stem(std::string_view word) {
+  bool ascii_letters = std::all_of(word.begin(), word.end(), [](char c) { return c >= 'a' && c <= 'z'; });
+  if (!ascii_letters || word.size() <= kMinStemLength) {
+    return word;
+  }
+
+  // Plurals: caresses -> caress, ponies -> poni, cats -> cat
+  if (EndsWith(word, "sses") || EndsWith(word, "ies")) {
+    word.remove_suffix(2);
+  } else if (!EndsWith(word, "ss") && !EndsWith(word, "us") && !EndsWith(word, "is") && EndsWith(word, "s")) {
+    word.remove_suffix(1);
+  }
+
+  // Past tense and gerunds: agreed -> agree, hopping -> hop, jumped -> jump
+  bool stripped_verb_suffix = false;
+  if (EndsWith(word, "eed")) {
+    if (word.size() > kMinStemLength + 1) {
+      word.remove_suffix(1);
+    }
+  } else if (EndsWith(word, "ing") && word.size() >= kMinStemLength + 3 && HasVowel(word.substr(0, word.size() - 3))) {
+    word.remove_suffix(3);
+    stripped_verb_suffix = true;
+  } else if (EndsWith(word, "ed") && word.size() >= kMinStemLength + 2 && HasVowel(word.substr(0, word.size() - 2))) {
+    word.remove_suffix(2);
+    stripped_verb_suffix = true;
+  }
+  if (stripped_verb_suffix && word.size() > kMinStemLength) {
+    char last = word.back();
+    if (last == word[word.size() - 2] && !IsVowel(last) && last != 'l' && last != 's' && last != 'z') {
+      word.remove_suffix(1);
+    }
+  }
+
+  // Derivational endings: quickly -> quick, darkness -> dark
+  if (EndsWith(word, "ness") && word.size() >= kMinStemLength + 4) {
+    word.remove_suffix(4);
+  } else if (EndsWith(word, "ly") && word.size() >= kMinStemLength + 2) {
+    word.remove_suffix(2);
+  }
+
+  return word;
+}
+
+std::string_view TextAnalyzer::Analyze(std::string_view word) const {
+  if (word.empty() || IsStopWord(word)) {
+    return {};
+  }
+  return stemming ? Stem(word) : word;
+}
@@ -0,0 +1,436 @@
+#include "TextNormalizer.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SEARCH_ENGINE_X86_KERNELS 1
+#include <immintrin.h>
+#else
+#define SEARCH_ENGINE_X86_KERNELS 0
+#endif
+
+namespace {
+
+struct CodePointRange {
+  char32_t first;
+  char32_t last;
+};
+
+/**
+ * @brief Case folding rule: code points in [first, last] whose offset from first is a
+ * multiple of stride map to code_point + delta.
+ */
+struct FoldRange {
+  char32_t first;
+  char32_t last;
+  int32_t delta;
+  uint32_t stride;
+};
+
+// Non-ASCII code points treated as letters or digits, sorted and non-overlapping.
+constexpr CodePointRange kAlnumRanges[] = {
+  {0x00AA, 0x00AA}, {0x00B5, 0x00B5}, {0x00BA, 0x00BA}, {0x00C0, 0x00D6},
+  {0x00D8, 0x00F6}, {0x00F8, 0x02AF}, {0x0370, 0x0373}, {0x0376, 0x0377},
+  {0x037B, 0x037D}, {0x037F, 0x037F}, {0x0386, 0x0386}, {0x0388, 0x038A},
+  {0x038C, 0x038C}, {0x038E, 0x03A1}, {0x03A3, 0x03F5}, {0x03F7, 0x0481},
+  {0x048A, 0x052F}, {0x0531, 0x0556}, {0x0560, 0x0588}, {0x05D0, 0x05EA},
+  {0x0620, 0x064A}, {0x0660, 0x0669}, {0x0671, 0x06D3}, {0x06F0, 0x06F9},
+  {0x0900, 0x0963}, {0x0966, 0x096F}, {0x0E01, 0x0E3A}, {0x0E40, 0x0E4E},
+  {0x0E50, 0x0E59}, {0x10D0, 0x10FA}, {0x1E00, 0x1EFF}, {0x2126, 0x2126},
+  {0x212A, 0x212B}, {0x3041, 0x3096}, {0x30A1, 0x30FA}, {0x3400, 0x4DBF},
+  {0x4E00, 0x9FFF}, {0xAC00, 0xD7A3}, {0xFF10, 0xFF19}, {0xFF21, 0xFF3A},
+  {0xFF41, 0xFF5A},
+};
+
+// Case folding for the scripts above, restricted to mappings that do not lengthen the
+// UTF-8 encoding. The rules follow CaseFolding.txt status C and S, except U+0130, which
+// has only a Turkic (T) and a full (F) mapping: it folds to plain i, the first code point
+// of the full mapping, so that dotted capital I matches i outside Turkish text as well.
+constexpr FoldRange kFoldRanges[] = {
+  {0x00B5, 0x00B5, 775, 1},     // micro sign -> greek mu
+  {0x00C0, 0x00D6, 32, 1},
+  {0x00D8, 0x00DE, 32, 1},
+  {0x0100, 0x012F, 1, 2},
+  {0x0130, 0x0130, -199, 1},    // capital I with dot -> i
+  {0x0132, 0x0137, 1, 2},
+  {0x0139, 0x0148, 1, 2},
+  {0x014A, 0x0177, 1, 2},
+  {0x0178, 0x0178, -121, 1},    // capital Y with diaeresis
+  {0x0179, 0x017E, 1, 2},
+  {0x017F, 0x017F, -268, 1},    // long s -> s
+  {0x01CD, 0x01DC, 1, 2},
+  {0x01DE, 0x01EF, 1, 2},
+  {0x01F8, 0x021F, 1, 2},
+  {0x0222, 0x0233, 1, 2},
+  {0x0386, 0x0386, 38, 1},
+  {0x0388, 0x038A, 37, 1},
+  {0x038C, 0x038C, 64, 1},
+  {0x038E, 0x038F, 63, 1},
+  {0x0391, 0x03A1, 32, 1},
+  {0x03A3, 0x03AB, 32, 1},
+  {0x03C2, 0x03C2, 1, 1},       // final sigma -> sigma
+  {0x0400, 0x040F, 80, 1},
+  {0x0410, 0x042F, 32, 1},
+  {0x0460, 0x0481, 1, 2},
+  {0x048A, 0x04BF, 1, 2},
+  {0x04C0, 0x04C0, 15, 1},
+  {0x04C1, 0x04CE, 1, 2},
+  {0x04D0, 0x052F, 1, 2},
+  {0x0531, 0x0556, 48, 1},
+  {0x1E00, 0x1E95, 1, 2},
+  {0x1E9E, 0x1E9E, -7615, 1},   // capital sharp s -> sharp s
+  {0x1EA0, 0x1EFF, 1, 2},
+  {0x2126, 0x2126, -7517, 1},   // ohm sign -> omega
+  {0x212A, 0x212A, -8383, 1},   // kelvin sign -> k
+  {0x212B, 0x212B, -8262, 1},   // angstrom sign -> a with ring
+  {0xFF21, 0xFF3A, 32, 1},
+};
+
+// U+00A0 separates words like ASCII whitespace; InvertedIndex maps it back the same way
+constexpr char32_t kNoBreakSpace = 0x00A0;
+
+// Direct lookup tables for code points with 1- and 2-byte encodings, which
+// cover Latin, Greek, Cyrillic, Armenian, Hebrew and Arabic text.
+constexpr char32_t kTableSize = 0x800;
+
+struct SmallCodePointTables {
+  std::array<bool, kTableSize> alnum{};
+  std::array<char16_t, kTableSize> fold{};
+
+  SmallCodePointTables() {
+    for (char32_t cp = 0; cp < kTableSize; ++cp) {
+      alnum[cp] = TextNormalizer::IsAlnum(cp);
+      fold[cp] = static_cast<char16_t>(TextNormalizer::FoldCase(cp));
+    }
+  }
+};
+
+const SmallCodePointTables& SmallTables() {
+  static const SmallCodePointTables tables;
+  return tables;
+}
+
+// ASCII classes: 0 = dropped, 1 = whitespace separator, 2 = letter or digit
+constexpr std::array<uint8_t, 128> kAsciiClass = [] {
+  std::array<uint8_t, 128> classes{};
+  for (int c = '0'; c <= '9'; ++c) classes[c] = 2;
+  for (int c = 'a'; c <= 'z'; ++c) classes[c] = 2;
+  for (int c = 'A'; c <= 'Z'; ++c) classes[c] = 2;
+  for (char c : { ' ', '\t', '\n', '\v', '\f', '\r' }) classes[static_cast<uint8_t>(c)] = 1;
+  return classes;
+}();
+
+inline char* EmitAscii(unsigned char c, char* out) {
+  switch (kAsciiClass[c]) {
+    case 1:
+      *out++ = ' ';
+      break;
+    case 2:
+      *out++ = static_cast<char>(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+      break;
+    default:
+      break;
+  }
+  return out;
+}
+
+inline char* EncodeUtf8(char32_t cp, char* out) {
+  if (cp < 0x80) {
+    *out++ = static_cast<char>(cp);
+  } else if (cp < 0x800) {
+    *out++ = static_cast<char>(0xC0 | (cp >> 6));
+    *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    *out++ = static_cast<char>(0xE0 | (cp >> 12));
+    *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+  } else {
+    *out++ = static_cast<char>(0xF0 | (cp >> 18));
+    *out++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+    *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+  }
+  return out;
+}
+
+/**
+ * @brief Decodes one multibyte UTF-8 sequence and emits its folded form if it is alnum,
+ * or a space for a no-break space.
+ * Malformed sequences (bad continuation, overlong, surrogate, out of range) drop one byte.
+ * @return Number of input bytes consumed.
+ */
+size_t EmitMultibyte(const unsigned char* in, size_t available, char*& out) {
+  unsigned char lead = in[0];
+  size_t length = 0;
+  char32_t cp = 0;
+  char32_t min_value = 0;
+
+  if (lead >= 0xC2 && lead <= 0xDF) {
+    length = 2; cp = lead & 0x1F; min_value = 0x80;
+  } else if (lead >= 0xE0 && lead <= 0xEF) {
+    length = 3; cp = lead & 0x0F; min_value = 0x800;
+  } else if (lead >= 0xF0 && lead <= 0xF4) {
+    length = 4; cp = lead & 0x07; min_value = 0x10000;
+  } else {
+    return 1;
+  }
+
+  if (length > available) {
+    return 1;
+  }
+  for (size_t i = 1; i < length; ++i) {
+    if ((in[i] & 0xC0) != 0x80) {
+      return 1;
+    }
+    cp = (cp << 6) | (in[i] & 0x3F);
+  }
+  if (cp < min_value || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+    return 1;
+  }
+
+  if (cp == kNoBreakSpace) {
+    *out++ = ' ';
+  } else if (cp < kTableSize) {
+    const auto& tables = SmallTables();
+    if (tables.alnum[cp]) {
+      out = EncodeUtf8(tables.fold[cp], out);
+    }
+  } else if (TextNormalizer::IsAlnum(cp)) {
+    out = EncodeUtf8(TextNormalizer::FoldCase(cp), out);
+  }
+  return length;
+}
+
+/**
+ * @brief Scalar reference kernel.
+ * @return End of the written output.
+ */
+char* NormalizeScalar(const unsigned char* in, size_t size, char* out) {
+  size_t i = 0;
+  while (i < size) {
+    if (in[i] < 0x80) {
+      out = EmitAscii(in[i], out);
+      ++i;
+    } else {
+      i += EmitMultibyte(in + i, size - i, out);
+    }
+  }
+  return out;
+}
+
+#if SEARCH_ENGINE_X86_KERNELS
+
+/**
+ * @brief Writes the bytes of a 16-byte block selected by a keep mask.
+ * Fully kept blocks are copied at once, others are compacted without branches.
+ */
+inline char* CompactBlock(const char* lowered, uint32_t keep_mask, char* out) {
+  if ((keep_mask & 0xFFFF) == 0xFFFF) {
+    std::memcpy(out, lowered, 16);
+    return out + 16;
+  }
+  for (int i = 0; i < 16; ++i) {
+    *out = lowered[i];
+    out += (keep_mask >> i) & 1;
+  }
+  return out;
+}
+
+/**
+ * @brief Handles a block containing non-ASCII bytes: everything up to the first
+ * multibyte sequence goes through the ASCII path, then one sequence is decoded.
+ * @return Number of input bytes consumed.
+ */
+inline size_t ProcessMixedBlock(const unsigned char* in, size_t available, uint32_t high_mask, char*& out) {
+  size_t ascii_prefix = static_cast<size_t>(std::countr_zero(high_mask));
+  for (size_t i = 0; i < ascii_prefix; ++i) {
+    out = EmitAscii(in[i], out);
+  }
+  return ascii_prefix + EmitMultibyte(in + ascii_prefix, available - ascii_prefix, out);
+}
+
+/**
+ * @brief SSE2 kernel: classifies and lowercases 16 ASCII bytes per step.
+ * Signed compares are safe because all bytes of an ASCII block are below 0x80.
+ */
+char* NormalizeSSE2(const unsigned char* in, size_t size, char* out) {
+  const __m128i digit_lo = _mm_set1_epi8('0' - 1), digit_hi = _mm_set1_epi8('9' + 1);
+  const __m128i upper_lo = _mm_set1_epi8('A' - 1), upper_hi = _mm_set1_epi8('Z' + 1);
+  const __m128i lower_lo = _mm_set1_epi8('a' - 1), lower_hi = _mm_set1_epi8('z' + 1);
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i ctrl_lo = _mm_set1_epi8('\t' - 1), ctrl_hi = _mm_set1_epi8('\r' + 1);
+  const __m128i case_bit = _mm_set1_epi8(0x20);
+
+  size_t i = 0;
+  while (i + 16 <= size) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+    auto high_mask = static_cast<uint32_t>(_mm_movemask_epi8(block));
+    if (high_mask != 0) {
+      i += ProcessMixedBlock(in + i, size - i, high_mask, out);
+      continue;
+    }
+
+    __m128i is_upper = _mm_and_si128(_mm_cmpgt_epi8(block, upper_lo), _mm_cmpgt_epi8(upper_hi, block));
+    __m128i is_lower = _mm_and_si128(_mm_cmpgt_epi8(block, lower_lo), _mm_cmpgt_epi8(lower_hi, block));
+    __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(block, digit_lo), _mm_cmpgt_epi8(digit_hi, block));
+    __m128i is_space = _mm_or_si128(_mm_cmpeq_epi8(block, space),
+      _mm_and_si128(_mm_cmpgt_epi8(block, ctrl_lo), _mm_cmpgt_epi8(ctrl_hi, block)));
+
+    __m128i lowered = _mm_or_si128(block, _mm_and_si128(is_upper, case_bit));
+    lowered = _mm_or_si128(_mm_andnot_si128(is_space, lowered), _mm_and_si128(is_space, space));
+    __m128i keep = _mm_or_si128(_mm_or_si128(is_upper, is_lower), _mm_or_si128(is_digit, is_space));
+    auto keep_mask = static_cast<uint32_t>(_mm_movemask_epi8(keep));
+
+    if (keep_mask == 0xFFFF) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out), lowered);
+      out += 16;
+    } else {
+      alignas(16) char buffer[16];
+      _mm_store_si128(reinterpret_cast<__m128i*>(buffer), lowered);
+      out = CompactBlock(buffer, keep_mask, out);
+    }
+    i += 16;
+  }
+  return NormalizeScalar(in + i, size - i, out);
+}
+
+/**
+ * @brief AVX2 kernel: same as the SSE2 kernel with 32-byte blocks.
+ */
+__attribute__((target("avx2")))
+char* NormalizeAVX2(const unsigned char* in, size_t size, char* out) {
+  const __m256i digit_lo = _mm256_set1_epi8('0' - 1), digit_hi = _mm256_set1_epi8('9' + 1);
+  const __m256i upper_lo = _mm256_set1_epi8('A' - 1), upper_hi = _mm256_set1_epi8('Z' + 1);
+  const __m256i lower_lo = _mm256_set1_epi8('a' - 1), lower_hi = _mm256_set1_epi8('z' + 1);
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i ctrl_lo = _mm256_set1_epi8('\t' - 1), ctrl_hi = _mm256_set1_epi8('\r' + 1);
+  const __m256i case_bit = _mm256_set1_epi8(0x20);
+
+  size_t i = 0;
+  while (i + 32 <= size) {
+    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+    auto high_mask = static_cast<uint32_t>(_mm256_movemask_epi8(block));
+    if (high_mask != 0) {
+      i += ProcessMixedBlock(in + i, size - i, high_mask, out);
+      continue;
+    }
+
+    __m256i is_upper = _mm256_and_si256(_mm256_cmpgt_epi8(block, upper_lo), _mm256_cmpgt_epi8(upper_hi, block));
+    __m256i is_lower = _mm256_and_si256(_mm256_cmpgt_epi8(block, lower_lo), _mm256_cmpgt_epi8(lower_hi, block));
+    __m256i is_digit = _mm256_and_si256(_mm256_cmpgt_epi8(block, digit_lo), _mm256_cmpgt_epi8(digit_hi, block));
+    __m256i is_space = _mm256_or_si256(_mm256_cmpeq_epi8(block, space),
+      _mm256_and_si256(_mm256_cmpgt_epi8(block, ctrl_lo), _mm256_cmpgt_epi8(ctrl_hi, block)));
+
+    __m256i lowered = _mm256_or_si256(block, _mm256_and_si256(is_upper, case_bit));
+    lowered = _mm256_blendv_epi8(lowered, space, is_space);
+    __m256i keep = _mm256_or_si256(_mm256_or_si256(is_upper, is_lower), _mm256_or_si256(is_digit, is_space));
+    auto keep_mask = static_cast<uint32_t>(_mm256_movemask_epi8(keep));
+
+    if (keep_mask == 0xFFFFFFFFu) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), lowered);
+      out += 32;
+    } else {
+      alignas(32) char buffer[32];
+      _mm256_store_si256(reinterpret_cast<__m256i*>(buffer), lowered);
+      out = CompactBlock(buffer, keep_mask, out);
+      out = CompactBlock(buffer + 16, keep_mask >> 16, out);
+    }
+    i += 32;
+  }
+  return NormalizeSSE2(in + i, size - i, out);
+}
+
+#endif
+
+using KernelFunction = char* (*)(const unsigned char*, size_t, char*);
+
+KernelFunction KernelFor(TextNormalizer::Kernel kernel) {
+  switch (kernel) {
+#if SEARCH_ENGINE_X86_KERNELS
+    case TextNormalizer::Kernel::SSE2: return NormalizeSSE2;
+    case TextNormalizer::Kernel::AVX2: return NormalizeAVX2;
+#endif
+    default: return NormalizeScalar;
+  }
+}
+
+std::string Run(KernelFunction kernel, std::string_view text) {
+  // Folding never lengthens a sequence, so the output fits into the input size
+  std::string result(text.size(), '\0');
+  char* end = kernel(reinterpret_cast<const unsigned char*>(text.data()), text.size(), result.data());
+  result.resize(static_cast<size_t>(end - result.data()));
+  return result;
+}
+
+} // namespace
+
+bool TextNormalizer::IsAlnum(char32_t code_point) {
+  if (code_point < 0x80) {
+    return kAsciiClass[code_point] == 2;
+  }
+  auto it = std::upper_bound(std::begin(kAlnumRanges), std::end(kAlnumRanges), code_point,
+    [](char32_t value, const CodePointRange& range) { return value < range.first; });
+  return it != std::begin(kAlnumRanges) && code_point <= std::prev(it)->last;
+}
+
+char32_t TextNormalizer::FoldCase(char32_t code_point) {
+  if (code_point < 0x80) {
+    return code_point >= 'A' && code_point <= 'Z' ? code_point + ('a' - 'A') : code_point;
+  }
+  auto it = std::upper_bound(std::begin(kFoldRanges), std::end(kFoldRanges), code_point,
+    [](char32_t value, const FoldRange& range) { return value < range.first; });
+  if (it == std::begin(kFoldRanges)) {
+    return code_point;
+  }
+  const FoldRange& range = *std::prev(it);
+  if (code_point > range.last || (code_point - range.first) % range.stride != 0) {
+    return code_point;
+  }
+  return static_cast<char32_t>(static_cast<int32_t>(code_point) + range.delta);
+}
+
+bool TextNormalizer::IsSupported(Kernel kernel) {
+  switch (kernel) {
+    case Kernel::Scalar:
+      return true;
+#if SEARCH_ENGINE_X86_KERNELS
+    case Kernel::SSE2:
+      return __builtin_cpu_supports("sse2");
+    case Kernel::AVX2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+TextNormalizer::Kernel TextNormalizer::ActiveKernel() {
+  static const Kernel active = [] {
+    if (IsSupported(Kernel::AVX2)) return Kernel::AVX2;
+    if (IsSupported(Kernel::SSE2)) return Kernel::SSE2;
+    return Kernel::Scalar;
+  }();
+  return active;
+}
+
+std::string TextNormalizer::Normalize(std::string_view text) {
+  static const KernelFunction kernel = KernelFor(ActiveKernel());
+  return Run(kernel, text);
+}
+
+size_t TextNormalizer::NormalizeInto(std::string_view text, char* out) {
+  static const KernelFunction kernel = KernelFor(ActiveKernel());
+  char* end = kernel(reinterpret_cast<const unsigned char*>(text.data()), text.size(), out);
+  return static_cast<size_t>(end - out);
+}
+
+std::string TextNormalizer::Normalize(std::string_view text, Kernel kernel) {
+  if (!IsSupported(kernel)) {
+    throw std::invalid_argument("Normalization kernel is not supported by this CPU.");
+  }
+  return Run(KernelFor(kernel), text);
+}
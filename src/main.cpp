@@ -1,9 +1,26 @@
 #include <QApplication>
+#include <iostream>
+#include "ConverterJSON.h"
 #include "MainWindow.h"
+#include "Metrics.h"
 
 int main(int argc, char *argv[]) {
   QApplication app(argc, argv);
   MainWindow window;
   window.show();
-  return app.exec();
+  int exit_code = app.exec();
+
+#if SEARCH_ENGINE_METRICS
+  // Dump the per-stage metrics collected during the run
+  try {
+    std::string stats_file = ConverterJSON().GetStatsFile();
+    if (!stats_file.empty()) {
+      Metrics::WriteReport(stats_file);
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "Error writing metrics report: " << e.what() << std::endl;
+  }
+#endif
+
+  return exit_code;
 }
\ No newline at end of file
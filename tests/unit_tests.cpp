@@ -1,7 +1,75 @@
 #include "gtest/gtest.h"
 
+#include "Deduplicator.h"
+#include "DocumentBitmap.h"
+#include "DocumentFilter.h"
+#include "DocumentLoader.h"
+#include "DocumentWatcher.h"
 #include "InvertedIndex.h"
+#include "LoadGenerator.h"
+#include "Metrics.h"
+#include "NumaTopology.h"
+#include "ScratchArena.h"
+#include "SearchCursor.h"
 #include "SearchServer.h"
+#include "ShardCoordinator.h"
+#include "ShardProtocol.h"
+#include "ShardServer.h"
+#include "TextAnalyzer.h"
+#include "TextNormalizer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <random>
+#include <set>
+#include <span>
+#include <sstream>
+#include <thread>
+
+#include <unistd.h>
+
+// GCC pairs the replaced operator delete with new expressions it inlined and warns about free()
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+namespace {
+
+// Allocation-counting hook: counts operator new calls made by any thread while enabled
+std::atomic<bool> count_allocations{false};
+std::atomic<size_t> allocation_count{0};
+
+} // namespace
+
+void* operator new(size_t size) {
+  if (count_allocations.load(std::memory_order_relaxed)) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept {
+  std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+  std::free(pointer);
+}
 
 /**
  * @brief Helper function to test the functionality of InvertedIndex.
@@ -303,3 +371,1452 @@ TEST(SearchServerTest, TestResponsesLimit) {
 
 
 
+TEST(MetricsTest, HistogramPercentiles) {
+  LatencyHistogram histogram;
+  for (uint64_t value = 1; value <= 100000; ++value) {
+    histogram.Record(value * 1000);
+  }
+  ASSERT_EQ(histogram.Count(), 100000u);
+  ASSERT_EQ(histogram.Min(), 1000u);
+  ASSERT_EQ(histogram.Max(), 100000000u);
+  ASSERT_NEAR(histogram.Percentile(50.0), 50000000.0, 50000000.0 * 0.03);
+  ASSERT_NEAR(histogram.Percentile(99.0), 99000000.0, 99000000.0 * 0.03);
+  for (uint64_t value : std::vector<uint64_t>{ 0, 1, 63, 64, 1000, 123456789, UINT64_MAX }) {
+    size_t bucket = LatencyHistogram::BucketIndex(value);
+    ASSERT_LT(bucket, LatencyHistogram::kBucketCount);
+    ASSERT_LE(LatencyHistogram::BucketLowerBound(bucket), value);
+    ASSERT_GE(LatencyHistogram::BucketUpperBound(bucket), value);
+  }
+}
+
+#if SEARCH_ENGINE_METRICS
+TEST(MetricsTest, StagesAreRecorded) {
+  Metrics::SetTimelineSampling(1);
+  Metrics::Reset();
+  InvertedIndex idx;
+  idx.UpdateDocumentBase({ "milk water", "milk sugar", "water" });
+  SearchServer srv(idx);
+  srv.search({ "milk", "water sugar" });
+
+  MetricsSnapshot snapshot = Metrics::Snapshot();
+  ASSERT_EQ(snapshot[Stage::Tokenize].Count(), 3u);
+  ASSERT_EQ(snapshot[Stage::Query].Count(), 2u);
+  ASSERT_EQ(snapshot[Stage::Lookup].Count(), 2u);
+  ASSERT_EQ(snapshot[Stage::Scoring].Count(), 2u);
+  // The stages of a query share their boundaries, so they add up to the whole query exactly
+  ASSERT_EQ(snapshot[Stage::Query].Sum(), snapshot[Stage::Lookup].Sum() + snapshot[Stage::Scoring].Sum());
+  ASSERT_EQ(snapshot[Counter::QueriesProcessed], 2u);
+  ASSERT_EQ(snapshot[Counter::TokensIndexed], 5u);
+  ASSERT_EQ(snapshot[Counter::PostingsScanned], 5u);
+
+  std::ostringstream json;
+  Metrics::WriteJson(json);
+  ASSERT_NE(json.str().find("\"tokenize\": {\"count\": 3"), std::string::npos);
+
+  std::ostringstream prometheus;
+  Metrics::WritePrometheus(prometheus);
+  ASSERT_NE(prometheus.str().find("search_engine_stage_seconds_count{stage=\"query\"} 2"), std::string::npos);
+
+  // A query whose truncated impact list runs out is scored exhaustively, as one scoring sample
+  InvertedIndex impact;
+  impact.SetImpactOrdering({ 2, 1 });
+  impact.UpdateDocumentBase({ "w w", "w", "w", "w" });
+  DocumentBitmap last;
+  last.Add(3);
+  SearchServer impact_server(impact, 5);
+  Metrics::Reset();
+  ASSERT_EQ(impact_server.SearchScores("w", &last).size(), 1u);
+  ASSERT_EQ(Metrics::Snapshot()[Stage::Scoring].Count(), 1u);
+  ASSERT_TRUE(impact_server.Explain("w", &last).impact_fallback);
+
+  // Sampled timelines: every query is counted, one in four is timed
+  Metrics::SetTimelineSampling(4);
+  Metrics::Reset();
+  for (int i = 0; i < 8; ++i) {
+    impact_server.SearchScores("w");
+  }
+  snapshot = Metrics::Snapshot();
+  ASSERT_EQ(snapshot[Counter::QueriesProcessed], 8u);
+  ASSERT_EQ(snapshot[Stage::Query].Count(), 2u);
+  ASSERT_EQ(snapshot[Stage::Scoring].Count(), 2u);
+  ASSERT_THROW(Metrics::SetTimelineSampling(0), std::invalid_argument);
+  Metrics::SetTimelineSampling(Metrics::kDefaultTimelineSampling);
+}
+
+TEST(MetricsTest, ResetWhileRecording) {
+  std::atomic<uint64_t> added{0};
+  std::atomic<bool> stopping{false};
+  std::thread writer([&]() {
+    while (!stopping) {
+      Metrics::Add(Counter::BytesRead, 1);
+      added.fetch_add(1);
+    }
+  });
+  // A reset is never undone by a write in flight, so only adds made after it are counted
+  for (int i = 0; i < 2000; ++i) {
+    uint64_t before = added.load();
+    Metrics::Reset();
+    uint64_t counted = Metrics::Snapshot()[Counter::BytesRead];
+    ASSERT_LE(counted, added.load() - before + 1);
+  }
+  stopping = true;
+  writer.join();
+  Metrics::Reset();
+  ASSERT_EQ(Metrics::Snapshot()[Counter::BytesRead], 0u);
+}
+#endif
+
+TEST(TestCaseInvertedIndex, TestMemoryUsage) {
+  InvertedIndex idx;
+  idx.UpdateDocumentBase({ "milk water", "milk sugar" });
+  IndexMemoryUsage small = idx.GetMemoryUsage();
+  ASSERT_GT(small.dictionary_bytes, 0u);
+  ASSERT_GE(small.postings_bytes, 4 * sizeof(Entry));
+  ASSERT_GE(small.documents_bytes, 2 * sizeof(std::string));
+
+  idx.UpdateDocumentBase({ std::string(1000, 'x') + " milk water", "milk sugar tea coffee" });
+  IndexMemoryUsage large = idx.GetMemoryUsage();
+  ASSERT_GT(large.dictionary_bytes, small.dictionary_bytes);
+  ASSERT_GT(large.postings_bytes, small.postings_bytes);
+  ASSERT_GT(large.documents_bytes, small.documents_bytes + 1000);
+  ASSERT_EQ(large.Total(), large.dictionary_bytes + large.postings_bytes + large.documents_bytes);
+}
+
+TEST(TestCaseInvertedIndex, TestSpillToDisk) {
+  std::vector<std::string> docs;
+  for (size_t i = 0; i < 2000; ++i) {
+    docs.push_back("common word" + std::to_string(i % 97) + " rare" + std::to_string(i) + " common");
+  }
+
+  InvertedIndex in_memory;
+  in_memory.UpdateDocumentBase(docs);
+
+  InvertedIndex spilled;
+  spilled.SetMemoryLimit(4096);
+  spilled.UpdateDocumentBase(docs);
+  ASSERT_GT(spilled.GetSpilledRunCount(), 1u);
+  ASSERT_EQ(in_memory.GetSpilledRunCount(), 0u);
+
+  for (const std::string word : { "common", "word5", "word96", "rare0", "rare1999", "missing" }) {
+    ASSERT_EQ(spilled.GetWordCount(word), in_memory.GetWordCount(word)) << word;
+  }
+
+  // The merged postings are served from disk, so only the dictionary stays in memory
+  IndexMemoryUsage spilled_usage = spilled.GetMemoryUsage();
+  IndexMemoryUsage in_memory_usage = in_memory.GetMemoryUsage();
+  ASSERT_EQ(spilled_usage.postings_bytes, 0u);
+  ASSERT_EQ(in_memory_usage.disk_postings_bytes, 0u);
+  ASSERT_EQ(spilled_usage.disk_postings_bytes, 2000 * 3 * sizeof(Entry));
+  ASSERT_LT(spilled_usage.Total(), in_memory_usage.Total());
+
+  const std::vector<std::string> requests = { "common", "word5 rare17", "rare1999 word3", "missing" };
+  ASSERT_EQ(SearchServer(spilled, 5).search(requests), SearchServer(in_memory, 5).search(requests));
+
+  // Updated terms move back to memory; the others keep being read from disk
+  const std::vector<DocumentUpdate> updates = { { 5, "word5 word5 fresh" }, { 2000, "rare0 fresh" } };
+  spilled.UpdateDocuments(updates);
+  in_memory.UpdateDocuments(updates);
+  for (const std::string word : { "common", "word5", "word96", "rare0", "rare5", "fresh" }) {
+    ASSERT_EQ(spilled.GetWordCount(word), in_memory.GetWordCount(word)) << word;
+  }
+  ASSERT_GT(spilled.GetMemoryUsage().postings_bytes, 0u);
+  ASSERT_LT(spilled.GetMemoryUsage().disk_postings_bytes, spilled_usage.disk_postings_bytes);
+  ASSERT_EQ(SearchServer(spilled, 5).search(requests), SearchServer(in_memory, 5).search(requests));
+
+  // The budget is checked after every document: a budget smaller than one document
+  // spills after at most one document per indexing thread
+  std::vector<std::string> few_docs(docs.begin(), docs.begin() + 100);
+  InvertedIndex per_document;
+  per_document.SetMemoryLimit(1);
+  per_document.SetDeduplication(true, 0);
+  per_document.UpdateDocumentBase(few_docs);
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  ASSERT_GE(per_document.GetSpilledRunCount(), few_docs.size() / threads);
+  InvertedIndex few_in_memory;
+  few_in_memory.SetDeduplication(true, 0);
+  few_in_memory.UpdateDocumentBase(few_docs);
+  for (const std::string word : { "common", "word5", "rare0", "rare99" }) {
+    ASSERT_EQ(per_document.GetWordCount(word), few_in_memory.GetWordCount(word)) << word;
+  }
+}
+
+TEST(TestCaseInvertedIndex, TestCyrillic) {
+  const std::vector<std::string> docs = {
+    "Привет, мир! Москва — столица России.",
+    "МОСКВА москва Moscow",
+    "Ёжик в тумане"
+};
+  const std::vector<std::string> requests = { "москва", "МИР", "ёжик", "moscow" };
+  const std::vector<std::vector<Entry>> expected = {
+    { {0, 1}, {1, 2} },
+    { {0, 1} },
+    { {2, 1} },
+    { {1, 1} }
+  };
+  TestInvertedIndexFunctionality(docs, requests, expected);
+}
+
+/**
+ * @brief Compares every supported SIMD kernel against the scalar reference on fuzzed input.
+ */
+TEST(TextNormalizerTest, KernelsMatchScalarReference) {
+  const std::vector<std::string> pieces = {
+    "Hello", "WORLD", "42", " ", "\t", "\n", ",", "...", "-", "Привет", "ЁЖ", "Straße", "ΣΊΣΥΦΟΣ",
+    "ẞ", "Ω", "İ", "\u00A0", "日本語", "\xF0\x9F\x98\x80", "\xC3", "\xE2\x82", "\xFF", "\xC0\xAF", "\xED\xA0\x80"
+  };
+  std::mt19937 rng(12345);
+  std::uniform_int_distribution<size_t> piece(0, pieces.size() - 1);
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::uniform_int_distribution<int> length(0, 120);
+
+  for (int iteration = 0; iteration < 2000; ++iteration) {
+    std::string text;
+    int parts = length(rng);
+    for (int i = 0; i < parts; ++i) {
+      if (i % 7 == 3) {
+        text += static_cast<char>(byte(rng));
+      } else {
+        text += pieces[piece(rng)];
+      }
+    }
+
+    std::string reference = TextNormalizer::Normalize(text, TextNormalizer::Kernel::Scalar);
+    for (auto kernel : { TextNormalizer::Kernel::SSE2, TextNormalizer::Kernel::AVX2 }) {
+      if (TextNormalizer::IsSupported(kernel)) {
+        ASSERT_EQ(TextNormalizer::Normalize(text, kernel), reference);
+      }
+    }
+    ASSERT_EQ(TextNormalizer::Normalize(text), reference);
+  }
+}
+
+TEST(TextNormalizerTest, CaseFolding) {
+  ASSERT_EQ(TextNormalizer::Normalize("Hello, World! 2024"), "hello world 2024");
+  ASSERT_EQ(TextNormalizer::Normalize("ПРИВЕТ Мир"), "привет мир");
+  ASSERT_EQ(TextNormalizer::Normalize("ΣΊΣΥΦΟΣ ς"), "σίσυφοσ σ");
+  ASSERT_EQ(TextNormalizer::Normalize("STRAẞE Straße"), "straße straße");
+  ASSERT_EQ(TextNormalizer::Normalize("a\xFF" "b\xC3"), "ab");
+  ASSERT_EQ(TextNormalizer::Normalize("İSTANBUL"), "istanbul");
+  ASSERT_EQ(TextNormalizer::Normalize("10\u00A0km, New\u00A0York"), "10 km new york");
+  ASSERT_EQ(TextNormalizer::Normalize(std::string(40, 'A') + "!" + std::string(40, 'z')),
+            std::string(40, 'a') + std::string(40, 'z'));
+}
+
+TEST(TextAnalyzerTest, StopWordPerfectHash) {
+  TextAnalyzer analyzer;
+  analyzer.SetStopWords(TextAnalyzer::DefaultStopWords());
+  ASSERT_EQ(analyzer.StopWordCount(), TextAnalyzer::DefaultStopWords().size());
+  for (const auto& word : TextAnalyzer::DefaultStopWords()) {
+    ASSERT_TRUE(analyzer.IsStopWord(word)) << word;
+  }
+  for (const std::string word : { "milk", "london", "th", "thee", "", "capital" }) {
+    ASSERT_FALSE(analyzer.IsStopWord(word)) << word;
+  }
+
+  analyzer.SetStopWords({ "Foo", "BAR", "foo" });
+  ASSERT_EQ(analyzer.StopWordCount(), 2u);
+  ASSERT_TRUE(analyzer.IsStopWord("foo"));
+  ASSERT_TRUE(analyzer.IsStopWord("bar"));
+  ASSERT_FALSE(analyzer.IsStopWord("the"));
+}
+
+TEST(TextAnalyzerTest, Stemming) {
+  ASSERT_EQ(TextAnalyzer::Stem("caresses"), "caress");
+  ASSERT_EQ(TextAnalyzer::Stem("ponies"), "poni");
+  ASSERT_EQ(TextAnalyzer::Stem("cats"), "cat");
+  ASSERT_EQ(TextAnalyzer::Stem("glass"), "glass");
+  ASSERT_EQ(TextAnalyzer::Stem("agreed"), "agree");
+  ASSERT_EQ(TextAnalyzer::Stem("hopping"), "hop");
+  ASSERT_EQ(TextAnalyzer::Stem("jumped"), "jump");
+  ASSERT_EQ(TextAnalyzer::Stem("falling"), "fall");
+  ASSERT_EQ(TextAnalyzer::Stem("quickly"), "quick");
+  ASSERT_EQ(TextAnalyzer::Stem("darkness"), "dark");
+  ASSERT_EQ(TextAnalyzer::Stem("sing"), "sing");
+  ASSERT_EQ(TextAnalyzer::Stem("москвы"), "москвы");
+}
+
+TEST(TestCaseSearchServer, TestAnalysisStage) {
+  const std::vector<std::string> docs = {
+    "the cat is jumping over the dogs",
+    "a dog jumped and the cats watched",
+    "the the the the"
+};
+  TextAnalyzer analyzer;
+  analyzer.SetStopWords(TextAnalyzer::DefaultStopWords());
+  analyzer.SetStemming(true);
+
+  InvertedIndex idx;
+  idx.SetAnalyzer(analyzer);
+  idx.UpdateDocumentBase(docs);
+  ASSERT_TRUE(idx.GetWordCount("the").empty());
+  ASSERT_EQ(idx.GetWordCount("jumps"), (std::vector<Entry>{ {0, 1}, {1, 1} }));
+
+  SearchServer srv(idx);
+  const std::vector<std::vector<RelativeIndex>> expected = {
+    { {0, 1}, {1, 1} },
+    {}
+  };
+  ASSERT_EQ(srv.search({ "The Dog jumps", "the and of" }), expected);
+}
+
+/**
+ * @brief Reports index size and average query time with and without the analysis stage.
+ */
+TEST(SearchServerTest, AnalysisStageShrinksIndex) {
+  std::mt19937 rng(7);
+  const auto& stop_words = TextAnalyzer::DefaultStopWords();
+  std::uniform_int_distribution<size_t> stop_word(0, stop_words.size() - 1);
+  std::uniform_int_distribution<int> content_word(0, 5000);
+  std::vector<std::string> docs(5000);
+  for (auto& doc : docs) {
+    for (int i = 0; i < 60; ++i) {
+      doc += (i % 2 == 0 ? stop_words[stop_word(rng)] : "term" + std::to_string(content_word(rng))) + " ";
+    }
+  }
+  std::vector<std::string> requests, content_requests;
+  for (int i = 0; i < 200; ++i) {
+    std::string first = "term" + std::to_string(content_word(rng));
+    std::string second = "term" + std::to_string(content_word(rng));
+    requests.push_back("the " + first + " of and " + second);
+    content_requests.push_back(first + " " + second);
+  }
+
+  InvertedIndex plain;
+  plain.UpdateDocumentBase(docs);
+  InvertedIndex analyzed;
+  TextAnalyzer analyzer;
+  analyzer.SetStopWords(stop_words);
+  analyzed.SetAnalyzer(analyzer);
+  analyzed.UpdateDocumentBase(docs);
+
+  // Stop-word postings are dropped and every other postings list is kept as is
+  size_t plain_postings = 0;
+  size_t stop_word_postings = 0;
+  for (const auto& word : stop_words) {
+    stop_word_postings += plain.GetWordCount(word).size();
+    ASSERT_TRUE(analyzed.GetWordCount(word).empty()) << word;
+  }
+  plain_postings += stop_word_postings;
+  for (int word = 0; word <= 5000; ++word) {
+    std::string term = "term" + std::to_string(word);
+    std::vector<Entry> postings = plain.GetWordCount(term);
+    plain_postings += postings.size();
+    ASSERT_EQ(analyzed.GetWordCount(term), postings) << term;
+  }
+  // Half the words are stop words; some repeat within a document, which leaves them over 40% of the postings
+  ASSERT_GT(stop_word_postings * 5, plain_postings * 2);
+  ASSERT_LT(analyzed.GetMemoryUsage().postings_bytes * 5, plain.GetMemoryUsage().postings_bytes * 3);
+
+  // Stop words are dropped from queries as well, so they no longer change the results
+  ASSERT_EQ(SearchServer(analyzed).search(requests), SearchServer(plain).search(content_requests));
+}
+
+TEST(TestCaseInvertedIndex, TestDeduplication) {
+  const std::vector<std::string> docs = {
+    "milk water sugar coffee tea bread butter cheese honey jam",
+    "Milk, water; sugar coffee tea bread butter cheese honey jam!",
+    "milk water sugar coffee tea bread butter cheese honey jam milk",
+    "americano cappuccino latte espresso",
+    "milk"
+};
+  InvertedIndex idx;
+  idx.SetDeduplication(true, 8);
+  idx.UpdateDocumentBase(docs);
+
+  ASSERT_EQ(idx.GetCanonicalId(1), 0u);
+  ASSERT_EQ(idx.GetCanonicalId(2), 0u);
+  ASSERT_EQ(idx.GetCanonicalId(3), 3u);
+  ASSERT_EQ(idx.GetAliases(0), (std::vector<size_t>{ 1, 2 }));
+  ASSERT_TRUE(idx.GetAliases(3).empty());
+  ASSERT_EQ(idx.GetWordCount("milk"), (std::vector<Entry>{ {0, 1}, {4, 1} }));
+
+  DeduplicationStats stats = idx.GetDeduplicationStats();
+  ASSERT_EQ(stats.exact_duplicates, 1u);
+  ASSERT_EQ(stats.near_duplicates, 1u);
+  ASSERT_EQ(stats.postings_saved, 20u);
+
+  // Updates regroup the duplicates; the rebuilt index is swapped in with the new texts
+  idx.UpdateDocuments({ { 3, "milk" }, { 5, "americano latte" } });
+  ASSERT_EQ(idx.DocumentCount(), 6u);
+  ASSERT_EQ(idx.GetCanonicalId(4), 3u);
+  ASSERT_EQ(idx.GetAliases(0), (std::vector<size_t>{ 1, 2 }));
+  ASSERT_EQ(idx.GetWordCount("milk"), (std::vector<Entry>{ {0, 1}, {3, 1} }));
+  ASSERT_EQ(idx.GetWordCount("americano"), (std::vector<Entry>{ {5, 1} }));
+  ASSERT_EQ(idx.GetDocumentText(3), "milk");
+  ASSERT_EQ(idx.GetDocumentText(5), "americano latte");
+}
+
+TEST(SearchServerTest, MetadataFilterMatchesDuplicates) {
+  const std::vector<std::string> docs = {
+    "milk water sugar coffee tea bread butter cheese honey jam",
+    "Milk, water; sugar coffee tea bread butter cheese honey jam!",
+    "americano cappuccino latte espresso"
+};
+  InvertedIndex idx;
+  idx.SetDeduplication(true, 0);
+  idx.SetDocumentMetadata({ { { "type", "md" } }, { { "type", "txt" } }, { { "type", "md" } } });
+  idx.UpdateDocumentBase(docs);
+  ASSERT_EQ(idx.GetCanonicalId(1), 0u);
+
+  // Only the duplicate is a txt file, but its text is indexed under document 0
+  DocumentFilter txt = DocumentFilter::Parse("type:txt");
+  ASSERT_TRUE(idx.MatchDocuments(txt).Contains(0));
+  ASSERT_FALSE(idx.MatchDocuments(txt).Contains(2));
+  SearchServer server(idx, 5);
+  auto result = server.search({ "milk", "latte" }, txt);
+  ASSERT_EQ(result[0].size(), 1u);
+  ASSERT_EQ(result[0][0].doc_id, 0u);
+  ASSERT_TRUE(result[1].empty());
+  ASSERT_EQ(server.search({ "milk" }, DocumentFilter::Parse("type:pdf"))[0].size(), 0u);
+}
+
+TEST(DeduplicatorTest, SimHashDistance) {
+  std::vector<std::string> words;
+  for (int i = 0; i < 200; ++i) {
+    words.push_back("word" + std::to_string(i));
+  }
+  auto fingerprint = [](const std::vector<std::string>& terms) {
+    std::pmr::unordered_map<std::string_view, size_t> counts;
+    std::string text;
+    for (const auto& term : terms) {
+      ++counts[term];
+      text += term + " ";
+    }
+    return Deduplicator::Fingerprint(text, counts);
+  };
+
+  DocumentFingerprint original = fingerprint(words);
+  std::vector<std::string> edited = words;
+  edited[10] = "changed";
+  DocumentFingerprint near = fingerprint(edited);
+  DocumentFingerprint other = fingerprint(std::vector<std::string>(words.begin(), words.begin() + 20));
+
+  ASSERT_NE(original.content_hash, near.content_hash);
+  ASSERT_LE(std::popcount(original.simhash ^ near.simhash), 6);
+  ASSERT_GT(std::popcount(original.simhash ^ other.simhash), 6);
+
+  Deduplicator deduplicator(6);
+  ASSERT_EQ(deduplicator.Add(0, original), 0u);
+  ASSERT_EQ(deduplicator.Add(1, other), 1u);
+  ASSERT_EQ(deduplicator.Add(2, near), 0u);
+  ASSERT_EQ(deduplicator.Add(3, original), 0u);
+}
+
+/**
+ * @brief Reports the space and query time saved by collapsing duplicates.
+ */
+TEST(SearchServerTest, DeduplicationCollapsesCopies) {
+  std::mt19937 rng(11);
+  std::uniform_int_distribution<int> word(0, 3000);
+  std::vector<std::string> unique_docs(500);
+  for (auto& doc : unique_docs) {
+    for (int i = 0; i < 80; ++i) {
+      doc += "term" + std::to_string(word(rng)) + " ";
+    }
+  }
+  // Every document appears four times: as is, re-cased, and with one or two words appended
+  std::vector<std::string> docs;
+  for (const auto& doc : unique_docs) {
+    std::string upper = doc;
+    std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+    docs.insert(docs.end(), { doc, upper, doc + "extra", doc + "extra more" });
+  }
+  std::vector<std::string> requests;
+  for (int i = 0; i < 200; ++i) {
+    requests.push_back("term" + std::to_string(word(rng)) + " term" + std::to_string(word(rng)));
+  }
+
+  InvertedIndex plain;
+  plain.UpdateDocumentBase(docs);
+  InvertedIndex deduplicated;
+  deduplicated.SetDeduplication(true, 6);
+  deduplicated.UpdateDocumentBase(docs);
+
+  // Re-cased copies are exact after normalization; SimHash catches most appended copies
+  DeduplicationStats stats = deduplicated.GetDeduplicationStats();
+  ASSERT_EQ(stats.exact_duplicates, 500u);
+  ASSERT_GE(stats.near_duplicates, 900u);
+  ASSERT_GE((stats.exact_duplicates + stats.near_duplicates) * 10, docs.size() * 7);
+  // A copy collapses into an earlier copy of the same document, never into another document
+  for (size_t doc_id = 0; doc_id < docs.size(); ++doc_id) {
+    size_t canonical_id = deduplicated.GetCanonicalId(doc_id);
+    ASSERT_LE(canonical_id, doc_id);
+    ASSERT_EQ(canonical_id / 4, doc_id / 4) << doc_id;
+  }
+
+  // The postings of every collapsed copy are saved
+  size_t plain_postings = 0;
+  size_t deduplicated_postings = 0;
+  for (int term = 0; term <= 3000; ++term) {
+    plain_postings += plain.GetWordCount("term" + std::to_string(term)).size();
+    deduplicated_postings += deduplicated.GetWordCount("term" + std::to_string(term)).size();
+  }
+  for (const std::string term : { "extra", "more" }) {
+    plain_postings += plain.GetWordCount(term).size();
+    deduplicated_postings += deduplicated.GetWordCount(term).size();
+  }
+  ASSERT_EQ(plain_postings - deduplicated_postings, stats.postings_saved);
+  ASSERT_LT(deduplicated.GetMemoryUsage().postings_bytes * 3, plain.GetMemoryUsage().postings_bytes);
+
+  // Queries only return canonical documents, so copies no longer crowd out other hits
+  for (const auto& answer : SearchServer(deduplicated, 5).search(requests)) {
+    for (const auto& hit : answer) {
+      ASSERT_EQ(deduplicated.GetCanonicalId(hit.doc_id), hit.doc_id);
+    }
+  }
+}
+
+TEST(DocumentLoaderTest, LoadsFilesConcurrently) {
+  const std::vector<std::string> docs = {
+    "milk milk milk milk water water water",
+    "milk water water",
+    "",
+    "milk milk milk milk milk water water water water water",
+    "americano cappuccino"
+};
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "search_engine_loader_test";
+  std::filesystem::create_directories(dir);
+  std::vector<std::string> paths;
+  for (size_t i = 0; i < docs.size(); ++i) {
+    paths.push_back((dir / ("file" + std::to_string(i) + ".txt")).string());
+    std::ofstream(paths.back(), std::ios::binary) << docs[i];
+  }
+  paths.insert(paths.begin() + 2, (dir / "missing.txt").string());
+
+  DocumentLoader loader(3);
+  auto mapped = std::make_shared<MappedDocuments>(loader.Load(paths));
+  ASSERT_EQ(mapped->size(), docs.size());
+  ASSERT_EQ(mapped->FailedPaths(), std::vector<std::string>{ paths[2] });
+  for (size_t i = 0; i < docs.size(); ++i) {
+    ASSERT_EQ((*mapped)[i], docs[i]);
+  }
+  std::cout << "Loaded " << mapped->TotalBytes() << " bytes at " << mapped->GigabytesPerSecond() << " GB/s" << std::endl;
+
+  // A directory opens as a stream but reports no usable size; it fails like a missing file
+  std::vector<std::string> with_directory = { paths[0], dir.string(), paths[1] };
+  for (bool copy_files : { false, true }) {
+    MappedDocuments loaded = DocumentLoader(2, copy_files).Load(with_directory);
+    ASSERT_EQ(loaded.size(), 2u) << copy_files;
+    ASSERT_EQ(loaded.FailedPaths(), std::vector<std::string>{ dir.string() }) << copy_files;
+    ASSERT_EQ(loaded[1], docs[1]) << copy_files;
+  }
+
+  InvertedIndex from_files;
+  from_files.UpdateMappedDocumentBase(mapped);
+  InvertedIndex from_strings;
+  from_strings.UpdateDocumentBase(docs);
+  for (const std::string word : { "milk", "water", "cappuccino", "sugar" }) {
+    ASSERT_EQ(from_files.GetWordCount(word), from_strings.GetWordCount(word)) << word;
+  }
+
+  mapped.reset();
+  ASSERT_EQ(from_files.GetWordCount("americano"), (std::vector<Entry>{ {4, 1} }));
+  std::filesystem::remove_all(dir);
+}
+
+TEST(ScratchArenaTest, GrowsToPeakAndReuses) {
+  ScratchArena arena(1024);
+  for (int round = 0; round < 3; ++round) {
+    arena.Reset();
+    std::pmr::vector<size_t> values(arena.Resource());
+    allocation_count = 0;
+    count_allocations = true;
+    for (size_t i = 0; i < 4096; ++i) {
+      values.push_back(i);
+    }
+    count_allocations = false;
+    if (round > 0) {
+      ASSERT_EQ(allocation_count, 0u);
+    }
+  }
+  ASSERT_GE(arena.Capacity(), 4096 * sizeof(size_t));
+}
+
+TEST(SearchServerTest, SteadyStateQueryAllocations) {
+  std::vector<std::string> docs;
+  for (int i = 0; i < 2000; ++i) {
+    docs.push_back("milk water coffee" + std::string(i % 3, ' ') + " tea" + std::to_string(i % 50) + " sugar");
+  }
+  InvertedIndex idx;
+  idx.UpdateDocumentBase(docs);
+  SearchServer srv(idx, 5);
+  const std::vector<std::string> request = { "Milk, sugar and TEA7 coffee milk" };
+
+  // The first query overflows the arena of this thread, the next reset grows it to fit
+  auto expected = srv.search(request);
+  srv.search(request);
+  ASSERT_EQ(expected[0].size(), 5u);
+
+  for (int i = 0; i < 10; ++i) {
+    allocation_count = 0;
+    count_allocations = true;
+    auto result = srv.search(request);
+    count_allocations = false;
+    // One for the list of queries and one for the results of the query
+    ASSERT_LE(allocation_count, 2u);
+    ASSERT_EQ(result, expected);
+  }
+
+  // Batches run on persistent workers, whose arenas also survive from one batch to the next
+  SearchServer pooled(idx, 5);
+  pooled.SetWorkerThreads(4);
+  std::vector<std::string> batch;
+  for (int i = 0; i < 16; ++i) {
+    batch.push_back("milk sugar tea" + std::to_string(i % 50) + " coffee");
+  }
+  auto batch_expected = pooled.search(batch);
+  for (int warmup = 0; warmup < 20; ++warmup) {
+    pooled.search(batch);
+  }
+  for (int i = 0; i < 10; ++i) {
+    allocation_count = 0;
+    count_allocations = true;
+    auto result = pooled.search(batch);
+    count_allocations = false;
+    // The list of lists and one result list per query, counted on every thread
+    ASSERT_LE(allocation_count, 1u + batch.size());
+    ASSERT_EQ(result, batch_expected);
+  }
+  ASSERT_THROW(pooled.SetWorkerThreads(2), std::runtime_error);
+}
+
+TEST(SearchServerTest, ImpactOrderedPostings) {
+  // Zipf-like corpus: low word ids are frequent, repeated counts vary per document
+  std::mt19937 rng(7);
+  std::vector<std::string> docs;
+  for (int i = 0; i < 20000; ++i) {
+    std::string doc;
+    for (int j = 0; j < 40; ++j) {
+      int word = static_cast<int>(std::pow(static_cast<double>(rng() % 10000) / 10000.0, 3) * 2000);
+      doc += "w" + std::to_string(word) + " ";
+    }
+    docs.push_back(doc);
+  }
+  const std::vector<std::string> requests = {
+    "w0", "w1", "w5", "w0 w1", "w0 w2 w3", "w1 w700", "w1500 w1900", "w0 missing", "w3 w3 w4"
+  };
+
+  InvertedIndex plain;
+  plain.UpdateDocumentBase(docs);
+  auto expected = SearchServer(plain, 5).search(requests);
+
+  for (size_t top_k : { size_t{0}, size_t{50} }) {
+    InvertedIndex impact;
+    impact.SetImpactOrdering({ 1000, top_k });
+    impact.UpdateDocumentBase(docs);
+    ASSERT_FALSE(impact.FindImpactOrdered("w0").empty());
+    ASSERT_TRUE(impact.FindImpactOrdered("w1900").empty());
+    ASSERT_GT(impact.GetMemoryUsage().impact_bytes, 0u);
+    ASSERT_EQ(SearchServer(impact, 5).search(requests), expected) << "top_k " << top_k;
+  }
+
+  InvertedIndex impact;
+  impact.SetImpactOrdering({ 1000, 50 });
+  impact.UpdateDocumentBase(docs);
+  std::vector<std::string> hot_requests(200, "w0");
+  auto time_queries = [&hot_requests](InvertedIndex& idx) {
+    SearchServer srv(idx, 5);
+    auto start = std::chrono::steady_clock::now();
+    srv.search(hot_requests);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(end - start).count() / static_cast<double>(hot_requests.size());
+  };
+  double plain_us = time_queries(plain);
+  double impact_us = time_queries(impact);
+  std::cout << "Hot single-term query: " << plain_us << " us exhaustive, " << impact_us << " us from top-k list, "
+            << impact.GetMemoryUsage().impact_bytes << " bytes of impact-ordered postings" << std::endl;
+  ASSERT_LT(impact_us, plain_us);
+}
+
+TEST(DocumentBitmapTest, MatchesReferenceSet) {
+  std::mt19937 rng(11);
+  auto random_set = [&rng](size_t count, size_t range) {
+    std::set<size_t> ids;
+    while (ids.size() < count) {
+      ids.insert(rng() % range);
+    }
+    return ids;
+  };
+  auto to_bitmap = [](const std::set<size_t>& ids) {
+    DocumentBitmap bitmap;
+    for (auto it = ids.rbegin(); it != ids.rend(); ++it) {
+      bitmap.Add(*it);
+    }
+    return bitmap;
+  };
+
+  // Dense sets use bitmap containers, sparse sets array containers
+  std::set<size_t> dense = random_set(60000, 200000);
+  std::set<size_t> sparse = random_set(3000, 200000);
+  DocumentBitmap dense_bitmap = to_bitmap(dense);
+  DocumentBitmap sparse_bitmap = to_bitmap(sparse);
+  ASSERT_EQ(dense_bitmap.Cardinality(), dense.size());
+  ASSERT_EQ(dense_bitmap.ToVector(), std::vector<size_t>(dense.begin(), dense.end()));
+  ASSERT_LT(dense_bitmap.SizeInBytes(), dense.size() * sizeof(uint16_t));
+  for (size_t id = 0; id < 200000; id += 7) {
+    ASSERT_EQ(sparse_bitmap.Contains(id), sparse.count(id) == 1) << id;
+  }
+
+  std::vector<size_t> expected;
+  std::set_intersection(dense.begin(), dense.end(), sparse.begin(), sparse.end(), std::back_inserter(expected));
+  DocumentBitmap intersection = dense_bitmap;
+  intersection.IntersectWith(sparse_bitmap);
+  ASSERT_EQ(intersection.ToVector(), expected);
+
+  expected.clear();
+  std::set_union(dense.begin(), dense.end(), sparse.begin(), sparse.end(), std::back_inserter(expected));
+  DocumentBitmap united = sparse_bitmap;
+  united.UnionWith(dense_bitmap);
+  ASSERT_EQ(united.ToVector(), expected);
+  ASSERT_EQ(united.Cardinality(), expected.size());
+
+  // Removing most of a dense set turns its containers back into arrays and drops empty ones
+  std::set<size_t> remaining;
+  for (size_t id : dense) {
+    if (id % 20 == 0 || id >= 65536) {
+      remaining.insert(id);
+    } else {
+      dense_bitmap.Remove(id);
+    }
+  }
+  dense_bitmap.Remove(200001);
+  ASSERT_EQ(dense_bitmap.ToVector(), std::vector<size_t>(remaining.begin(), remaining.end()));
+  ASSERT_EQ(dense_bitmap.Cardinality(), remaining.size());
+  for (size_t id : remaining) {
+    dense_bitmap.Remove(id);
+  }
+  ASSERT_TRUE(dense_bitmap.Empty());
+}
+
+TEST(SearchServerTest, MetadataFilter) {
+  std::mt19937 rng(3);
+  std::vector<std::string> docs;
+  std::vector<DocumentMetadata> metadata;
+  for (int i = 0; i < 5000; ++i) {
+    std::string doc;
+    for (int j = 0; j < 20; ++j) {
+      doc += "w" + std::to_string(rng() % (j < 10 ? 5 : 300)) + " ";
+    }
+    docs.push_back(doc);
+    metadata.push_back({
+      { "type", i % 3 == 0 ? "md" : "txt" },
+      { "date", "2024-" + std::string(i % 12 < 9 ? "0" : "") + std::to_string(i % 12 + 1) + "-01" }
+    });
+  }
+  const std::vector<std::string> requests = { "w0", "w1 w2", "w7 w250", "w299" };
+  DocumentFilter filter = DocumentFilter::Parse("type:txt,pdf date:2024-03-01..2024-06-01");
+  ASSERT_EQ(filter.Clauses().size(), 2u);
+  ASSERT_THROW(DocumentFilter::Parse("type"), std::invalid_argument);
+
+  // Reference: documents outside the filter are replaced by empty ones
+  std::vector<std::string> filtered_docs = docs;
+  size_t matching = 0;
+  for (size_t i = 0; i < docs.size(); ++i) {
+    bool month_ok = i % 12 >= 2 && i % 12 <= 5;
+    if (i % 3 == 0 || !month_ok) {
+      filtered_docs[i] = " ";
+    } else {
+      ++matching;
+    }
+  }
+  InvertedIndex reference;
+  reference.UpdateDocumentBase(filtered_docs);
+  auto expected = SearchServer(reference, 5).search(requests);
+
+  for (size_t top_k : { size_t{0}, size_t{20} }) {
+    InvertedIndex idx;
+    idx.SetImpactOrdering({ top_k == 0 ? 0 : size_t{500}, top_k });
+    idx.SetDocumentMetadata(metadata);
+    idx.UpdateDocumentBase(docs);
+    ASSERT_EQ(idx.MatchDocuments(filter).Cardinality(), matching);
+    ASSERT_GT(idx.GetMemoryUsage().metadata_bytes, 0u);
+    auto result = SearchServer(idx, 5).search(requests, filter);
+    ASSERT_EQ(result, expected) << "top_k " << top_k;
+    for (const auto& answer : result) {
+      ASSERT_EQ(answer.size(), 5u);
+    }
+  }
+}
+
+TEST(ShardCoordinatorTest, MergesShardsLikeSingleIndex) {
+  std::mt19937 rng(11);
+  std::vector<std::string> docs;
+  for (int i = 0; i < 900; ++i) {
+    std::string doc;
+    for (int j = 0; j < 15; ++j) {
+      doc += "w" + std::to_string(rng() % (j < 5 ? 8 : 400)) + " ";
+    }
+    docs.push_back(doc);
+  }
+  const std::vector<std::string> requests = { "w0", "w1 w3", "w7 w250", "w399", "missing" };
+  InvertedIndex reference;
+  reference.UpdateDocumentBase(docs);
+  auto expected = SearchServer(reference, 5).search(requests);
+
+  auto directory = std::filesystem::temp_directory_path() / ("shards_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(directory);
+  const size_t shard_count = 3;
+  std::vector<std::unique_ptr<InvertedIndex>> indexes;
+  std::vector<std::unique_ptr<ShardServer>> servers;
+  std::vector<std::thread> threads;
+  std::vector<std::string> addresses;
+  for (size_t shard = 0; shard < shard_count; ++shard) {
+    size_t first = docs.size() * shard / shard_count;
+    size_t last = docs.size() * (shard + 1) / shard_count;
+    indexes.push_back(std::make_unique<InvertedIndex>());
+    indexes.back()->UpdateDocumentBase({ docs.begin() + first, docs.begin() + last });
+    servers.push_back(std::make_unique<ShardServer>(*indexes.back(), first));
+    addresses.push_back("unix:" + (directory / ("shard" + std::to_string(shard) + ".sock")).string());
+    servers.back()->Listen(addresses.back());
+    threads.emplace_back(&ShardServer::Serve, servers.back().get());
+  }
+
+  {
+    ShardCoordinator coordinator(addresses, std::chrono::milliseconds(5000), 5);
+    for (int round = 0; round < 2; ++round) {
+      for (size_t i = 0; i < requests.size(); ++i) {
+        CoordinatedResult result = coordinator.Search(requests[i]);
+        ASSERT_FALSE(result.Partial());
+        ASSERT_EQ(result.results, expected[i]) << requests[i];
+      }
+    }
+    ASSERT_THROW(coordinator.Search(""), std::invalid_argument);
+
+    // A shard that accepts connections but never answers is reported, not waited for
+    std::string stalled = "unix:" + (directory / "stalled.sock").string();
+    int stalled_fd = ShardProtocol::Listen(stalled);
+    std::vector<std::string> with_stalled = addresses;
+    with_stalled.push_back(stalled);
+    ShardCoordinator partial(with_stalled, std::chrono::milliseconds(200), 5);
+    auto start = std::chrono::steady_clock::now();
+    CoordinatedResult result = partial.Search(requests[0]);
+    ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+    ASSERT_TRUE(result.Partial());
+    ASSERT_EQ(result.failed_shards, std::vector<size_t>{ shard_count });
+    ASSERT_EQ(result.results, expected[0]);
+    ::close(stalled_fd);
+
+    // A shard restarted behind a pooled connection is reached again on a fresh one
+    servers[0]->Stop();
+    threads[0].join();
+    servers[0] = std::make_unique<ShardServer>(*indexes[0], 0);
+    servers[0]->Listen(addresses[0]);
+    threads[0] = std::thread(&ShardServer::Serve, servers[0].get());
+    result = coordinator.Search(requests[1]);
+    ASSERT_FALSE(result.Partial());
+    ASSERT_EQ(result.results, expected[1]);
+
+    // A shard that is down is reported the same way
+    servers[1]->Stop();
+    threads[1].join();
+    result = coordinator.Search(requests[0]);
+    ASSERT_TRUE(result.Partial());
+    ASSERT_EQ(result.failed_shards, std::vector<size_t>{ 1 });
+  }
+
+  for (size_t shard = 0; shard < shard_count; ++shard) {
+    servers[shard]->Stop();
+    if (threads[shard].joinable()) {
+      threads[shard].join();
+    }
+  }
+  std::filesystem::remove_all(directory);
+}
+
+TEST(LoadGeneratorTest, CorrectsCoordinatedOmission) {
+  auto directory = std::filesystem::temp_directory_path() / ("loadgen_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(directory);
+  std::ofstream(directory / "requests.json") << "{\n  \"requests\": [\n    \"milk water\",\n    \"caf\\u00e9 \\\"x\\\"\"\n  ]\n}";
+  std::ofstream(directory / "log.jsonl") << "\"sugar\"\n{\"ts\": 1, \"query\": \"tea\"}\n\ncoffee beans\n";
+  ASSERT_EQ(LoadGenerator::ReadQueryLog((directory / "requests.json").string()),
+            (std::vector<std::string>{ "milk water", "caf\xC3\xA9 \"x\"" }));
+  ASSERT_EQ(LoadGenerator::ReadQueryLog((directory / "log.jsonl").string()),
+            (std::vector<std::string>{ "sugar", "tea", "coffee beans" }));
+  std::filesystem::remove_all(directory);
+
+  // One 100 ms stall on a single worker: 1 query in 500 is slow to serve, but the ~100 queries
+  // due during the stall all wait behind it
+  std::atomic<int> calls{0};
+  LoadGenerator generator({ "q" }, [&calls](const std::string&) {
+    if (++calls == 50) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+  }, 1);
+  LoadReport report = generator.Run(1000.0, std::chrono::milliseconds(500));
+  ASSERT_EQ(report.completed, 500u);
+  ASSERT_EQ(report.errors, 0u);
+  ASSERT_LT(report.service.Percentile(90), 10'000'000u);
+  ASSERT_GT(report.latency.Percentile(90), 10'000'000u);
+  ASSERT_GE(report.latency.Max(), 100'000'000u);
+}
+
+TEST(SearchServerTest, AsyncDeadlineAndCancellation) {
+  std::vector<std::string> docs;
+  for (int i = 0; i < 20000; ++i) {
+    docs.push_back("common w" + std::to_string(i % 50) + (i % 7 == 0 ? " rare" : ""));
+  }
+  InvertedIndex idx;
+  idx.UpdateDocumentBase(docs);
+  SearchServer server(idx, 5);
+  const std::vector<std::string> requests = { "common", "w3 rare", "rare", "missing" };
+  auto expected = server.search(requests);
+
+  auto far = std::chrono::steady_clock::now() + std::chrono::hours(1);
+  std::vector<std::future<SearchOutcome>> pending;
+  for (const auto& request : requests) {
+    pending.push_back(server.SearchAsync(request, far));
+  }
+  for (size_t i = 0; i < requests.size(); ++i) {
+    SearchOutcome outcome = pending[i].get();
+    ASSERT_FALSE(outcome.truncated);
+    ASSERT_EQ(outcome.results, expected[i]);
+  }
+
+  // A query past its deadline, or cancelled, stops before reading postings
+  SearchOutcome late = server.SearchAsync("common", std::chrono::steady_clock::now()).get();
+  ASSERT_TRUE(late.truncated);
+  ASSERT_TRUE(late.results.empty());
+
+  CancellationToken token;
+  pending.clear();
+  for (int i = 0; i < 50; ++i) {
+    pending.push_back(server.SearchAsync("common rare", far, token));
+  }
+  token.Cancel();
+  for (auto& outcome : pending) {
+    SearchOutcome result = outcome.get();
+    ASSERT_LE(result.results.size(), 5u);
+    if (!result.truncated) {
+      ASSERT_EQ(result.results.size(), 5u);
+    }
+  }
+  ASSERT_TRUE(server.SearchAsync("common", far, token).get().truncated);
+
+  ASSERT_THROW(server.SearchAsync("", far).get(), std::invalid_argument);
+}
+
+TEST(SearchServerTest, TruncatedCommonTermPass) {
+  // Every candidate has one rare occurrence and 1 to 3 common ones
+  std::vector<std::string> docs;
+  for (int i = 0; i < 20000; ++i) {
+    std::string doc = i % 4 == 0 ? "rare" : "filler";
+    for (int j = 0; j <= i % 3; ++j) doc += " common";
+    docs.push_back(doc);
+  }
+  InvertedIndex idx;
+  idx.UpdateDocumentBase(docs);
+  SearchServer server(idx, 5000);
+  server.SetCommonTermFrequency(10000);
+  auto expected = server.search({ "rare common" })[0];
+  ASSERT_EQ(expected.size(), 5000u);
+
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_FALSE(server.SearchAsync("rare common", start + std::chrono::hours(1)).get().truncated);
+  auto full = std::chrono::steady_clock::now() - start;
+
+  // Deadlines spread over the query cut it at different points, most of them in the common-term
+  // pass: a truncated result holds only rare-term counts, never a mix with fully scored documents
+  for (int step = 1; step < 40; ++step) {
+    SearchOutcome outcome = server.SearchAsync("rare common", std::chrono::steady_clock::now() + full * step / 40).get();
+    if (!outcome.truncated) {
+      ASSERT_EQ(outcome.results, expected);
+      continue;
+    }
+    for (const auto& result : outcome.results) {
+      ASSERT_FLOAT_EQ(result.rank, 1.0f) << "step " << step;
+    }
+  }
+}
+
+TEST(SearchServerTest, QueryPlanner) {
+  std::vector<std::string> docs;
+  std::vector<size_t> common_counts, mid_counts, rare_counts;
+  for (size_t i = 0; i < 5000; ++i) {
+    size_t common = 1 + i % 3;
+    size_t mid = i % 10 == 0 ? 1 + i % 4 : 0;
+    size_t rare = i % 97 == 0 ? 1 : 0;
+    std::string doc;
+    for (size_t j = 0; j < common; ++j) doc += "common ";
+    for (size_t j = 0; j < mid; ++j) doc += "mid ";
+    for (size_t j = 0; j < rare; ++j) doc += "rare ";
+    docs.push_back(doc + "filler" + std::to_string(i));
+    common_counts.push_back(common);
+    mid_counts.push_back(mid);
+    rare_counts.push_back(rare);
+  }
+  InvertedIndex idx;
+  idx.UpdateDocumentBase(docs);
+  SearchServer server(idx, 5);
+
+  // Terms are ordered by document frequency rather than alphabetically
+  QueryPlan plan = server.Explain("mid common rare missing");
+  ASSERT_EQ(plan.strategy, QueryStrategy::Exhaustive);
+  ASSERT_EQ(plan.terms.size(), 3u);
+  ASSERT_EQ(plan.terms[0].term, "rare");
+  ASSERT_EQ(plan.terms[1].term, "mid");
+  ASSERT_EQ(plan.terms[2].term, "common");
+  ASSERT_EQ(plan.terms[2].document_frequency, 5000u);
+  ASSERT_EQ(plan.postings_read, 5000u + 500u + 52u);
+  auto all_terms = server.search({ "mid common rare" });
+
+  // Above the threshold, "common" only scores documents that contain a rarer term
+  server.SetCommonTermFrequency(1000);
+  plan = server.Explain("mid common rare");
+  ASSERT_EQ(plan.strategy, QueryStrategy::RareTermsFirst);
+  ASSERT_TRUE(plan.terms[2].scoring_only);
+  ASSERT_FALSE(plan.terms[1].scoring_only);
+  ASSERT_EQ(plan.postings_read, 500u + 52u);
+  ASSERT_EQ(plan.candidates, 546u);
+  ASSERT_EQ(plan.random_lookups, plan.candidates);
+  std::ostringstream explain;
+  plan.Write(explain);
+  ASSERT_NE(explain.str().find("rare-terms-first"), std::string::npos);
+  ASSERT_NE(explain.str().find("scoring-only"), std::string::npos);
+
+  std::vector<DocumentScore> expected;
+  for (size_t i = 0; i < docs.size(); ++i) {
+    if (mid_counts[i] + rare_counts[i] > 0) {
+      expected.push_back({ i, common_counts[i] + mid_counts[i] + rare_counts[i] });
+    }
+  }
+  std::sort(expected.begin(), expected.end(), [](const DocumentScore& a, const DocumentScore& b) {
+    return a.score != b.score ? a.score > b.score : a.doc_id < b.doc_id;
+  });
+  expected.resize(5);
+  ASSERT_EQ(server.SearchScores("mid common rare"), expected);
+  // Every document scores on "common", so the best ones still come from the full OR
+  ASSERT_EQ(server.search({ "mid common rare" }), all_terms);
+
+  // A query of common terms alone cannot defer them
+  plan = server.Explain("common");
+  ASSERT_EQ(plan.strategy, QueryStrategy::Exhaustive);
+  ASSERT_FALSE(plan.terms[0].scoring_only);
+
+  InvertedIndex impact;
+  impact.SetImpactOrdering({ 1000, 0 });
+  impact.UpdateDocumentBase(docs);
+  plan = SearchServer(impact, 5).Explain("common mid");
+  ASSERT_EQ(plan.strategy, QueryStrategy::ImpactOrdered);
+  ASSERT_LT(plan.postings_read, 5000u);
+}
+
+TEST(TestCaseInvertedIndex, TestIncrementalUpdate) {
+  std::mt19937 rng(11);
+  auto random_doc = [&rng]() {
+    std::string doc;
+    for (int j = 0; j < 30; ++j) {
+      doc += "w" + std::to_string(rng() % 60) + " ";
+    }
+    return doc;
+  };
+  std::vector<std::string> docs;
+  for (int i = 0; i < 300; ++i) {
+    docs.push_back(random_doc());
+  }
+
+  InvertedIndex incremental;
+  incremental.SetImpactOrdering({ 100, 20 });
+  incremental.UpdateDocumentBase(docs);
+  SearchServer server(incremental, 5);
+
+  // Modify, delete, add a brand new term, and append two documents; the last update of a document wins
+  std::vector<DocumentUpdate> updates = {
+    { 300, random_doc() }, { 3, "w1 w1 w1 brandnew" }, { 7, "" }, { 301, random_doc() }, { 42, random_doc() },
+    { 3, "w2 w2 brandnew brandnew" }
+  };
+  for (const auto& update : updates) {
+    if (update.doc_id >= docs.size()) {
+      docs.resize(update.doc_id + 1);
+    }
+    docs[update.doc_id] = update.text;
+  }
+  incremental.UpdateDocuments(updates);
+  ASSERT_EQ(incremental.DocumentCount(), 302u);
+  ASSERT_THROW(incremental.UpdateDocuments({ { 310, "gap" } }), std::invalid_argument);
+
+  InvertedIndex rebuilt;
+  rebuilt.SetImpactOrdering({ 100, 20 });
+  rebuilt.UpdateDocumentBase(docs);
+  for (int word = 0; word < 60; ++word) {
+    std::string term = "w" + std::to_string(word);
+    ASSERT_EQ(incremental.GetWordCount(term), rebuilt.GetWordCount(term)) << term;
+    ASSERT_TRUE(std::ranges::equal(incremental.FindImpactOrdered(term), rebuilt.FindImpactOrdered(term))) << term;
+  }
+  ASSERT_EQ(incremental.GetWordCount("brandnew"), (std::vector<Entry>{ {3, 2} }));
+
+  const std::vector<std::string> requests = { "w0", "w1 w2", "brandnew", "w5 w6 w7", "w59" };
+  ASSERT_EQ(server.search(requests), SearchServer(rebuilt, 5).search(requests));
+}
+
+TEST(DocumentWatcherTest, ReindexesChangedFiles) {
+  auto directory = std::filesystem::temp_directory_path() / ("watch_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(directory);
+  std::vector<std::string> paths;
+  for (const std::string text : { "milk water", "sugar", "coffee tea" }) {
+    paths.push_back((directory / ("doc" + std::to_string(paths.size()) + ".txt")).string());
+    std::ofstream(paths.back(), std::ios::binary) << text;
+  }
+  std::string late_path = (directory / "late.txt").string();
+  paths.push_back(late_path);
+
+  // Mapped files may be truncated under the index before the watcher sees the change
+  auto mapped = std::make_shared<MappedDocuments>(DocumentLoader().Load(paths));
+  InvertedIndex index;
+  ASSERT_THROW(DocumentWatcher(index, *mapped), std::invalid_argument);
+
+  auto copied = std::make_shared<MappedDocuments>(DocumentLoader(0, true).Load(paths));
+  ASSERT_FALSE(copied->Mapped());
+  index.SetDocumentMetadata(std::vector<DocumentMetadata>(3, { { "type", "txt" } }));
+  index.UpdateMappedDocumentBase(copied);
+  SearchServer server(index, 5);
+  DocumentWatcher watcher(index, *copied, std::chrono::milliseconds(20));
+  watcher.SetMetadataSource([](const std::string&) { return DocumentMetadata{ { "type", "md" } }; });
+
+  ASSERT_EQ(watcher.Rescan().updated, 0u);
+  std::ofstream(paths[0], std::ios::binary | std::ios::trunc) << "tea";
+  std::ofstream(paths[1], std::ios::binary | std::ios::trunc) << "sugar honey";
+  std::filesystem::remove(paths[2]);
+  ASSERT_EQ((*copied)[0], "milk water");
+  WatchBatch batch = watcher.Rescan();
+  ASSERT_EQ(batch.updated, 3u);
+  ASSERT_TRUE(index.GetWordCount("milk").empty());
+  ASSERT_EQ(index.GetWordCount("tea"), (std::vector<Entry>{ {0, 1} }));
+  ASSERT_EQ(index.GetWordCount("honey"), (std::vector<Entry>{ {1, 1} }));
+  ASSERT_TRUE(index.GetWordCount("coffee").empty());
+  // Changed documents take their new metadata; the deleted one has none left
+  ASSERT_EQ(index.MatchDocuments(DocumentFilter::Parse("type:md")).ToVector(), (std::vector<size_t>{ 0, 1 }));
+  ASSERT_TRUE(index.MatchDocuments(DocumentFilter::Parse("type:txt")).Empty());
+
+  // Rewriting the same contents is not re-indexed
+  std::ofstream(paths[1], std::ios::binary | std::ios::trunc) << "sugar honey";
+  ASSERT_EQ(watcher.Rescan().updated, 0u);
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  size_t reindexed = 0;
+  std::thread watching([&]() {
+    watcher.Run([&](const WatchBatch& applied) {
+      std::lock_guard lock(mutex);
+      reindexed += applied.updated;
+      changed.notify_all();
+    });
+  });
+  // The file is rewritten until the watcher, which starts asynchronously, reports it
+  bool searchable = false;
+  for (int attempt = 0; attempt < 50 && !searchable; ++attempt) {
+    std::ofstream(late_path, std::ios::binary | std::ios::trunc) << "honey honey";
+    std::unique_lock lock(mutex);
+    searchable = changed.wait_for(lock, std::chrono::milliseconds(100), [&reindexed]() { return reindexed > 0; });
+  }
+  watcher.Stop();
+  watching.join();
+  ASSERT_TRUE(searchable);
+  ASSERT_EQ(index.DocumentCount(), 4u);
+  ASSERT_EQ(server.search({ "honey" }).front().front().doc_id, 3u);
+  ASSERT_EQ(server.search({ "honey" }, DocumentFilter::Parse("type:md")).front().size(), 2u);
+  std::filesystem::remove_all(directory);
+}
+
+TEST(SearchServerTest, Snippets) {
+  std::vector<std::string> docs = {
+    "Fresh milk,  cold\tMILK! (milk)",
+    "",
+    "Кофе и молоко: МОЛОКО.",
+  };
+  std::string long_doc;
+  for (int i = 0; i < 30; ++i) long_doc += "alpha ";
+  long_doc += "beta\n\ngamma ";
+  for (int i = 0; i < 30; ++i) long_doc += "delta ";
+  docs.push_back(long_doc);
+  docs.push_back("delta gamma");
+
+  InvertedIndex idx;
+  idx.SetTermOffsets(true);
+  idx.UpdateDocumentBase(docs);
+  ASSERT_GT(idx.GetMemoryUsage().offsets_bytes, 0u);
+  ASSERT_EQ(idx.FindOccurrences(0, "milk").size(), 3u);
+  ASSERT_EQ(idx.FindOccurrences(0, "milk")[1].offset, 18u);
+  ASSERT_EQ(idx.FindOccurrences(0, "milk")[1].length, 4u);
+  ASSERT_EQ(idx.FindOccurrences(0, "milk")[2].offset, 25u);
+  ASSERT_EQ(idx.FindOccurrences(2, idx.AnalyzeWord("молоко")).size(), 2u);
+  ASSERT_TRUE(idx.FindOccurrences(1, "milk").empty());
+
+  SearchServer server(idx, 5);
+  server.SetSnippetOptions({ 40, "[", "]" });
+  Snippet snippet = server.MakeSnippet("milk", 0);
+  ASSERT_EQ(snippet.text, "Fresh [milk], cold [MILK]! ([milk])");
+  ASSERT_EQ(snippet.highlights, 3u);
+  ASSERT_EQ(server.MakeSnippet("МОЛОКО", 2).text, "Кофе и [молоко]: [МОЛОКО].");
+
+  // The window covering the rare terms wins over the one with the most occurrences of a common term
+  snippet = server.MakeSnippet("delta gamma beta", 3);
+  ASSERT_EQ(snippet.text.substr(0, 14), "[beta] [gamma]") << snippet.text;
+  ASSERT_LE(snippet.end - snippet.begin, 40u);
+  ASSERT_EQ(server.MakeSnippet("gamma", 3).text.substr(0, 17), "alpha beta [gamma");
+  ASSERT_EQ(server.MakeSnippet("missing", 3).text.substr(0, 11), "alpha alpha");
+
+  auto answers = server.search({ "milk", "gamma" });
+  auto snippets = server.Snippets({ "milk", "gamma" }, answers);
+  ASSERT_EQ(snippets[1].size(), answers[1].size());
+  for (size_t i = 0; i < answers[1].size(); ++i) {
+    ASSERT_EQ(snippets[1][i].doc_id, answers[1][i].doc_id);
+    ASSERT_NE(snippets[1][i].text.find("[gamma]"), std::string::npos);
+  }
+
+  // Offsets follow incremental updates
+  idx.UpdateDocuments({ { 1, "skim milk" } });
+  ASSERT_EQ(server.MakeSnippet("milk", 1).text, "skim [milk]");
+
+  // A no-break space separates words and counts as two bytes of the original text
+  idx.UpdateDocuments({ { 1, "Ça\u00A0va,\u00A0lait\u00A0\u00A0milk" } });
+  ASSERT_EQ(idx.FindOccurrences(1, "milk").size(), 1u);
+  ASSERT_EQ(idx.FindOccurrences(1, "milk")[0].offset, 18u);
+  ASSERT_EQ(server.MakeSnippet("lait milk", 1).text, "Ça\u00A0va,\u00A0[lait]\u00A0\u00A0[milk]");
+
+  InvertedIndex plain;
+  plain.UpdateDocumentBase(docs);
+  ASSERT_THROW(SearchServer(plain, 5).MakeSnippet("milk", 0), std::runtime_error);
+
+  // Stored offsets against finding the words by scanning the documents again
+  std::mt19937 rng(5);
+  std::vector<std::string> large_docs;
+  for (int i = 0; i < 200; ++i) {
+    std::string doc;
+    for (int j = 0; j < 3000; ++j) {
+      doc += "w" + std::to_string(rng() % 500) + (j % 7 == 0 ? ", " : " ");
+    }
+    large_docs.push_back(doc);
+  }
+  InvertedIndex large;
+  large.SetTermOffsets(true);
+  large.UpdateDocumentBase(large_docs);
+  SearchServer large_server(large, 5);
+  std::vector<std::string> queries;
+  for (int i = 0; i < 200; ++i) {
+    queries.push_back("w" + std::to_string(rng() % 500) + " w" + std::to_string(rng() % 500));
+  }
+  auto large_answers = large_server.search(queries);
+  auto start = std::chrono::steady_clock::now();
+  auto large_snippets = large_server.Snippets(queries, large_answers);
+  double offsets_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+  start = std::chrono::steady_clock::now();
+  size_t rescanned = 0;
+  for (size_t q = 0; q < queries.size(); ++q) {
+    std::set<std::string> terms;
+    std::istringstream words(queries[q]);
+    for (std::string word; words >> word;) terms.insert(large.AnalyzeWord(word));
+    for (const auto& result : large_answers[q]) {
+      std::istringstream text(large_docs[result.doc_id]);
+      for (std::string word; text >> word;) rescanned += terms.count(large.AnalyzeWord(word));
+    }
+  }
+  double rescan_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+  size_t highlighted = 0, hits = 0;
+  for (const auto& per_query : large_snippets) {
+    for (const auto& hit : per_query) {
+      highlighted += hit.highlights;
+      ++hits;
+    }
+  }
+  ASSERT_GT(highlighted, hits);
+  ASSERT_LE(highlighted, rescanned);
+  std::cout << "Snippets: " << offsets_us / static_cast<double>(hits) << " us per hit from offsets, "
+            << rescan_us / static_cast<double>(hits) << " us per hit rescanning, "
+            << large.GetMemoryUsage().offsets_bytes << " bytes of offsets" << std::endl;
+  ASSERT_LT(offsets_us, rescan_us);
+}
+
+TEST(TestCaseInvertedIndex, TestNumaReplicas) {
+  std::mt19937 rng(17);
+  std::vector<std::string> docs;
+  for (int i = 0; i < 400; ++i) {
+    std::string doc;
+    for (int j = 0; j < 25; ++j) {
+      doc += "w" + std::to_string(rng() % 80) + " ";
+    }
+    docs.push_back(doc);
+  }
+
+  // Two simulated nodes sharing CPU 0, so the test runs on any machine
+  NumaTopology two_nodes({ { 0 }, { 0 } });
+  InvertedIndex placed;
+  placed.SetImpactOrdering({ 100, 20 });
+  placed.SetNumaTopology(&two_nodes);
+  placed.UpdateDocumentBase(docs);
+  InvertedIndex plain;
+  plain.SetImpactOrdering({ 100, 20 });
+  plain.UpdateDocumentBase(docs);
+  ASSERT_GT(placed.GetMemoryUsage().replica_bytes, 0u);
+  ASSERT_EQ(plain.GetMemoryUsage().replica_bytes, 0u);
+
+  const std::vector<std::string> requests = { "w0", "w1 w2", "w5 w6 w7", "w79 w3", "missing" };
+  ASSERT_EQ(SearchServer(placed, 5).search(requests), SearchServer(plain, 5).search(requests));
+
+  // Workers pinned to different nodes read different copies of the same postings
+  auto lookup_as = [&placed, &two_nodes](size_t worker, const std::string& term) {
+    std::span<const Entry> postings;
+    std::thread([&]() {
+      two_nodes.PinWorker(worker);
+      postings = placed.FindTerm(term);
+    }).join();
+    return postings;
+  };
+  std::span<const Entry> node0 = lookup_as(0, "w1");
+  std::span<const Entry> node1 = lookup_as(1, "w1");
+  ASSERT_FALSE(node0.empty());
+  ASSERT_NE(node0.data(), node1.data());
+  ASSERT_TRUE(std::ranges::equal(node0, node1));
+
+  // Incremental updates reach every copy
+  placed.UpdateDocuments({ { 5, "w1 w1 numanew" } });
+  plain.UpdateDocuments({ { 5, "w1 w1 numanew" } });
+  for (size_t worker = 0; worker < 2; ++worker) {
+    for (const std::string term : { "w1", "numanew" }) {
+      std::span<const Entry> postings = lookup_as(worker, term);
+      ASSERT_FALSE(postings.empty()) << term;
+      ASSERT_TRUE(std::ranges::equal(postings, plain.FindTerm(term))) << term;
+    }
+  }
+
+  // A node whose CPUs cannot be used is not recorded as the thread's node
+  NumaTopology offline({ { 0 }, { 1000 } });
+  std::thread([&offline]() {
+    ASSERT_FALSE(offline.PinWorker(1));
+    ASSERT_EQ(offline.CurrentNode(), 0u);
+    ASSERT_TRUE(offline.PinWorker(0));
+  }).join();
+
+  // The real topology of a single-node machine leaves the index as it is
+  if (NumaTopology::System().NodeCount() == 1) {
+    InvertedIndex local;
+    local.SetNumaTopology(&NumaTopology::System());
+    local.UpdateDocumentBase(docs);
+    ASSERT_EQ(local.GetMemoryUsage().replica_bytes, 0u);
+    ASSERT_EQ(SearchServer(local, 5).search(requests), SearchServer(plain, 5).search(requests));
+  }
+}
+
+TEST(SearchServerTest, CursorPagination) {
+  std::mt19937 rng(23);
+  std::vector<std::string> docs;
+  for (int i = 0; i < 3000; ++i) {
+    std::string doc;
+    for (int j = 0; j < 20; ++j) {
+      doc += "w" + std::to_string(rng() % 50) + " ";
+    }
+    docs.push_back(doc);
+  }
+  InvertedIndex index;
+  index.SetImpactOrdering({ 500, 100000 });
+  index.UpdateDocumentBase(docs);
+
+  // Pages concatenate to the full ranking on every evaluation path
+  for (size_t common_frequency : { size_t(0), size_t(1000) }) {
+    SearchServer paged(index, 7);
+    SearchServer full(index, 100000);
+    paged.SetCommonTermFrequency(common_frequency);
+    full.SetCommonTermFrequency(common_frequency);
+    for (const std::string query : { "w1", "w2 w3", "w4 w5 w6 w7", "w8 missing", "missing" }) {
+      std::vector<DocumentScore> expected = full.SearchScores(query);
+      std::vector<RelativeIndex> concatenated;
+      std::string cursor;
+      size_t pages = 0;
+      do {
+        SearchPage page = paged.SearchPaged(query, cursor);
+        ASSERT_LE(page.results.size(), 7u);
+        concatenated.insert(concatenated.end(), page.results.begin(), page.results.end());
+        cursor = page.next_cursor;
+        ASSERT_LT(++pages, 1000u);
+      } while (!cursor.empty());
+      ASSERT_EQ(concatenated.size(), expected.size()) << query;
+      for (size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_EQ(concatenated[i].doc_id, expected[i].doc_id) << query << " #" << i;
+        ASSERT_FLOAT_EQ(concatenated[i].rank, static_cast<float>(expected[i].score) / expected.front().score);
+      }
+    }
+  }
+
+  SearchCursor cursor{ 12, 345678, 40, SearchCursor::HashQuery("w1") };
+  ASSERT_EQ(SearchCursor::Decode(cursor.Encode()), cursor);
+  ASSERT_LE(cursor.Encode().size(), 24u);
+  ASSERT_THROW(SearchCursor::Decode("not a cursor!"), std::invalid_argument);
+  ASSERT_THROW(SearchCursor::Decode(cursor.Encode().substr(0, 6)), std::invalid_argument);
+  SearchServer server(index, 7);
+  std::string next = server.SearchPaged("w1").next_cursor;
+  ASSERT_FALSE(next.empty());
+  ASSERT_THROW(server.SearchPaged("w2", next), std::invalid_argument);
+
+  // A cursor is tied to the filter of its query as well
+  DocumentBitmap even, even_rebuilt, odd;
+  for (size_t doc_id = 0; doc_id < index.DocumentCount(); ++doc_id) {
+    (doc_id % 2 == 0 ? even : odd).Add(doc_id);
+  }
+  for (size_t doc_id = index.DocumentCount(); doc_id-- > 0;) {
+    if (doc_id % 2 == 0) {
+      even_rebuilt.Add(doc_id);
+    }
+  }
+  ASSERT_EQ(even.Hash(), even_rebuilt.Hash());
+  std::string filtered = server.SearchPaged("w1", {}, &even).next_cursor;
+  ASSERT_FALSE(filtered.empty());
+  ASSERT_NO_THROW(server.SearchPaged("w1", filtered, &even_rebuilt));
+  ASSERT_THROW(server.SearchPaged("w1", filtered, &odd), std::invalid_argument);
+  ASSERT_THROW(server.SearchPaged("w1", filtered), std::invalid_argument);
+  ASSERT_THROW(server.SearchPaged("w1", next, &even), std::invalid_argument);
+
+  // A deep page resumes from its cursor instead of re-running the query for every result above it
+  const std::string query = "w9";
+  const size_t page_size = 10, depth = 60;
+  SearchServer paging(index, static_cast<int>(page_size));
+  std::vector<std::string> cursors = { "" };
+  for (size_t page = 0; page < depth; ++page) {
+    cursors.push_back(paging.SearchPaged(query, cursors.back()).next_cursor);
+  }
+  ASSERT_FALSE(cursors.back().empty());
+  SearchServer rerun(index, static_cast<int>(page_size * (depth + 1)));
+  const int rounds = 50;
+  auto time_us = [rounds](const std::function<void()>& run) {
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round) run();
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / rounds;
+  };
+  double first_us = time_us([&]() { paging.SearchPaged(query, cursors.front()); });
+  double deep_us = time_us([&]() { paging.SearchPaged(query, cursors.back()); });
+  double rerun_us = time_us([&]() { rerun.SearchScores(query); });
+  auto deep_page = paging.SearchPaged(query, cursors.back()).results;
+  auto rerun_tail = rerun.SearchScores(query);
+  ASSERT_EQ(deep_page.front().doc_id, rerun_tail[page_size * depth].doc_id);
+  std::cout << "Pagination: page 1 " << first_us << " us, page " << depth + 1 << " " << deep_us
+            << " us from its cursor, " << rerun_us << " us re-running with a larger limit" << std::endl;
+  ASSERT_LT(deep_us, rerun_us);
+}
+
+TEST(SearchServerTest, BatchAnswerCallback) {
+  InvertedIndex idx;
+  idx.UpdateDocumentBase({ "milk water", "milk sugar", "water tea" });
+  SearchServer srv(idx, 5);
+  srv.SetWorkerThreads(3);
+  std::vector<std::string> requests;
+  for (int i = 0; i < 40; ++i) {
+    requests.push_back(i % 2 ? "milk" : "water tea");
+  }
+
+  std::mutex mutex;
+  std::vector<int> calls(requests.size(), 0);
+  auto answers = srv.search(requests, DocumentFilter{}, [&](size_t i, const std::vector<RelativeIndex>& results) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++calls[i];
+    return !results.empty();
+  });
+  ASSERT_EQ(calls, std::vector<int>(requests.size(), 1));
+  ASSERT_EQ(answers, srv.search(requests));
+
+  // Returning false skips the queries that were not started yet
+  std::atomic<size_t> answered{0};
+  srv.search(requests, DocumentFilter{}, [&](size_t, const std::vector<RelativeIndex>&) {
+    return ++answered < 5;
+  });
+  ASSERT_LT(answered.load(), requests.size());
+}
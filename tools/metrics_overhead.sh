@@ -0,0 +1,77 @@
+#!/bin/sh
+# Measures the cost of the built-in metrics: builds search_bench with SEARCH_ENGINE_METRICS
+# ON and OFF, runs both over the same corpus and fails if indexing time or query throughput
+# is more than MAX_OVERHEAD_PCT (default 2) worse with metrics. The GUI is left out of the
+# builds, so the script needs no Qt.
+# Usage: tools/metrics_overhead.sh <queries-file> <document>...
+# ROUNDS of ON/OFF pairs (default 41), RUNS per build and round (default 3), PASSES over the
+# query log per run (default 100) and BUILD_ROOT (default a temporary directory) tune the runs.
+set -eu
+
+if [ "$#" -lt 2 ]; then
+  echo "Usage: $0 <queries-file> <document>..." >&2
+  exit 2
+fi
+
+SOURCE_DIR=$(cd "$(dirname "$0")/.." && pwd)
+QUERIES=$1
+shift
+ROUNDS=${ROUNDS:-41}
+RUNS=${RUNS:-3}
+PASSES=${PASSES:-100}
+MAX_OVERHEAD_PCT=${MAX_OVERHEAD_PCT:-2}
+BUILD_ROOT=${BUILD_ROOT:-$(mktemp -d)}
+
+for metrics in ON OFF; do
+  cmake -S "$SOURCE_DIR" -B "$BUILD_ROOT/metrics_$metrics" -DCMAKE_BUILD_TYPE=Release \
+    -DSEARCH_ENGINE_METRICS=$metrics -DSEARCH_ENGINE_GUI=OFF >/dev/null
+  cmake --build "$BUILD_ROOT/metrics_$metrics" --target search_bench -j >/dev/null
+done
+
+# Alternate the builds, and which of them goes first, and compare each ON run with the OFF run
+# next to it, so that drift in machine load weighs on both sides of a pair; the median over the
+# pairs is reported
+pairs=""
+round=0
+while [ "$round" -lt "$ROUNDS" ]; do
+  if [ $((round % 2)) -eq 0 ]; then
+    on=$("$BUILD_ROOT/metrics_ON/search_bench" --log "$QUERIES" --runs "$RUNS" --passes "$PASSES" "$@")
+    off=$("$BUILD_ROOT/metrics_OFF/search_bench" --log "$QUERIES" --runs "$RUNS" --passes "$PASSES" "$@")
+  else
+    off=$("$BUILD_ROOT/metrics_OFF/search_bench" --log "$QUERIES" --runs "$RUNS" --passes "$PASSES" "$@")
+    on=$("$BUILD_ROOT/metrics_ON/search_bench" --log "$QUERIES" --runs "$RUNS" --passes "$PASSES" "$@")
+  fi
+  pairs="$pairs$on $off
+"
+  round=$((round + 1))
+done
+
+printf '%s' "$pairs" | awk -v max="$MAX_OVERHEAD_PCT" '
+  function median(values, count,    i, j, value) {
+    for (i = 2; i <= count; ++i) {
+      value = values[i]
+      for (j = i - 1; j >= 1 && values[j] > value; --j) values[j + 1] = values[j]
+      values[j + 1] = value
+    }
+    return count % 2 ? values[(count + 1) / 2] : (values[count / 2] + values[count / 2 + 1]) / 2
+  }
+  {
+    for (i = 1; i <= NF; ++i) {
+      split($i, field, "=")
+      if (field[1] == "metrics") build = field[2]
+      else if (field[1] == "index_ms") index_ms[build] = field[2]
+      else if (field[1] == "qps") qps[build] = field[2]
+    }
+    ++pairs
+    index_pct[pairs] = (index_ms["on"] - index_ms["off"]) / index_ms["off"] * 100
+    query_pct[pairs] = (qps["off"] - qps["on"]) / qps["off"] * 100
+  }
+  END {
+    index_median = median(index_pct, pairs)
+    query_median = median(query_pct, pairs)
+    printf "index_overhead_pct=%.2f query_overhead_pct=%.2f target_pct=%s pairs=%d\n", index_median, query_median, max, pairs
+    if (index_median > max || query_median > max) {
+      print "Metrics overhead exceeds the target." > "/dev/stderr"
+      exit 1
+    }
+  }'
@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "DocumentLoader.h"
+#include "InvertedIndex.h"
+#include "LoadGenerator.h"
+#include "Metrics.h"
+#include "SearchServer.h"
+#include "TextAnalyzer.h"
+
+namespace {
+
+void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program << " --log <requests.json | queries.jsonl> [--runs N] [--passes P]\n"
+            << "       [--limit K] [--stop-words] [--stemming] [--dedup D] <document>...\n"
+            << "Builds the index over the documents and runs every query of the log P times on one\n"
+            << "thread, N times over, and prints the build time and query throughput of the fastest runs\n"
+            << "with the size of the index. --stop-words and --stemming enable the analysis stage, and\n"
+            << "--dedup collapses documents within SimHash distance D, so runs with and without them\n"
+            << "report what they save." << std::endl;
+}
+
+// Noise from other processes only ever slows a run down, so the fastest run is the closest to the cost of the code
+double Fastest(const std::vector<double>& values, bool lower_is_faster) {
+  return lower_is_faster ? *std::min_element(values.begin(), values.end()) : *std::max_element(values.begin(), values.end());
+}
+
+} // namespace
+
+/**
+ * Closed-loop benchmark of indexing and querying. Built once with and once without
+ * SEARCH_ENGINE_METRICS, it measures the cost of the instrumentation (tools/metrics_overhead.sh).
+ */
+int main(int argc, char *argv[]) {
+  std::string log_path;
+  std::vector<std::string> documents;
+  size_t runs = 10;
+  size_t passes = 100;
+  int limit = 5;
+  TextAnalyzer analyzer;
+  int dedup_distance = -1;
+
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string argument = argv[i];
+      bool has_value = i + 1 < argc;
+      if (argument == "--log" && has_value) {
+        log_path = argv[++i];
+      } else if (argument == "--runs" && has_value) {
+        runs = std::stoul(argv[++i]);
+      } else if (argument == "--passes" && has_value) {
+        passes = std::stoul(argv[++i]);
+      } else if (argument == "--limit" && has_value) {
+        limit = std::stoi(argv[++i]);
+      } else if (argument == "--stop-words") {
+        analyzer.SetStopWords(TextAnalyzer::DefaultStopWords());
+      } else if (argument == "--stemming") {
+        analyzer.SetStemming(true);
+      } else if (argument == "--dedup" && has_value) {
+        dedup_distance = std::stoi(argv[++i]);
+      } else if (argument.rfind("--", 0) == 0) {
+        PrintUsage(argv[0]);
+        return 2;
+      } else {
+        documents.push_back(argument);
+      }
+    }
+  } catch (const std::exception&) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+  if (log_path.empty() || documents.empty() || runs == 0 || passes == 0 || dedup_distance > 64) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+
+  try {
+    std::vector<std::string> queries = LoadGenerator::ReadQueryLog(log_path);
+    if (queries.empty()) {
+      throw std::runtime_error("The query log is empty.");
+    }
+    auto mapped = std::make_shared<MappedDocuments>(DocumentLoader().Load(documents));
+
+    std::vector<double> index_ms, qps;
+    IndexMemoryUsage usage;
+    DeduplicationStats dedup_stats;
+    for (size_t run = 0; run < runs; ++run) {
+      InvertedIndex index;
+      index.SetAnalyzer(analyzer);
+      index.SetDeduplication(dedup_distance >= 0, dedup_distance >= 0 ? static_cast<unsigned>(dedup_distance) : 0);
+      auto start = std::chrono::steady_clock::now();
+      index.UpdateMappedDocumentBase(mapped);
+      auto built = std::chrono::steady_clock::now();
+      index_ms.push_back(std::chrono::duration<double, std::milli>(built - start).count());
+      usage = index.GetMemoryUsage();
+      dedup_stats = index.GetDeduplicationStats();
+
+      // Queries run on this thread only, so the workers of the pool add no scheduling noise
+      SearchServer server(index, limit);
+      start = std::chrono::steady_clock::now();
+      for (size_t pass = 0; pass < passes; ++pass) {
+        for (const auto& query : queries) {
+          try {
+            server.SearchScores(query);
+          } catch (const std::invalid_argument&) {
+            // Empty queries are rejected the same way in both builds
+          }
+        }
+      }
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      qps.push_back(static_cast<double>(queries.size() * passes) / seconds);
+    }
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "metrics=" << (SEARCH_ENGINE_METRICS ? "on" : "off")
+              << " documents=" << mapped->size() << " queries=" << queries.size() * passes
+              << " index_ms=" << Fastest(index_ms, true) << " qps=" << Fastest(qps, false)
+              << " dictionary_bytes=" << usage.dictionary_bytes << " postings_bytes=" << usage.postings_bytes;
+    if (dedup_distance >= 0) {
+      std::cout << " exact_duplicates=" << dedup_stats.exact_duplicates
+                << " near_duplicates=" << dedup_stats.near_duplicates << " postings_saved=" << dedup_stats.postings_saved;
+    }
+    std::cout << std::endl;
+  } catch (const std::exception& e) {
+    std::cerr << "Benchmark error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,147 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Metrics.h"
+#include "ShardCoordinator.h"
+
+namespace {
+
+void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program << " --shard <address> [--shard <address>...] [--timeout-ms N] [--limit K]\n"
+            << "       [--filter EXPR] [--bench SECONDS] [--clients N] [query...]\n"
+            << "Queries are read from standard input, one per line, when none are given." << std::endl;
+}
+
+/**
+ * @brief Runs queries from several closed-loop clients and prints throughput and latency.
+ */
+void RunBenchmark(ShardCoordinator& coordinator, const std::vector<std::string>& queries, const std::string& filter,
+                  double seconds, size_t clients) {
+  std::vector<LatencyHistogram> latencies(clients);
+  std::atomic<size_t> partial{0};
+  std::atomic<bool> running{true};
+  std::vector<std::thread> threads;
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t client = 0; client < clients; ++client) {
+    threads.emplace_back([&, client]() {
+      for (size_t i = client; running; i += clients) {
+        auto query_start = std::chrono::steady_clock::now();
+        try {
+          if (coordinator.Search(queries[i % queries.size()], filter).Partial()) {
+            ++partial;
+          }
+        } catch (const std::exception&) {
+          ++partial;
+        }
+        auto elapsed = std::chrono::steady_clock::now() - query_start;
+        latencies[client].Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+      }
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  running = false;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  LatencyHistogram total;
+  for (const auto& latency : latencies) {
+    total.Merge(latency);
+  }
+  std::cout << "shards=" << coordinator.ShardCount() << " clients=" << clients
+            << " queries=" << total.Count() << " qps=" << static_cast<double>(total.Count()) / elapsed
+            << " p50_us=" << static_cast<double>(total.Percentile(50)) / 1e3
+            << " p99_us=" << static_cast<double>(total.Percentile(99)) / 1e3
+            << " partial=" << partial << std::endl;
+}
+
+} // namespace
+
+/**
+ * Coordinator of the distributed mode: fans queries out to shard nodes and merges
+ * their top results. With --bench it measures the aggregate throughput instead.
+ */
+int main(int argc, char *argv[]) {
+  std::vector<std::string> shards;
+  std::vector<std::string> queries;
+  std::string filter;
+  int timeout_ms = 1000;
+  int limit = 5;
+  double bench_seconds = 0.0;
+  size_t clients = std::thread::hardware_concurrency() == 0 ? 4 : std::thread::hardware_concurrency();
+
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string argument = argv[i];
+      bool has_value = i + 1 < argc;
+      if (argument == "--shard" && has_value) {
+        shards.push_back(argv[++i]);
+      } else if (argument == "--timeout-ms" && has_value) {
+        timeout_ms = std::stoi(argv[++i]);
+      } else if (argument == "--limit" && has_value) {
+        limit = std::stoi(argv[++i]);
+      } else if (argument == "--filter" && has_value) {
+        filter = argv[++i];
+      } else if (argument == "--bench" && has_value) {
+        bench_seconds = std::stod(argv[++i]);
+      } else if (argument == "--clients" && has_value) {
+        clients = std::stoul(argv[++i]);
+      } else if (argument.rfind("--", 0) == 0) {
+        PrintUsage(argv[0]);
+        return 2;
+      } else {
+        queries.push_back(argument);
+      }
+    }
+  } catch (const std::exception&) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+  if (shards.empty() || clients == 0) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+  if (queries.empty()) {
+    for (std::string line; std::getline(std::cin, line);) {
+      if (!line.empty()) {
+        queries.push_back(line);
+      }
+    }
+  }
+
+  try {
+    ShardCoordinator coordinator(shards, std::chrono::milliseconds(timeout_ms), limit);
+    if (bench_seconds > 0.0) {
+      if (queries.empty()) {
+        throw std::invalid_argument("No queries to benchmark.");
+      }
+      RunBenchmark(coordinator, queries, filter, bench_seconds, clients);
+      return 0;
+    }
+
+    for (const auto& query : queries) {
+      CoordinatedResult result = coordinator.Search(query, filter);
+      std::cout << query << ":";
+      for (const auto& [doc_id, rank] : result.results) {
+        std::cout << " " << doc_id << "(" << rank << ")";
+      }
+      if (result.Partial()) {
+        std::cout << "  [partial, missing shards:";
+        for (size_t shard : result.failed_shards) {
+          std::cout << " " << shard;
+        }
+        std::cout << "]";
+      }
+      std::cout << std::endl;
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "Coordinator error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
\ No newline at end of file
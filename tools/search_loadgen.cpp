@@ -0,0 +1,159 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "DocumentLoader.h"
+#include "InvertedIndex.h"
+#include "LoadGenerator.h"
+#include "SearchServer.h"
+#include "ShardCoordinator.h"
+
+namespace {
+
+void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program << " --log <requests.json | queries.jsonl> [--qps N] [--duration-s S]\n"
+            << "       [--concurrency N] [--sweep [--growth F] [--max-qps N]] [--limit K]\n"
+            << "       (--shard <address> [--shard <address>...] [--timeout-ms N] | [--snippets W] <document>...)\n"
+            << "Replays the log at a fixed arrival rate against the shard coordinator, or against an\n"
+            << "in-process SearchServer over the given documents; --snippets also cuts a W-byte\n"
+            << "snippet for every hit." << std::endl;
+}
+
+double Microseconds(uint64_t nanoseconds) {
+  return static_cast<double>(nanoseconds) / 1e3;
+}
+
+void PrintReport(const LoadReport& report) {
+  const LatencyHistogram& latency = report.latency;
+  std::cout << std::fixed << std::setprecision(1)
+            << "target_qps=" << report.target_qps << " achieved_qps=" << report.achieved_qps
+            << " queries=" << report.completed << " errors=" << report.errors
+            << " p50_us=" << Microseconds(latency.Percentile(50))
+            << " p99_us=" << Microseconds(latency.Percentile(99))
+            << " p999_us=" << Microseconds(latency.Percentile(99.9))
+            << " max_us=" << Microseconds(latency.Max())
+            << " service_p99_us=" << Microseconds(report.service.Percentile(99))
+            << (report.Saturated() ? " SATURATED" : "") << std::endl;
+}
+
+} // namespace
+
+/**
+ * Open-loop load generator: replays a query log at a target arrival rate and reports
+ * throughput and latency percentiles corrected for coordinated omission. With --sweep
+ * the rate grows until the target saturates.
+ */
+int main(int argc, char *argv[]) {
+  std::string log_path;
+  std::vector<std::string> shards;
+  std::vector<std::string> documents;
+  double qps = 100.0;
+  double duration_s = 10.0;
+  double growth = 1.5;
+  double max_qps = 1e6;
+  bool sweep = false;
+  size_t concurrency = 64;
+  int timeout_ms = 1000;
+  int limit = 5;
+  size_t snippet_window = 0;
+
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string argument = argv[i];
+      bool has_value = i + 1 < argc;
+      if (argument == "--log" && has_value) {
+        log_path = argv[++i];
+      } else if (argument == "--qps" && has_value) {
+        qps = std::stod(argv[++i]);
+      } else if (argument == "--duration-s" && has_value) {
+        duration_s = std::stod(argv[++i]);
+      } else if (argument == "--concurrency" && has_value) {
+        concurrency = std::stoul(argv[++i]);
+      } else if (argument == "--sweep") {
+        sweep = true;
+      } else if (argument == "--growth" && has_value) {
+        growth = std::stod(argv[++i]);
+      } else if (argument == "--max-qps" && has_value) {
+        max_qps = std::stod(argv[++i]);
+      } else if (argument == "--shard" && has_value) {
+        shards.push_back(argv[++i]);
+      } else if (argument == "--timeout-ms" && has_value) {
+        timeout_ms = std::stoi(argv[++i]);
+      } else if (argument == "--limit" && has_value) {
+        limit = std::stoi(argv[++i]);
+      } else if (argument == "--snippets" && has_value) {
+        snippet_window = std::stoul(argv[++i]);
+      } else if (argument.rfind("--", 0) == 0) {
+        PrintUsage(argv[0]);
+        return 2;
+      } else {
+        documents.push_back(argument);
+      }
+    }
+  } catch (const std::exception&) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+  if (log_path.empty() || shards.empty() == documents.empty()) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+
+  try {
+    std::vector<std::string> queries = LoadGenerator::ReadQueryLog(log_path);
+
+    std::unique_ptr<ShardCoordinator> coordinator;
+    InvertedIndex index;
+    std::unique_ptr<SearchServer> server;
+    LoadGenerator::Target target;
+    if (!shards.empty()) {
+      coordinator = std::make_unique<ShardCoordinator>(shards, std::chrono::milliseconds(timeout_ms), limit);
+      target = [&coordinator](const std::string& query) {
+        if (coordinator->Search(query).Partial()) {
+          throw std::runtime_error("Partial result");
+        }
+      };
+    } else {
+      auto mapped = std::make_shared<MappedDocuments>(DocumentLoader().Load(documents));
+      index.SetTermOffsets(snippet_window > 0);
+      index.UpdateMappedDocumentBase(mapped);
+      server = std::make_unique<SearchServer>(index, limit);
+      if (snippet_window > 0) {
+        server->SetSnippetOptions({ snippet_window });
+        target = [&server](const std::string& query) {
+          for (const auto& hit : server->SearchScores(query)) {
+            server->MakeSnippet(query, hit.doc_id);
+          }
+        };
+      } else {
+        target = [&server](const std::string& query) {
+          server->SearchScores(query);
+        };
+      }
+    }
+
+    LoadGenerator generator(std::move(queries), target, concurrency);
+    auto duration = std::chrono::milliseconds(static_cast<int64_t>(duration_s * 1000));
+    if (!sweep) {
+      PrintReport(generator.Run(qps, duration));
+      return 0;
+    }
+
+    std::vector<LoadReport> reports = generator.Sweep(qps, growth, max_qps, duration);
+    for (const auto& report : reports) {
+      PrintReport(report);
+    }
+    if (reports.back().Saturated()) {
+      std::cout << "Saturation point: " << reports.back().achieved_qps << " qps (last sustained rate: "
+                << (reports.size() > 1 ? reports[reports.size() - 2].target_qps : 0.0) << " qps)" << std::endl;
+    } else {
+      std::cout << "Not saturated at " << reports.back().target_qps << " qps" << std::endl;
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "Load generator error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
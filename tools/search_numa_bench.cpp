@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "DocumentLoader.h"
+#include "InvertedIndex.h"
+#include "LoadGenerator.h"
+#include "NumaTopology.h"
+#include "SearchServer.h"
+
+namespace {
+
+void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program << " --log <requests.json | queries.jsonl> [--threads N] [--duration-s S]\n"
+            << "       [--limit K] <document>...\n"
+            << "Runs the queries from workers pinned round-robin over the NUMA nodes, first over\n"
+            << "an index placed without NUMA awareness and then over one replicated per node, and\n"
+            << "reports the throughput and the share of postings bytes read from a remote node." << std::endl;
+}
+
+/**
+ * @brief Throughput and postings locality of one run.
+ */
+struct BenchResult {
+  double qps = 0.0;
+  uint64_t local_bytes = 0;
+  uint64_t remote_bytes = 0;
+  uint64_t unknown_bytes = 0; // Pages whose node the kernel did not report.
+};
+
+/**
+ * @brief Runs the queries for the given time from pinned workers over one index.
+ * Every worker also looks up the postings of its queries' terms and checks on which node
+ * their pages sit during its first pass over the log, so sampling does not weigh on throughput.
+ */
+BenchResult Run(InvertedIndex& index, const std::vector<std::string>& queries, const NumaTopology& topology,
+                size_t threads, std::chrono::milliseconds duration, int limit) {
+  std::atomic<uint64_t> completed{0}, local{0}, remote{0}, unknown{0};
+  std::atomic<bool> stopping{false};
+  std::vector<std::thread> workers;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t worker = 0; worker < threads; ++worker) {
+    workers.emplace_back([&, worker]() {
+      topology.PinWorker(worker);
+      SearchServer server(index, limit);
+      int node = static_cast<int>(topology.CurrentNode());
+      uint64_t done = 0;
+      for (size_t next = worker; !stopping.load(std::memory_order_relaxed); next = (next + 1) % queries.size()) {
+        const std::string& query = queries[next];
+        server.SearchScores(query);
+        ++done;
+        if (done > queries.size()) {
+          continue;
+        }
+        std::istringstream words(query);
+        for (std::string word; words >> word;) {
+          std::span<const Entry> postings = index.FindTerm(index.AnalyzeWord(word));
+          if (postings.empty()) {
+            continue;
+          }
+          uint64_t bytes = postings.size_bytes();
+          int page_node = NumaTopology::NodeOfAddress(postings.data());
+          (page_node < 0 ? unknown : page_node == node ? local : remote) += bytes;
+        }
+      }
+      completed += done;
+    });
+  }
+  std::this_thread::sleep_for(duration);
+  stopping = true;
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  BenchResult result;
+  result.qps = static_cast<double>(completed.load()) / seconds;
+  result.local_bytes = local;
+  result.remote_bytes = remote;
+  result.unknown_bytes = unknown;
+  return result;
+}
+
+void PrintResult(const char* placement, const BenchResult& result) {
+  uint64_t known = result.local_bytes + result.remote_bytes;
+  double remote_share = known > 0 ? 100.0 * static_cast<double>(result.remote_bytes) / static_cast<double>(known) : 0.0;
+  std::cout << std::fixed << std::setprecision(1)
+            << "placement=" << placement << " qps=" << result.qps
+            << " remote_postings_pct=" << remote_share
+            << " sampled_bytes=" << known << " unknown_bytes=" << result.unknown_bytes << std::endl;
+}
+
+} // namespace
+
+/**
+ * NUMA placement benchmark: compares throughput and remote postings reads of pinned query
+ * workers with and without per-node replicas of the index.
+ */
+int main(int argc, char *argv[]) {
+  std::string log_path;
+  std::vector<std::string> documents;
+  const NumaTopology& topology = NumaTopology::System();
+  size_t threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+  double duration_s = 5.0;
+  int limit = 5;
+
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string argument = argv[i];
+      bool has_value = i + 1 < argc;
+      if (argument == "--log" && has_value) {
+        log_path = argv[++i];
+      } else if (argument == "--threads" && has_value) {
+        threads = std::stoul(argv[++i]);
+      } else if (argument == "--duration-s" && has_value) {
+        duration_s = std::stod(argv[++i]);
+      } else if (argument == "--limit" && has_value) {
+        limit = std::stoi(argv[++i]);
+      } else if (argument.rfind("--", 0) == 0) {
+        PrintUsage(argv[0]);
+        return 2;
+      } else {
+        documents.push_back(argument);
+      }
+    }
+  } catch (const std::exception&) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+  if (log_path.empty() || documents.empty() || threads == 0) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+
+  try {
+    std::vector<std::string> queries = LoadGenerator::ReadQueryLog(log_path);
+    if (queries.empty()) {
+      throw std::runtime_error("The query log is empty.");
+    }
+    auto mapped = std::make_shared<MappedDocuments>(DocumentLoader().Load(documents));
+    auto duration = std::chrono::milliseconds(static_cast<int64_t>(duration_s * 1000));
+
+    std::cout << "nodes=" << topology.NodeCount() << " threads=" << threads << std::endl;
+    if (topology.NodeCount() == 1) {
+      std::cout << "Single NUMA node: placement is a no-op, both runs read the same memory." << std::endl;
+    }
+
+    {
+      InvertedIndex index;
+      index.UpdateMappedDocumentBase(mapped);
+      PrintResult("off", Run(index, queries, topology, threads, duration, limit));
+    }
+    {
+      InvertedIndex index;
+      index.SetNumaTopology(&topology);
+      index.UpdateMappedDocumentBase(mapped);
+      std::cout << "replica_bytes=" << index.GetMemoryUsage().replica_bytes << std::endl;
+      PrintResult("replicated", Run(index, queries, topology, threads, duration, limit));
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "Benchmark error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,66 @@
+#include <csignal>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "DocumentLoader.h"
+#include "InvertedIndex.h"
+#include "ShardServer.h"
+
+/**
+ * Shard node of the distributed mode.
+ * Usage: search_shard <address> <shard> <shard-count> <file>...
+ * The files are the whole corpus in document order; the node indexes its contiguous
+ * slice of them and serves queries on the address until SIGINT or SIGTERM.
+ */
+int main(int argc, char *argv[]) {
+  if (argc < 5) {
+    std::cerr << "Usage: " << argv[0] << " <unix:/path | host:port> <shard> <shard-count> <file>..." << std::endl;
+    return 2;
+  }
+
+  try {
+    std::string address = argv[1];
+    size_t shard = std::stoul(argv[2]);
+    size_t shard_count = std::stoul(argv[3]);
+    std::vector<std::string> files(argv + 4, argv + argc);
+    if (shard_count == 0 || shard >= shard_count) {
+      throw std::invalid_argument("Shard index must be below the shard count.");
+    }
+
+    size_t first_doc = files.size() * shard / shard_count;
+    size_t end_doc = files.size() * (shard + 1) / shard_count;
+    std::vector<std::string> own_files(files.begin() + first_doc, files.begin() + end_doc);
+
+    // Signals are taken by sigwait below, not by the serving threads
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    auto documents = std::make_shared<MappedDocuments>(DocumentLoader().Load(own_files));
+    if (documents->size() != own_files.size()) {
+      // Document IDs must stay aligned with the corpus file list
+      throw std::runtime_error("Some documents of the shard could not be read.");
+    }
+    InvertedIndex index;
+    index.UpdateMappedDocumentBase(documents);
+
+    ShardServer server(index, first_doc);
+    server.Listen(address);
+    std::cout << "Shard " << shard << "/" << shard_count << " serving documents " << first_doc << "-"
+              << end_doc - 1 << " on " << address << std::endl;
+
+    std::thread serving(&ShardServer::Serve, &server);
+    int signal = 0;
+    sigwait(&signals, &signal);
+    server.Stop();
+    serving.join();
+  } catch (const std::exception& e) {
+    std::cerr << "Shard error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "DocumentLoader.h"
+#include "DocumentWatcher.h"
+#include "InvertedIndex.h"
+#include "SearchServer.h"
+
+namespace {
+
+void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program << " [--debounce-ms N] [--limit K] <document>...\n"
+            << "Indexes the documents, re-indexes them as they change on disk and answers\n"
+            << "queries read from stdin, one per line, until EOF." << std::endl;
+}
+
+} // namespace
+
+/**
+ * Watch mode: keeps the index in sync with the document files while serving queries,
+ * and reports the time-to-searchable of every batch of changes on stderr.
+ */
+int main(int argc, char *argv[]) {
+  std::vector<std::string> documents;
+  int debounce_ms = 100;
+  int limit = 5;
+
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string argument = argv[i];
+      bool has_value = i + 1 < argc;
+      if (argument == "--debounce-ms" && has_value) {
+        debounce_ms = std::stoi(argv[++i]);
+      } else if (argument == "--limit" && has_value) {
+        limit = std::stoi(argv[++i]);
+      } else if (argument.rfind("--", 0) == 0) {
+        PrintUsage(argv[0]);
+        return 2;
+      } else {
+        documents.push_back(argument);
+      }
+    }
+  } catch (const std::exception&) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+  if (documents.empty()) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+
+  try {
+    // Watched files are copied: a mapping of a file truncated before its change is applied faults on read
+    auto loaded = std::make_shared<MappedDocuments>(DocumentLoader(0, true).Load(documents));
+    InvertedIndex index;
+    index.UpdateMappedDocumentBase(loaded);
+    SearchServer server(index, limit);
+    DocumentWatcher watcher(index, *loaded, std::chrono::milliseconds(debounce_ms));
+
+    std::thread watching([&watcher]() {
+      try {
+        watcher.Run([](const WatchBatch& batch) {
+          std::cerr << std::fixed << std::setprecision(2)
+                    << "reindexed=" << batch.updated << " unchanged=" << batch.unchanged
+                    << " index_ms=" << batch.index_ms
+                    << " time_to_searchable_ms=" << batch.searchable_ms << std::endl;
+        });
+      } catch (const std::exception& e) {
+        std::cerr << "Watcher error: " << e.what() << std::endl;
+      }
+    });
+
+    std::string query;
+    while (std::getline(std::cin, query)) {
+      auto answers = server.search({ query });
+      for (const auto& result : answers.front()) {
+        std::cout << result.doc_id << "\t" << result.rank << "\n";
+      }
+      std::cout << std::endl;
+    }
+
+    watcher.Stop();
+    watching.join();
+  } catch (const std::exception& e) {
+    std::cerr << "Watch mode error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,61 @@
+#!/bin/sh
+# Measures the aggregate QPS of the distributed mode as shard processes are added.
+# Usage: tools/shard_scaling.sh <build-dir> <queries-file> <document>...
+# MAX_SHARDS (default 4), SECONDS_PER_RUN (default 5) and CLIENTS (default 8) tune the runs.
+set -eu
+
+if [ "$#" -lt 3 ]; then
+  echo "Usage: $0 <build-dir> <queries-file> <document>..." >&2
+  exit 2
+fi
+
+BUILD_DIR=$1
+QUERIES=$2
+shift 2
+MAX_SHARDS=${MAX_SHARDS:-4}
+SECONDS_PER_RUN=${SECONDS_PER_RUN:-5}
+CLIENTS=${CLIENTS:-8}
+SOCKET_DIR=$(mktemp -d)
+PIDS=""
+
+cleanup() {
+  for pid in $PIDS; do
+    kill "$pid" 2>/dev/null || true
+  done
+  wait 2>/dev/null || true
+  rm -rf "$SOCKET_DIR"
+}
+trap cleanup EXIT INT TERM
+
+shards=1
+while [ "$shards" -le "$MAX_SHARDS" ]; do
+  PIDS=""
+  addresses=""
+  shard=0
+  while [ "$shard" -lt "$shards" ]; do
+    socket="$SOCKET_DIR/shard$shard.sock"
+    "$BUILD_DIR/search_shard" "unix:$socket" "$shard" "$shards" "$@" >/dev/null &
+    PIDS="$PIDS $!"
+    addresses="$addresses --shard unix:$socket"
+    shard=$((shard + 1))
+  done
+
+  # Wait until every shard has built its index and is listening
+  shard=0
+  while [ "$shard" -lt "$shards" ]; do
+    while [ ! -S "$SOCKET_DIR/shard$shard.sock" ]; do
+      sleep 0.1
+    done
+    shard=$((shard + 1))
+  done
+
+  # shellcheck disable=SC2086
+  "$BUILD_DIR/search_coordinator" $addresses --bench "$SECONDS_PER_RUN" --clients "$CLIENTS" < "$QUERIES"
+
+  for pid in $PIDS; do
+    kill "$pid"
+  done
+  wait
+  PIDS=""
+  shards=$((shards * 2))
+done